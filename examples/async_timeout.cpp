@@ -60,6 +60,7 @@ void Worker::onConnect(boost::system::error_code ec)
     }
     else
     {
+        timer.cancel();
         std::cerr << "connected\n";
         get();
     }
@@ -67,7 +68,15 @@ void Worker::onConnect(boost::system::error_code ec)
 
 void Worker::onGet(const redisclient::RedisValue &value)
 {
-    timer.cancel();
+    if (value.isError())
+    {
+        std::cerr << "GET failed: " << value.toString() << std::endl;
+        redisClient.disconnect();
+        // try again
+        run();
+        return;
+    }
+
     std::cerr << "GET " << value.toString() << std::endl;
     sleep(1);
 
@@ -76,10 +85,8 @@ void Worker::onGet(const redisclient::RedisValue &value)
 
 void Worker::get()
 {
-    timer.expires_from_now(timeout);
-    timer.async_wait(std::bind(&Worker::onTimeout, this, std::placeholders::_1));
-
-    redisClient.command("GET",  {redisKey},
+    // The client arms the command timeout itself, no per-call timer needed.
+    redisClient.command("GET",  {redisKey}, timeout,
             std::bind(&Worker::onGet, this, std::placeholders::_1));
 }
 
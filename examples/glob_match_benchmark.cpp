@@ -0,0 +1,288 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <redisclient/globmatcher.h>
+
+// Cost of finding the patterns matching a channel, from 16 to 4096
+// patterns: redisclient::GlobMatcher against matching each pattern in
+// turn, as a server does for PSUBSCRIBE. No server is needed.
+
+struct Config
+{
+    size_t channels;
+    size_t maxPatterns;
+    size_t repeat;
+    size_t cacheMb;
+};
+
+// Glob match of Redis (stringmatchlen), without nocase.
+static bool globMatch(const char *pattern, size_t patternLen, const char *string, size_t stringLen)
+{
+    while (patternLen && stringLen)
+    {
+        switch (pattern[0])
+        {
+        case '*':
+            while (patternLen > 1 && pattern[1] == '*')
+            {
+                ++pattern;
+                --patternLen;
+            }
+
+            if (patternLen == 1)
+                return true;
+
+            for(; stringLen; ++string, --stringLen)
+            {
+                if (globMatch(pattern + 1, patternLen - 1, string, stringLen))
+                    return true;
+            }
+
+            return false;
+        case '?':
+            break;
+        case '[':
+        {
+            bool negate, match = false;
+
+            ++pattern;
+            --patternLen;
+            negate = patternLen && pattern[0] == '^';
+
+            if (negate)
+            {
+                ++pattern;
+                --patternLen;
+            }
+
+            while (patternLen && pattern[0] != ']')
+            {
+                if (pattern[0] == '\\' && patternLen >= 2)
+                {
+                    ++pattern;
+                    --patternLen;
+                    match |= pattern[0] == string[0];
+                }
+                else if (patternLen >= 3 && pattern[1] == '-')
+                {
+                    unsigned char from = pattern[0], to = pattern[2], c = string[0];
+
+                    if (from > to)
+                        std::swap(from, to);
+
+                    match |= c >= from && c <= to;
+                    pattern += 2;
+                    patternLen -= 2;
+                }
+                else
+                {
+                    match |= pattern[0] == string[0];
+                }
+
+                ++pattern;
+                --patternLen;
+            }
+
+            if (match == negate)
+                return false;
+
+            if (patternLen == 0)
+            {
+                --pattern;
+                ++patternLen;
+            }
+
+            break;
+        }
+        case '\\':
+            if (patternLen >= 2)
+            {
+                ++pattern;
+                --patternLen;
+            }
+            // fall through
+        default:
+            if (pattern[0] != string[0])
+                return false;
+        }
+
+        ++string;
+        --stringLen;
+        ++pattern;
+        --patternLen;
+
+        if (stringLen == 0)
+        {
+            while (patternLen && pattern[0] == '*')
+            {
+                ++pattern;
+                --patternLen;
+            }
+        }
+    }
+
+    return patternLen == 0 && stringLen == 0;
+}
+
+static const char *venues[] = { "xnas", "xnys", "arcx", "bats", "iexg", "edgx", "memx", "xcbo" };
+static const char *events[] = { "trade", "quote", "book", "status" };
+
+static std::string symbol(size_t i)
+{
+    std::string s;
+
+    for(size_t n = i % 26 + 1, k = i; n; --n, k /= 3)
+        s += static_cast<char>('A' + (k * 7 + n) % 26);
+
+    return s;
+}
+
+// Patterns of market data consumers: by symbol, by venue and event,
+// with classes and single character wildcards.
+static std::string pattern(size_t i)
+{
+    std::string venue = venues[i % 8];
+    std::string sym = symbol(i / 8);
+
+    switch (i % 4)
+    {
+    case 0:
+        return "md." + venue + "." + sym + ".*";
+    case 1:
+        return "md.*." + sym + ".trade";
+    case 2:
+        return "md." + venue + ".[" + sym.substr(0, 1) + "-Z]*.quote";
+    default:
+        return "md.????." + sym + ".*";
+    }
+}
+
+// Best ns per channel of match over all channels; count gets the matches.
+template<typename Match>
+static double measure(const std::vector<std::string> &channels, size_t repeat,
+                      size_t &count, Match match)
+{
+    double best = 0;
+
+    for(size_t i = 0; i < repeat; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        count = 0;
+
+        for(const std::string &channel: channels)
+            count += match(channel);
+
+        double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count() / channels.size();
+
+        if (i == 0 || ns < best)
+            best = ns;
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    namespace po = boost::program_options;
+
+    Config config;
+
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "produce help message")
+        ("channels", po::value(&config.channels)->default_value(100000),
+             "number of channels matched")
+        ("max-patterns", po::value(&config.maxPatterns)->default_value(4096),
+             "largest number of patterns")
+        ("repeat", po::value(&config.repeat)->default_value(3),
+             "runs per matcher, the best one is reported")
+        ("cache-mb", po::value(&config.cacheMb)->default_value(
+             redisclient::GlobMatcher::defaultCacheBytes >> 20),
+             "MB of cached states of the compiled matcher")
+    ;
+
+    po::variables_map vm;
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), vm);
+        po::notify(vm);
+    }
+    catch(const po::error &e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if( vm.count("help") )
+    {
+        std::cout << description << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> channels;
+
+    channels.reserve(config.channels);
+
+    for(size_t i = 0; i < config.channels; ++i)
+    {
+        size_t k = i * 7919 % config.channels;
+
+        channels.push_back(std::string("md.") + venues[k % 8] + "." +
+                symbol(k / 32 % 1024) + "." + events[k / 8 % 4]);
+    }
+
+    std::cout << boost::format("%8s %12s %12s %10s %10s\n")
+        % "patterns" % "naive ns" % "compiled ns" % "speedup" % "matches";
+
+    for(size_t n = 16; n <= config.maxPatterns; n *= 4)
+    {
+        std::vector<std::string> patterns;
+        redisclient::GlobMatcher matcher(config.cacheMb << 20);
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            patterns.push_back(pattern(i));
+            matcher.add(patterns.back());
+        }
+
+        size_t naiveCount = 0;
+        size_t compiledCount = 0;
+
+        double naiveNs = measure(channels, config.repeat, naiveCount,
+                [&patterns](const std::string &channel) {
+                    size_t count = 0;
+
+                    for(const std::string &p: patterns)
+                        count += globMatch(p.data(), p.size(), channel.data(), channel.size());
+
+                    return count;
+                });
+        double compiledNs = measure(channels, config.repeat, compiledCount,
+                [&matcher](const std::string &channel) {
+                    return matcher.match(channel).size();
+                });
+
+        if (naiveCount != compiledCount)
+        {
+            std::cerr << "matches differ: " << naiveCount << " naive, "
+                << compiledCount << " compiled\n";
+            return EXIT_FAILURE;
+        }
+
+        std::cout << boost::format("%8d %12.1f %12.1f %9.1fx %10d\n")
+            % n % naiveNs % compiledNs % (naiveNs / compiledNs) % compiledCount;
+    }
+
+    return EXIT_SUCCESS;
+}
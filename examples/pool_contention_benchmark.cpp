@@ -0,0 +1,241 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <redisclient/impl/objectpool.h>
+
+// Acquire/release throughput and the longest wait for a connection of
+// pools under contention, from 1 to 64 threads: a deque guarded by one
+// mutex and condition variable (the ConnectionPool design) against
+// redisclient::ObjectPool. No server is needed, pooled objects are plain
+// integers.
+
+struct Config
+{
+    size_t poolSize;
+    size_t operations;
+    size_t work;
+    size_t maxThreads;
+    size_t repeat;
+};
+
+// Same locking scheme as ConnectionPool::fetch()/release().
+class MutexPool
+{
+public:
+    explicit MutexPool(size_t size)
+        : size(size), created(0)
+    {
+    }
+
+    ~MutexPool()
+    {
+        for(int *object: pool)
+            delete object;
+    }
+
+    int *fetch()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (pool.empty())
+        {
+            if (created == size)
+            {
+                cv.wait(lock, [this] { return !pool.empty(); });
+            }
+            else
+            {
+                ++created;
+                return new int(0);
+            }
+        }
+
+        int *object = pool.front();
+        pool.pop_front();
+
+        return object;
+    }
+
+    void release(int *object)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pool.push_back(object);
+        }
+
+        cv.notify_one();
+    }
+
+private:
+    size_t size;
+    size_t created;
+    std::deque<int *> pool;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// Simulate using the connection between fetch and release.
+static void doWork(int &object, size_t work)
+{
+    volatile int sink = object;
+
+    for(size_t i = 0; i < work; ++i)
+        sink = sink + 1;
+
+    object = sink;
+}
+
+// Called through a pointer, so that both pools run the very same loop
+// code instead of differently aligned inlined copies.
+static void (*volatile work)(int &, size_t) = &doWork;
+
+struct Result
+{
+    double rate;
+    double maxWaitUsec;
+};
+
+template<typename Worker>
+static Result run(size_t threads, const Config &config, Worker worker)
+{
+    std::vector<std::thread> workers;
+    std::vector<double> maxWait(threads, 0);
+    std::atomic<bool> start(false);
+
+    for(size_t i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i]() {
+            while (!start.load())
+                std::this_thread::yield();
+
+            for(size_t n = 0; n < config.operations; ++n)
+                maxWait[i] = std::max(maxWait[i], worker());
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+
+    start.store(true);
+
+    for(auto &thread: workers)
+        thread.join();
+
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+
+    Result result;
+
+    result.rate = threads * config.operations / seconds;
+    result.maxWaitUsec = *std::max_element(maxWait.begin(), maxWait.end());
+
+    return result;
+}
+
+// Microseconds since start.
+static double since(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    namespace po = boost::program_options;
+
+    Config config;
+
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "produce help message")
+        ("pool-size", po::value(&config.poolSize)->default_value(16),
+             "number of pooled connections")
+        ("operations", po::value(&config.operations)->default_value(200000),
+             "fetch/release pairs per thread")
+        ("work", po::value(&config.work)->default_value(50),
+             "busy loop iterations while a connection is held")
+        ("max-threads", po::value(&config.maxThreads)->default_value(64),
+             "largest number of threads")
+        ("repeat", po::value(&config.repeat)->default_value(3),
+             "runs per pool, the best one is reported")
+    ;
+
+    po::variables_map vm;
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), vm);
+        po::notify(vm);
+    }
+    catch(const po::error &e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if( vm.count("help") )
+    {
+        std::cout << description << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::cout << boost::format("%8s %16s %16s %8s %14s %14s\n")
+        % "threads" % "mutex ops/s" % "objectpool ops/s" % "speedup"
+        % "mutex wait" % "objectpool wait";
+
+    for(size_t threads = 1; threads <= config.maxThreads; threads *= 2)
+    {
+        MutexPool mutexPool(config.poolSize);
+        redisclient::ObjectPool<int> objectPool(config.poolSize, []() { return 0; });
+
+        Result mutexResult = { 0, 0 };
+        Result objectPoolResult = { 0, 0 };
+
+        // Interleave the runs, so that both pools see the same conditions.
+        for(size_t i = 0; i < config.repeat; ++i)
+        {
+            Result result = run(threads, config, [&]() {
+                auto start = std::chrono::steady_clock::now();
+                int *object = mutexPool.fetch();
+                double wait = since(start);
+
+                work(*object, config.work);
+                mutexPool.release(object);
+                return wait;
+            });
+
+            if (result.rate > mutexResult.rate)
+                mutexResult = result;
+
+            result = run(threads, config, [&]() {
+                auto start = std::chrono::steady_clock::now();
+                size_t slot = objectPool.acquire();
+                double wait = since(start);
+
+                work(objectPool.get(slot), config.work);
+                objectPool.release(slot);
+                return wait;
+            });
+
+            if (result.rate > objectPoolResult.rate)
+                objectPoolResult = result;
+        }
+
+        std::cout << boost::format("%8d %16.0f %16.0f %7.2fx %12.0fus %12.0fus\n")
+            % threads % mutexResult.rate % objectPoolResult.rate
+            % (objectPoolResult.rate / mutexResult.rate)
+            % mutexResult.maxWaitUsec % objectPoolResult.maxWaitUsec;
+    }
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <redisclient/pubsubring.h>
+
+// Cost of passing pub/sub messages from the thread of the client to a
+// worker thread: a mutex protected queue of payload copies, the same
+// queue of shared messages, and redisclient::PubSubRing with blocking
+// pop() and with batched tryPop(). The producer pushes as fast as it
+// can; the Block policy keeps all messages. No server is needed.
+
+struct Config
+{
+    size_t messages;
+    size_t payload;
+    size_t capacity;
+    size_t batch;
+};
+
+// Queue of the consumer before PubSubRing.
+template<typename T>
+class LockedQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(value));
+        }
+
+        condition.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (queue.empty())
+            condition.wait(lock);
+
+        T value = std::move(queue.front());
+
+        queue.pop_front();
+        return value;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<T> queue;
+};
+
+// ns per message of produce() and consume() on two threads.
+template<typename Produce, typename Consume>
+static double measure(size_t messages, Produce produce, Consume consume)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer(consume);
+
+    produce();
+    consumer.join();
+
+    return std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / messages;
+}
+
+int main(int argc, char **argv)
+{
+    namespace po = boost::program_options;
+
+    Config config;
+
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "produce help message")
+        ("messages", po::value(&config.messages)->default_value(2000000),
+             "number of messages")
+        ("payload", po::value(&config.payload)->default_value(100),
+             "payload size")
+        ("capacity", po::value(&config.capacity)->default_value(4096),
+             "ring capacity")
+        ("batch", po::value(&config.batch)->default_value(64),
+             "messages per tryPop() of the batched consumer")
+    ;
+
+    po::variables_map vm;
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), vm);
+        po::notify(vm);
+    }
+    catch(const po::error &e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if( vm.count("help") )
+    {
+        std::cout << description << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    // As parsed by the client: one message shared by all subscribers.
+    std::vector<redisclient::PubSubMessagePtr> messages;
+
+    messages.reserve(1024);
+
+    for(size_t i = 0; i < 1024; ++i)
+    {
+        std::shared_ptr<redisclient::PubSubMessage> message =
+            std::make_shared<redisclient::PubSubMessage>();
+
+        message->channel.assign(8, 'c');
+        message->payload.assign(config.payload, static_cast<char>('a' + i % 26));
+        messages.push_back(std::move(message));
+    }
+
+    size_t n = config.messages;
+    size_t bytes = 0;
+
+    std::cout << boost::format("%-24s %10s\n") % "queue" % "ns/msg";
+
+    {
+        LockedQueue<std::vector<char>> queue;
+
+        double ns = measure(n, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                queue.push(messages[i % 1024]->payload);
+        }, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                bytes += queue.pop().size();
+        });
+
+        std::cout << boost::format("%-24s %10.1f\n") % "mutex, payload copy" % ns;
+    }
+
+    {
+        LockedQueue<redisclient::PubSubMessagePtr> queue;
+
+        double ns = measure(n, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                queue.push(messages[i % 1024]);
+        }, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                bytes += queue.pop()->payload.size();
+        });
+
+        std::cout << boost::format("%-24s %10.1f\n") % "mutex, shared" % ns;
+    }
+
+    {
+        redisclient::PubSubRing ring(config.capacity, redisclient::PubSubOverflow::Block);
+
+        double ns = measure(n, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                ring.push(messages[i % 1024]);
+
+            ring.close();
+        }, [&]() {
+            redisclient::PubSubMessagePtr message;
+
+            while (ring.pop(message))
+                bytes += message->payload.size();
+        });
+
+        redisclient::PubSubRing::Stats stats = ring.stats();
+
+        std::cout << boost::format("%-24s %10.1f   blocked %d, max lag %d\n")
+            % "ring, pop()" % ns % stats.blocked % stats.maxLag;
+    }
+
+    {
+        redisclient::PubSubRing ring(config.capacity, redisclient::PubSubOverflow::Block);
+
+        double ns = measure(n, [&]() {
+            for(size_t i = 0; i < n; ++i)
+                ring.push(messages[i % 1024]);
+
+            ring.close();
+        }, [&]() {
+            std::vector<redisclient::PubSubMessagePtr> batch;
+            redisclient::PubSubMessagePtr message;
+
+            batch.reserve(config.batch);
+
+            // Block for the first message, take the rest without waiting.
+            while (ring.pop(message))
+            {
+                bytes += message->payload.size();
+                batch.clear();
+                ring.tryPop(batch, config.batch - 1);
+
+                for(const redisclient::PubSubMessagePtr &m: batch)
+                    bytes += m->payload.size();
+            }
+        });
+
+        redisclient::PubSubRing::Stats stats = ring.stats();
+
+        std::cout << boost::format("%-24s %10.1f   blocked %d, max lag %d\n")
+            % "ring, batched tryPop()" % ns % stats.blocked % stats.maxLag;
+    }
+
+    if (bytes != 4 * n * config.payload)
+    {
+        std::cerr << "messages lost\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
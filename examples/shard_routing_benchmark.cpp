@@ -0,0 +1,197 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <redisclient/hashring.h>
+
+// Cost of routing a key to a shard and keys moved when a shard is added,
+// from 2 to 128 shards: redisclient::HashRing against jump consistent
+// hash and hash mod N, all with the same key hash. No server is needed.
+
+struct Config
+{
+    size_t keys;
+    size_t points;
+    size_t maxShards;
+    size_t repeat;
+};
+
+// Jump consistent hash (Lamping, Veach): shards can only be added or
+// removed at the end.
+static uint32_t jumpHash(uint64_t key, uint32_t buckets)
+{
+    int64_t b = -1;
+    int64_t j = 0;
+
+    while (j < static_cast<int64_t>(buckets))
+    {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = static_cast<int64_t>((b + 1) * (double(int64_t(1) << 31) / double((key >> 33) + 1)));
+    }
+
+    return static_cast<uint32_t>(b);
+}
+
+static std::string shardName(size_t shard)
+{
+    return "10.0." + std::to_string(shard / 256) + "." + std::to_string(shard % 256) + ":6379";
+}
+
+// Best ns per key of route over all keys.
+template<typename Route>
+static double measure(const std::vector<std::string> &keys, size_t repeat, Route route)
+{
+    double best = 0;
+    size_t sink = 0;
+
+    for(size_t i = 0; i < repeat; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for(const std::string &key: keys)
+            sink += route(key);
+
+        double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count() / keys.size();
+
+        if (i == 0 || ns < best)
+            best = ns;
+    }
+
+    // Keep the loop from being optimized out.
+    if (sink == size_t(-1))
+        std::cout << "";
+
+    return best;
+}
+
+// Fraction of keys whose shard differs between before and after.
+template<typename Before, typename After>
+static double moved(const std::vector<std::string> &keys, Before before, After after)
+{
+    size_t count = 0;
+
+    for(const std::string &key: keys)
+        count += before(key) != after(key);
+
+    return double(count) / keys.size();
+}
+
+// Largest shard load relative to the mean.
+template<typename Route>
+static double imbalance(const std::vector<std::string> &keys, size_t shards, Route route)
+{
+    std::vector<size_t> load(shards, 0);
+
+    for(const std::string &key: keys)
+        ++load[route(key)];
+
+    return double(*std::max_element(load.begin(), load.end())) * shards / keys.size();
+}
+
+int main(int argc, char **argv)
+{
+    namespace po = boost::program_options;
+
+    Config config;
+
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "produce help message")
+        ("keys", po::value(&config.keys)->default_value(1000000),
+             "number of keys routed")
+        ("points", po::value(&config.points)->default_value(redisclient::HashRing::defaultPoints),
+             "ring points per shard")
+        ("max-shards", po::value(&config.maxShards)->default_value(128),
+             "largest number of shards")
+        ("repeat", po::value(&config.repeat)->default_value(3),
+             "runs per router, the best one is reported")
+    ;
+
+    po::variables_map vm;
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), vm);
+        po::notify(vm);
+    }
+    catch(const po::error &e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if( vm.count("help") )
+    {
+        std::cout << description << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> keys;
+
+    keys.reserve(config.keys);
+
+    for(size_t i = 0; i < config.keys; ++i)
+        keys.push_back("user:" + std::to_string(i * 7919 % config.keys) + ":profile");
+
+    std::cout << boost::format("%6s %10s %10s %10s %10s %10s %10s %10s %10s\n")
+        % "shards" % "hash ns" % "ring ns" % "jump ns" % "mod ns"
+        % "ring moved" % "jump moved" % "mod moved" % "ring max";
+
+    for(size_t shards = 2; shards <= config.maxShards; shards *= 2)
+    {
+        redisclient::HashRing ring(config.points);
+        redisclient::HashRing grown(config.points);
+
+        for(size_t i = 0; i < shards; ++i)
+        {
+            ring.add(shardName(i));
+            grown.add(shardName(i));
+        }
+
+        grown.add(shardName(shards));
+
+        auto hash = [](const std::string &key) {
+            return redisclient::HashRing::hash(key.data(), key.size());
+        };
+        auto ringShard = [&ring](const std::string &key) { return ring.shard(key); };
+        auto grownShard = [&grown](const std::string &key) { return grown.shard(key); };
+        auto jump = [&hash](const std::string &key, size_t n) {
+            return jumpHash(hash(key), static_cast<uint32_t>(n));
+        };
+        auto mod = [&hash](const std::string &key, size_t n) { return hash(key) % n; };
+
+        double hashNs = measure(keys, config.repeat, hash);
+        double ringNs = measure(keys, config.repeat, ringShard);
+        double jumpNs = measure(keys, config.repeat,
+                [&](const std::string &key) { return jump(key, shards); });
+        double modNs = measure(keys, config.repeat,
+                [&](const std::string &key) { return mod(key, shards); });
+
+        double ringMoved = moved(keys, ringShard, grownShard);
+        double jumpMoved = moved(keys,
+                [&](const std::string &key) { return jump(key, shards); },
+                [&](const std::string &key) { return jump(key, shards + 1); });
+        double modMoved = moved(keys,
+                [&](const std::string &key) { return mod(key, shards); },
+                [&](const std::string &key) { return mod(key, shards + 1); });
+
+        std::cout << boost::format("%6d %10.1f %10.1f %10.1f %10.1f %9.1f%% %9.1f%% %9.1f%% %10.2f\n")
+            % shards % hashNs % ringNs % jumpNs % modNs
+            % (ringMoved * 100) % (jumpMoved * 100) % (modMoved * 100)
+            % imbalance(keys, shards, ringShard);
+    }
+
+    std::cout << "\nAdding a shard to N should move about 1/(N+1) of the keys; "
+        "ring max is the largest shard load relative to the mean.\n";
+
+    return EXIT_SUCCESS;
+}
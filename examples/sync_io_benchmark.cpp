@@ -0,0 +1,181 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+
+#include <boost/asio/ip/address.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <redisclient/redissyncclient.h>
+
+// Compare syscalls and p50/p99 latency per command of the sync client
+// I/O modes: poll (default), optimistic, busy-poll and io_uring.
+
+struct Config
+{
+    std::string address;
+    uint16_t port;
+    size_t requests;
+    size_t pipeline;
+    size_t spinUsec;
+    bool soBusyPoll;
+};
+
+class Benchmark
+{
+public:
+    Benchmark(boost::asio::io_service &ioService, const Config &config)
+        : ioService(ioService), config(config)
+    {
+    }
+
+    void run(const std::string &name, redisclient::RedisSyncClient::IoMode mode)
+    {
+        boost::asio::ip::tcp::endpoint endpoint(
+                boost::asio::ip::address::from_string(config.address), config.port);
+
+        redisclient::RedisSyncClient redisClient(ioService);
+        boost::system::error_code ec;
+
+        redisClient.setCommandTimeout(boost::posix_time::seconds(5))
+            .setIoMode(mode);
+
+        if (mode == redisclient::RedisSyncClient::IoMode::BusyPoll)
+            redisClient.setBusyPoll(boost::posix_time::microseconds(config.spinUsec),
+                    config.soBusyPoll);
+
+        redisClient.connect(endpoint, ec);
+
+        if (ec)
+        {
+            std::cerr << "Can't connect to " << config.address << ":" << config.port
+                << ": " << ec.message() << "\n";
+            exit(-1);
+        }
+
+        const std::string key = "sync-io-benchmark";
+
+        redisClient.command("SET", {key, key});
+        redisClient.resetIoStats();
+
+        std::vector<double> latencies;
+        latencies.reserve(config.requests);
+
+        for(size_t i = 0; i < config.requests; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            if (config.pipeline > 1)
+            {
+                std::deque<std::deque<redisclient::RedisBuffer>> commands(
+                        config.pipeline, std::deque<redisclient::RedisBuffer>{"GET", key});
+
+                redisClient.pipelined(std::move(commands), ec);
+            }
+            else
+            {
+                redisClient.command("GET", {key}, ec);
+            }
+
+            auto end = std::chrono::steady_clock::now();
+
+            if (ec)
+            {
+                std::cerr << "GET failed: " << ec.message() << "\n";
+                exit(-1);
+            }
+
+            latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+
+        redisclient::RedisSyncClient::IoStats stats = redisClient.ioStats();
+        double commands = static_cast<double>(config.requests * std::max<size_t>(config.pipeline, 1));
+        size_t syscalls = stats.polls + stats.reads + stats.writes + stats.sockopts +
+            stats.enters;
+
+        std::sort(latencies.begin(), latencies.end());
+
+        std::cout << boost::format("%-10s syscalls/cmd %6.2f (poll %.2f, recv %.2f, send %.2f, "
+                                   "setsockopt %.2f, io_uring_enter %.2f)  p50 %7.1fus  p99 %7.1fus\n")
+            % name
+            % (syscalls / commands)
+            % (stats.polls / commands) % (stats.reads / commands)
+            % (stats.writes / commands) % (stats.sockopts / commands)
+            % (stats.enters / commands)
+            % percentile(latencies, 0.50) % percentile(latencies, 0.99);
+
+        if (stats.spins > 0)
+        {
+            std::cout << boost::format("%-10s spin hit rate %.1f%% (%d of %d)\n")
+                % name % (100.0 * stats.spinHits / stats.spins)
+                % stats.spinHits % stats.spins;
+        }
+    }
+
+private:
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    }
+
+private:
+    boost::asio::io_service &ioService;
+    Config config;
+};
+
+int main(int argc, char **argv)
+{
+    namespace po = boost::program_options;
+
+    Config config;
+
+    po::options_description description("Options");
+    description.add_options()
+        ("help", "produce help message")
+        ("address", po::value(&config.address)->default_value("127.0.0.1"),
+             "redis server ip address")
+        ("port", po::value(&config.port)->default_value(6379), "redis server port")
+        ("requests", po::value(&config.requests)->default_value(100000),
+             "number of requests per mode")
+        ("pipeline", po::value(&config.pipeline)->default_value(1),
+             "commands per request")
+        ("spin", po::value(&config.spinUsec)->default_value(50),
+             "busy-poll spin budget in microseconds")
+        ("so-busy-poll", po::bool_switch(&config.soBusyPoll),
+             "also set SO_BUSY_POLL on the socket")
+    ;
+
+    po::variables_map vm;
+
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, description), vm);
+        po::notify(vm);
+    }
+    catch(const po::error &e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if( vm.count("help") )
+    {
+        std::cout << description << "\n";
+        return EXIT_SUCCESS;
+    }
+
+    boost::asio::io_service ioService;
+    Benchmark benchmark(ioService, config);
+
+    benchmark.run("poll", redisclient::RedisSyncClient::IoMode::Poll);
+    benchmark.run("optimistic", redisclient::RedisSyncClient::IoMode::Optimistic);
+    benchmark.run("busy-poll", redisclient::RedisSyncClient::IoMode::BusyPoll);
+    benchmark.run("io_uring", redisclient::RedisSyncClient::IoMode::IoUring);
+
+    return 0;
+}
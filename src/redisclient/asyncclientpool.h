@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_ASYNCCLIENTPOOL_H
+#define REDISCLIENT_ASYNCCLIENTPOOL_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "redisclient/redisasyncclient.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Spreads commands over several RedisAsyncClient connections, so that a
+// slow command only blocks the commands pipelined behind it on its own
+// connection. command() goes to the connection with the fewest commands
+// waiting for a reply (then the fewest bytes); commandByKey() always uses
+// the same connection for a key, keeping the order of its commands.
+class AsyncClientPool : boost::noncopyable {
+public:
+    struct ConnectionStats {
+        size_t pending;  // commands waiting for a reply
+        size_t bytes;    // size of these commands
+        size_t commands; // commands sent since connect
+    };
+
+    REDIS_CLIENT_DECL AsyncClientPool(boost::asio::io_service &ioService, size_t size);
+
+    // Connect all clients. Handler is called once, with the first error.
+    REDIS_CLIENT_DECL void connect(
+            const boost::asio::ip::tcp::endpoint &endpoint,
+            std::function<void(boost::system::error_code)> handler);
+
+    // Disconnect all clients. Commands waiting for a reply are dropped
+    // and no longer counted.
+    REDIS_CLIENT_DECL void disconnect();
+
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    REDIS_CLIENT_DECL void commandByKey(
+            const std::string &key,
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    REDIS_CLIENT_DECL size_t size() const;
+
+    // Client of connection index, e.g. to set options before connect().
+    REDIS_CLIENT_DECL RedisAsyncClient &client(size_t index);
+
+    REDIS_CLIENT_DECL std::vector<ConnectionStats> stats() const;
+
+private:
+    struct Connection {
+        Connection(boost::asio::io_service &ioService)
+            : client(ioService), pending(0), bytes(0), commands(0), generation(0)
+        {
+        }
+
+        RedisAsyncClient client;
+        std::atomic<size_t> pending;
+        std::atomic<size_t> bytes;
+        std::atomic<size_t> commands;
+        // Bumped when the counters are reset by connect()/disconnect().
+        std::atomic<size_t> generation;
+    };
+
+    struct Outstanding;
+
+    REDIS_CLIENT_DECL static void reset(Connection &connection);
+
+    REDIS_CLIENT_DECL size_t leastOutstanding() const;
+    REDIS_CLIENT_DECL void send(size_t index,
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler);
+
+    std::vector<std::shared_ptr<Connection>> connections;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/asyncclientpool.cpp"
+#endif
+
+#endif // REDISCLIENT_ASYNCCLIENTPOOL_H
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_CANCELLATIONTOKEN_H
+#define REDISCLIENT_CANCELLATIONTOKEN_H
+
+#include <atomic>
+#include <memory>
+
+namespace redisclient {
+
+// Cancellation flag shared by all copies of the token. Commands issued with
+// a cancelled token are dropped if they have not been written yet.
+class CancellationToken {
+public:
+    CancellationToken()
+        : flag(std::make_shared<std::atomic<bool>>(false))
+    {
+    }
+
+    void cancel()
+    {
+        flag->store(true);
+    }
+
+    bool cancelled() const
+    {
+        return flag->load();
+    }
+
+    const std::shared_ptr<std::atomic<bool>> &state() const
+    {
+        return flag;
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+}
+
+#endif // REDISCLIENT_CANCELLATIONTOKEN_H
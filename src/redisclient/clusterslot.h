@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_CLUSTERSLOT_H
+#define REDISCLIENT_CLUSTERSLOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "config.h"
+
+namespace redisclient {
+
+// Number of hash slots of Redis Cluster.
+const size_t clusterSlotCount = 16384;
+
+// CRC16-CCITT (XMODEM), the checksum used for cluster key slots.
+REDIS_CLIENT_DECL uint16_t crc16(const char *data, size_t size);
+
+// Part of a key that is hashed: its hash tag (text between the first
+// '{' and the next '}', if not empty) or else the whole key. Keys with
+// the same tag go to the same slot or shard.
+REDIS_CLIENT_DECL std::pair<const char *, size_t> keyHashTag(const char *key, size_t size);
+
+// Slot of a key: CRC16 of its hash tag or of the whole key, mod 16384.
+REDIS_CLIENT_DECL uint16_t keySlot(const char *key, size_t size);
+
+inline uint16_t keySlot(const std::string &key)
+{
+    return keySlot(key.data(), key.size());
+}
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/clusterslot.cpp"
+#endif
+
+#endif // REDISCLIENT_CLUSTERSLOT_H
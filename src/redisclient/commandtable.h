@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_COMMANDTABLE_H
+#define REDISCLIENT_COMMANDTABLE_H
+
+#include <string>
+
+#include "config.h"
+
+namespace redisclient {
+
+// Where a client with replicas sends a command.
+enum class Route {
+    Auto,    // read-only commands to a replica, others to the primary
+    Primary, // e.g. to read your own writes
+    Replica  // the primary if no replica is connected
+};
+
+// Return true if cmd (in any case) never modifies data, so it may be
+// sent to a replica. Unknown commands are treated as writes.
+REDIS_CLIENT_DECL bool isReadOnlyCommand(const std::string &cmd);
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/commandtable.cpp"
+#endif
+
+#endif // REDISCLIENT_COMMANDTABLE_H
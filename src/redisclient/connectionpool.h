@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_CONNECTIONPOOL_H
+#define REDISCLIENT_CONNECTIONPOOL_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "redisclient/redissyncclient.h"
+#include "redisclient/impl/objectpool.h"
+#include "config.h"
+
+namespace redisclient {
+
+class ConnectionPool;
+
+struct ConnectionPoolOptions
+{
+    ConnectionPoolOptions()
+        : size(1), minIdle(0),
+        healthCheckTimeout(boost::posix_time::seconds(1)),
+        minSize(1), scaleInterval(boost::posix_time::seconds(1))
+    {
+    }
+
+    // Max number of connections, including both in-use and idle ones.
+    // Upper bound for ConnectionPool::resize() and autoscaling.
+    size_t size;
+
+    // Number of connections opened in parallel by the constructor.
+    // Others are created on demand. The idle reaper keeps at least
+    // this many connections open.
+    size_t minIdle;
+
+    // Max time fetch() waits for a connection. Zero means forever.
+    boost::posix_time::time_duration waitTimeout;
+
+    // Connections older than this are reconnected when fetched (or by
+    // the health check). Zero means connections never expire.
+    boost::posix_time::time_duration connectionLifetime;
+
+    // Each connection's lifetime is shortened by a random time up to
+    // this (at most half of it), so that connections opened together
+    // don't expire together.
+    boost::posix_time::time_duration lifetimeJitter;
+
+    // Every healthCheckInterval, a background thread PINGs connections
+    // idle for that long, reconnects broken or expired idle ones and
+    // opens new ones up to minIdle, so fetch() rarely pays for a
+    // reconnect. Zero disables it.
+    boost::posix_time::time_duration healthCheckInterval;
+
+    // Timeout of the health check PING. A connection that doesn't answer
+    // in time is reconnected.
+    boost::posix_time::time_duration healthCheckTimeout;
+
+    // Idle connections unused for longer than this are closed by a
+    // background thread, down to minIdle connections. Zero disables it.
+    boost::posix_time::time_duration maxIdleTime;
+
+    // Autoscaling: every scaleInterval, grow the pool by a quarter if it
+    // was full and the 95th percentile of fetch() waits exceeded
+    // targetWait; shrink it by a quarter after three intervals using at
+    // most half of it. The pool starts with minSize connections allowed
+    // and stays between minSize and size. Zero targetWait disables it.
+    size_t minSize;
+    boost::posix_time::time_duration targetWait;
+    boost::posix_time::time_duration scaleInterval;
+};
+
+// Connection fetched from ConnectionPool. Gives the connection back to
+// the pool on destruction; a disconnected client is dropped instead.
+// The pool must outlive its connections.
+class PooledConnection : boost::noncopyable {
+public:
+    REDIS_CLIENT_DECL PooledConnection();
+    REDIS_CLIENT_DECL PooledConnection(PooledConnection &&other);
+    REDIS_CLIENT_DECL PooledConnection &operator=(PooledConnection &&other);
+    REDIS_CLIENT_DECL ~PooledConnection();
+
+    // Return the connection to the pool now.
+    REDIS_CLIENT_DECL void release();
+
+    REDIS_CLIENT_DECL RedisSyncClient &client();
+
+    RedisSyncClient *operator->()
+    {
+        return &client();
+    }
+
+    explicit operator bool() const
+    {
+        return pool != nullptr;
+    }
+
+private:
+    friend class ConnectionPool;
+
+    REDIS_CLIENT_DECL PooledConnection(ConnectionPool *pool, size_t slot);
+
+    ConnectionPool *pool;
+    size_t slot;
+};
+
+// Pool of RedisSyncClient connections, safe to use from many threads.
+// A client broken by an I/O error or timeout (see
+// RedisSyncClient::isConnected()) is replaced by a new connection.
+// Idle connections are reused LIFO: at low load the same few connections
+// serve all requests and the rest expire after maxIdleTime.
+class ConnectionPool : boost::noncopyable {
+public:
+    // Return a new connected client or throw.
+    typedef std::function<RedisSyncClient()> Factory;
+
+    REDIS_CLIENT_DECL ConnectionPool(Factory factory,
+            const ConnectionPoolOptions &options);
+
+    // Connect clients to endpoint. configure, if set, is called for each
+    // new client before connect (timeouts, ConnectOptions, ...).
+    REDIS_CLIENT_DECL ConnectionPool(boost::asio::io_service &ioService,
+            const boost::asio::ip::tcp::endpoint &endpoint,
+            const ConnectionPoolOptions &options,
+            std::function<void(RedisSyncClient &)> configure = nullptr);
+
+    REDIS_CLIENT_DECL ~ConnectionPool();
+
+    // Fetch a connection, waiting up to waitTimeout. Throws on timeout
+    // (boost::asio::error::timed_out) or if a new connection fails.
+    REDIS_CLIENT_DECL PooledConnection fetch();
+
+    // Same as above, returns an empty PooledConnection and sets ec.
+    REDIS_CLIENT_DECL PooledConnection fetch(boost::system::error_code &ec);
+
+    REDIS_CLIENT_DECL const ConnectionPoolOptions &options() const;
+
+    // Number of open connections, idle or in use.
+    REDIS_CLIENT_DECL size_t size() const;
+
+    // Current max number of connections, at most options().size.
+    REDIS_CLIENT_DECL size_t capacity() const;
+
+    // Change the max number of connections. Extra connections are closed
+    // when idle. With autoscaling the pool continues from the new size.
+    REDIS_CLIENT_DECL void resize(size_t size);
+
+private:
+    friend class PooledConnection;
+
+    struct Entry
+    {
+        Entry(RedisSyncClient client_, std::chrono::steady_clock::time_point expires_)
+            : client(std::move(client_)), expires(expires_),
+            lastUsed(std::chrono::steady_clock::now()), lastChecked(lastUsed)
+        {
+        }
+
+        RedisSyncClient client;
+        std::chrono::steady_clock::time_point expires;
+        std::chrono::steady_clock::time_point lastUsed;
+        std::chrono::steady_clock::time_point lastChecked;
+    };
+
+    REDIS_CLIENT_DECL std::chrono::steady_clock::time_point expiryTime() const;
+
+    REDIS_CLIENT_DECL void warmUp(size_t count);
+    REDIS_CLIENT_DECL bool usable(Entry &entry) const;
+    REDIS_CLIENT_DECL void release(size_t slot);
+    REDIS_CLIENT_DECL void maintain();
+    REDIS_CLIENT_DECL void reapIdle();
+    REDIS_CLIENT_DECL void checkHealth();
+    REDIS_CLIENT_DECL void autoscale();
+    REDIS_CLIENT_DECL void recordWait(std::chrono::steady_clock::duration wait);
+
+    ConnectionPoolOptions poolOptions;
+    ObjectPool<Entry> entries;
+
+    // fetch() waits, bucket i counts waits below 2^i microseconds.
+    std::atomic<uint64_t> waits[32];
+    std::atomic<size_t> inUse;
+    std::atomic<size_t> peakInUse; // since the last autoscale()
+    size_t lowIntervals; // used by the maintenance thread only
+
+    std::mutex maintenanceMutex;
+    std::condition_variable maintenanceCv;
+    bool stopping; // guarded by maintenanceMutex
+    std::thread maintenance;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/connectionpool.cpp"
+#endif
+
+#endif // REDISCLIENT_CONNECTIONPOOL_H
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_CONNECTOPTIONS_H
+#define REDISCLIENT_CONNECTOPTIONS_H
+
+#include <string>
+
+namespace redisclient {
+
+// Connection setup sent right after connect. All setup commands are
+// pipelined in a single write and their replies checked together, so
+// the handshake costs one round trip.
+struct ConnectOptions
+{
+    ConnectOptions()
+        : database(0), hello(false), readonly(false)
+    {
+    }
+
+    // AUTH [user] password. Skipped if password is empty.
+    std::string user;
+    std::string password;
+
+    // SELECT database. Skipped if 0.
+    int database;
+
+    // CLIENT SETNAME clientName. Skipped if empty.
+    std::string clientName;
+
+    // Send HELLO 2 (Redis 6+), carrying AUTH and SETNAME, instead of
+    // separate AUTH and CLIENT SETNAME commands.
+    bool hello;
+
+    // READONLY, for reading from a cluster replica.
+    bool readonly;
+};
+
+}
+
+#endif // REDISCLIENT_CONNECTOPTIONS_H
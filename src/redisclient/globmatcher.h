@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_GLOBMATCHER_H
+#define REDISCLIENT_GLOBMATCHER_H
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+
+namespace redisclient {
+
+// Matches a string against many glob patterns (PSUBSCRIBE syntax: *, ?,
+// [abc], [^a-z], \x) in one pass. Patterns are compiled into a trie
+// shared by common prefixes, run as an automaton whose states (sets of
+// trie nodes) and transitions are built on first use and cached, so a
+// match costs one table lookup per byte of the string. Bytes no pattern
+// tells apart share a column of the transition tables.
+class GlobMatcher {
+public:
+    // Max bytes of cached automaton states; the cache is dropped when
+    // full. Many patterns with a * before their end can need a state for
+    // each channel prefix seen.
+    static const size_t defaultCacheBytes = 8 << 20;
+
+    REDIS_CLIENT_DECL explicit GlobMatcher(size_t maxCacheBytes = defaultCacheBytes);
+
+    // Add pattern and return its id, 0 for the first one and so on.
+    REDIS_CLIENT_DECL size_t add(const std::string &pattern);
+
+    REDIS_CLIENT_DECL size_t patterns() const;
+
+    // Ids of the patterns matching the string, in increasing order. Valid
+    // until the next call of match() or add().
+    REDIS_CLIENT_DECL const std::vector<uint32_t> &match(const char *data, size_t size);
+
+    inline const std::vector<uint32_t> &match(const std::string &s)
+    {
+        return match(s.data(), s.size());
+    }
+
+private:
+    enum TokenType : uint8_t {
+        Literal,
+        AnyChar,
+        CharClass,
+        Star
+    };
+
+    struct Token {
+        TokenType type;
+        unsigned char c;
+        std::bitset<256> chars; // CharClass
+    };
+
+    struct Node {
+        std::vector<std::pair<Token, uint32_t>> edges;
+        std::vector<uint32_t> star; // children by a Star edge, matched by nothing too
+        bool loop;                  // reached by a Star edge: consumes any byte
+        std::vector<uint32_t> accept;
+    };
+
+    struct State {
+        std::vector<uint32_t> nodes; // sorted
+        std::vector<uint32_t> accept;
+        std::vector<int32_t> next;   // by byte class, -1 if not built
+    };
+
+    REDIS_CLIENT_DECL static std::vector<Token> parse(const std::string &pattern);
+    REDIS_CLIENT_DECL static bool sameToken(const Token &a, const Token &b);
+    REDIS_CLIENT_DECL static bool tokenMatches(const Token &token, unsigned char c);
+
+    REDIS_CLIENT_DECL void closure(uint32_t node, std::vector<uint32_t> &nodes) const;
+    REDIS_CLIENT_DECL int32_t state(std::vector<uint32_t> nodes);
+    REDIS_CLIENT_DECL int32_t step(int32_t from, uint8_t byteClass);
+    REDIS_CLIENT_DECL void compile();
+    REDIS_CLIENT_DECL void resetStates();
+
+    std::vector<Node> trie;
+    size_t count;
+    bool compiled; // classes and states are up to date
+
+    uint8_t classOf[256];
+    std::vector<unsigned char> representative; // a byte of each class
+
+    std::vector<State> states; // 0 is the dead state, 1 the start
+    std::unordered_multimap<size_t, int32_t> stateIndex; // by hash of nodes
+    size_t cacheBytes;
+    size_t maxCacheBytes;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/globmatcher.cpp"
+#endif
+
+#endif // REDISCLIENT_GLOBMATCHER_H
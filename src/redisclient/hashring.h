@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_HASHRING_H
+#define REDISCLIENT_HASHRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+namespace redisclient {
+
+// Consistent hash ring (ketama style) for client-side sharding over
+// standalone servers. Each shard owns pointsPerShard * weight points,
+// placed by the hash of its name; a key belongs to the shard of the
+// first point at or after the hash of its hash tag (see keyHashTag()).
+// Points are precomputed into a sorted array with a bucket index, so a
+// lookup is one hash and a binary search over a few points. Adding a
+// shard moves only the keys that now belong to it, about 1/N of them.
+class HashRing {
+public:
+    static const size_t defaultPoints = 160;
+
+    REDIS_CLIENT_DECL explicit HashRing(size_t pointsPerShard = defaultPoints);
+
+    // Add a shard and return its index. name (e.g. "host:port") places
+    // it on the ring: the same names give the same placement of keys
+    // regardless of the order they are added in.
+    REDIS_CLIENT_DECL size_t add(const std::string &name, size_t weight = 1);
+
+    REDIS_CLIENT_DECL size_t shards() const;
+    REDIS_CLIENT_DECL const std::string &name(size_t shard) const;
+
+    // Shard of a key. The ring must not be empty.
+    REDIS_CLIENT_DECL size_t shard(const char *key, size_t size) const;
+
+    inline size_t shard(const std::string &key) const
+    {
+        return shard(key.data(), key.size());
+    }
+
+    // Shard of a key hash, as returned by hash().
+    REDIS_CLIENT_DECL size_t shardOfHash(uint32_t hash) const;
+
+    // Hash of the hash tag of a key (64-bit FNV-1a, mixed, upper half).
+    REDIS_CLIENT_DECL static uint32_t hash(const char *key, size_t size);
+
+private:
+    REDIS_CLIENT_DECL static uint32_t hashBytes(const char *data, size_t size);
+    REDIS_CLIENT_DECL void rebuild();
+
+    size_t pointsPerShard;
+    std::vector<std::pair<std::string, size_t>> shardList; // name, weight
+
+    // Sorted point hashes and the shard of each point.
+    std::vector<uint32_t> points;
+    std::vector<uint32_t> owners;
+
+    // index[b] is the first point with hash >= b << indexShift.
+    std::vector<uint32_t> index;
+    unsigned int indexShift;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/hashring.cpp"
+#endif
+
+#endif // REDISCLIENT_HASHRING_H
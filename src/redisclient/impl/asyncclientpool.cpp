@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_ASYNCCLIENTPOOL_CPP
+#define REDISCLIENT_ASYNCCLIENTPOOL_CPP
+
+#include <cassert>
+#include <mutex>
+#include <stdexcept>
+
+#include "redisclient/asyncclientpool.h"
+
+namespace redisclient {
+
+// A command counted on its connection until its handler is called or
+// destroyed without being called, e.g. dropped by close() of the client.
+struct AsyncClientPool::Outstanding {
+    Outstanding(std::shared_ptr<Connection> connection_, size_t bytes_)
+        : connection(std::move(connection_)), bytes(bytes_),
+        generation(connection->generation.load())
+    {
+        ++connection->pending;
+        connection->bytes += bytes;
+        ++connection->commands;
+    }
+
+    ~Outstanding()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if (!connection)
+            return;
+
+        // Counters reset since, this command is not in them.
+        if (connection->generation.load() == generation)
+        {
+            --connection->pending;
+            connection->bytes -= bytes;
+        }
+
+        connection.reset();
+    }
+
+    std::shared_ptr<Connection> connection;
+    size_t bytes;
+    size_t generation;
+};
+
+AsyncClientPool::AsyncClientPool(boost::asio::io_service &ioService, size_t size)
+{
+    if (size == 0)
+        throw std::invalid_argument("AsyncClientPool: size must be positive");
+
+    connections.reserve(size);
+
+    for(size_t i = 0; i < size; ++i)
+        connections.push_back(std::make_shared<Connection>(ioService));
+}
+
+void AsyncClientPool::connect(const boost::asio::ip::tcp::endpoint &endpoint,
+        std::function<void(boost::system::error_code)> handler)
+{
+    struct Connecting
+    {
+        std::mutex mutex;
+        size_t left;
+        boost::system::error_code ec;
+        std::function<void(boost::system::error_code)> handler;
+    };
+
+    std::shared_ptr<Connecting> connecting = std::make_shared<Connecting>();
+
+    connecting->left = connections.size();
+    connecting->handler = std::move(handler);
+
+    for(auto &connection: connections)
+    {
+        reset(*connection);
+        connection->commands = 0;
+
+        connection->client.connect(endpoint, [connecting](boost::system::error_code ec) {
+            std::unique_lock<std::mutex> lock(connecting->mutex);
+
+            if (ec && !connecting->ec)
+                connecting->ec = ec;
+
+            if (--connecting->left == 0)
+            {
+                lock.unlock();
+                connecting->handler(connecting->ec);
+            }
+        });
+    }
+}
+
+void AsyncClientPool::disconnect()
+{
+    for(auto &connection: connections)
+    {
+        connection->client.disconnect();
+        reset(*connection);
+    }
+}
+
+void AsyncClientPool::reset(Connection &connection)
+{
+    ++connection.generation;
+    connection.pending = 0;
+    connection.bytes = 0;
+}
+
+void AsyncClientPool::command(const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    send(leastOutstanding(), cmd, std::move(args), std::move(handler));
+}
+
+void AsyncClientPool::commandByKey(const std::string &key,
+        const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    size_t index = std::hash<std::string>()(key) % connections.size();
+
+    send(index, cmd, std::move(args), std::move(handler));
+}
+
+size_t AsyncClientPool::size() const
+{
+    return connections.size();
+}
+
+RedisAsyncClient &AsyncClientPool::client(size_t index)
+{
+    assert(index < connections.size());
+    return connections[index]->client;
+}
+
+std::vector<AsyncClientPool::ConnectionStats> AsyncClientPool::stats() const
+{
+    std::vector<ConnectionStats> result;
+
+    result.reserve(connections.size());
+
+    for(const auto &connection: connections)
+    {
+        ConnectionStats stats;
+
+        stats.pending = connection->pending.load();
+        stats.bytes = connection->bytes.load();
+        stats.commands = connection->commands.load();
+        result.push_back(stats);
+    }
+
+    return result;
+}
+
+size_t AsyncClientPool::leastOutstanding() const
+{
+    size_t best = 0;
+    size_t bestPending = connections[0]->pending.load(std::memory_order_relaxed);
+    size_t bestBytes = connections[0]->bytes.load(std::memory_order_relaxed);
+
+    for(size_t i = 1; i < connections.size() && bestPending > 0; ++i)
+    {
+        size_t pending = connections[i]->pending.load(std::memory_order_relaxed);
+        size_t bytes = connections[i]->bytes.load(std::memory_order_relaxed);
+
+        if (pending < bestPending || (pending == bestPending && bytes < bestBytes))
+        {
+            best = i;
+            bestPending = pending;
+            bestBytes = bytes;
+        }
+    }
+
+    return best;
+}
+
+void AsyncClientPool::send(size_t index,
+        const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    std::shared_ptr<Connection> connection = connections[index];
+    size_t bytes = cmd.size();
+
+    for(const RedisBuffer &arg: args)
+        bytes += arg.size();
+
+    // Released by the reply, or when the handler is dropped unrun.
+    std::shared_ptr<Outstanding> outstanding =
+        std::make_shared<Outstanding>(connection, bytes);
+
+    connection->client.command(cmd, std::move(args),
+            [outstanding, handler](RedisValue value) {
+                outstanding->release();
+                handler(std::move(value));
+            });
+}
+
+}
+
+#endif // REDISCLIENT_ASYNCCLIENTPOOL_CPP
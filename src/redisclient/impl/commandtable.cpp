@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_COMMANDTABLE_CPP
+#define REDISCLIENT_COMMANDTABLE_CPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+
+#include "redisclient/commandtable.h"
+
+namespace redisclient {
+
+bool isReadOnlyCommand(const std::string &cmd)
+{
+    // Commands with the readonly flag in COMMAND INFO, sorted.
+    static const char *const readOnly[] = {
+        "BITCOUNT", "BITFIELD_RO", "BITPOS", "DBSIZE", "DUMP", "EXISTS",
+        "EXPIRETIME", "GEODIST", "GEOHASH", "GEOPOS", "GEORADIUSBYMEMBER_RO",
+        "GEORADIUS_RO", "GEOSEARCH", "GET", "GETBIT", "GETRANGE", "HEXISTS", "HGET",
+        "HGETALL", "HKEYS", "HLEN", "HMGET", "HRANDFIELD", "HSCAN", "HSTRLEN",
+        "HVALS", "KEYS", "LCS", "LINDEX", "LLEN", "LPOS", "LRANGE", "MGET",
+        "PEXPIRETIME", "PFCOUNT", "PTTL", "RANDOMKEY", "SCAN", "SCARD", "SDIFF",
+        "SINTER", "SINTERCARD", "SISMEMBER", "SMEMBERS", "SMISMEMBER",
+        "SRANDMEMBER", "SSCAN", "STRLEN", "SUBSTR", "SUNION", "TOUCH", "TTL",
+        "TYPE", "XLEN", "XPENDING", "XRANGE", "XREVRANGE", "ZCARD", "ZCOUNT",
+        "ZDIFF", "ZINTER", "ZINTERCARD", "ZLEXCOUNT", "ZMSCORE", "ZRANDMEMBER",
+        "ZRANGE", "ZRANGEBYLEX", "ZRANGEBYSCORE", "ZRANK", "ZREVRANGE",
+        "ZREVRANGEBYLEX", "ZREVRANGEBYSCORE", "ZREVRANK", "ZSCAN", "ZSCORE",
+        "ZUNION",
+    };
+
+    char name[32];
+
+    if (cmd.size() >= sizeof(name))
+        return false;
+
+    for(size_t i = 0; i < cmd.size(); ++i)
+        name[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(cmd[i])));
+
+    name[cmd.size()] = '\0';
+
+    return std::binary_search(std::begin(readOnly), std::end(readOnly), name,
+            [](const char *a, const char *b) { return std::strcmp(a, b) < 0; });
+}
+
+}
+
+#endif // REDISCLIENT_COMMANDTABLE_CPP
@@ -1,267 +1,484 @@
-/**************************************************************************
-   Copyright (c) 2017 sewenew
-   Licensed under the Apache License, Version 2.0 (the "License");
-   you may not use this file except in compliance with the License.
-   You may obtain a copy of the License at
-       http://www.apache.org/licenses/LICENSE-2.0
-   Unless required by applicable law or agreed to in writing, software
-   distributed under the License is distributed on an "AS IS" BASIS,
-   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-   See the License for the specific language governing permissions and
-   limitations under the License.
- *************************************************************************/
-
-#include "../connectionpool.h"
-#include <cassert>
-#include "errors.h"
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_CONNECTIONPOOL_CPP
+#define REDISCLIENT_CONNECTIONPOOL_CPP
 
+#include <boost/system/system_error.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
 
+#include "redisclient/connectionpool.h"
+#include "redisclient/impl/throwerror.h"
 
 namespace redisclient {
 
-ConnectionPool::ConnectionPool(const ConnectionPoolOptions &pool_opts,
-        const ConnectionOptions &connection_opts) :
-            _opts(connection_opts),
-            _pool_opts(pool_opts) {
-    if (_pool_opts.size == 0) {
-        throw Error("CANNOT create an empty pool");
-    }
+PooledConnection::PooledConnection()
+    : pool(nullptr), slot(0)
+{
+}
 
-    // Lazily create connections.
-    // 懒创建，现构造函数中并不创建connection，而是在第一次使用发现pool为空的时候我们创建若干个connection
+PooledConnection::PooledConnection(ConnectionPool *pool_, size_t slot_)
+    : pool(pool_), slot(slot_)
+{
 }
 
-ConnectionPool::ConnectionPool(SimpleSentinel sentinel,
-                                const ConnectionPoolOptions &pool_opts,
-                                const ConnectionOptions &connection_opts) :
-                                    _opts(connection_opts),
-                                    _pool_opts(pool_opts),
-                                    _sentinel(std::move(sentinel)) {
-    // In this case, the connection must be of TCP type.
-    if (_opts.type != ConnectionType::TCP) {
-        throw Error("Sentinel only supports TCP connection");
-    }
+PooledConnection::PooledConnection(PooledConnection &&other)
+    : pool(other.pool), slot(other.slot)
+{
+    other.pool = nullptr;
+}
 
-    if (_opts.connect_timeout == std::chrono::milliseconds(0)
-            || _opts.socket_timeout == std::chrono::milliseconds(0)) {
-        throw Error("With sentinel, connection timeout and socket timeout cannot be 0");
+PooledConnection &PooledConnection::operator=(PooledConnection &&other)
+{
+    if (this != &other)
+    {
+        release();
+        pool = other.pool;
+        slot = other.slot;
+        other.pool = nullptr;
     }
 
-    // Cleanup connection options.
-    _update_connection_opts("", -1);
+    return *this;
+}
 
-    // assert(_sentinel);
+PooledConnection::~PooledConnection()
+{
+    release();
 }
 
-// copy constructor
-ConnectionPool::ConnectionPool(ConnectionPool &&that) {
-    std::lock_guard<std::mutex> lock(that._mutex);
+void PooledConnection::release()
+{
+    if (pool)
+    {
+        pool->release(slot);
+        pool = nullptr;
+    }
+}
 
-    _move(std::move(that));
+RedisSyncClient &PooledConnection::client()
+{
+    assert(pool);
+    return pool->entries.get(slot).client;
 }
 
-ConnectionPool& ConnectionPool::operator=(ConnectionPool &&that) {
-    if (this != &that) {
-        std::lock(_mutex, that._mutex);
-        std::lock_guard<std::mutex> lock_this(_mutex, std::adopt_lock);
-        std::lock_guard<std::mutex> lock_that(that._mutex, std::adopt_lock);
+ConnectionPool::ConnectionPool(Factory factory, const ConnectionPoolOptions &options)
+    : poolOptions(options),
+    entries(options.size, [this, factory]() {
+            RedisSyncClient client = factory();
+
+            return Entry(std::move(client), expiryTime());
+        }),
+    inUse(0), peakInUse(0), lowIntervals(0), stopping(false)
+{
+    for(auto &count: waits)
+        count.store(0);
+
+    if (poolOptions.size == 0)
+        throw std::invalid_argument("ConnectionPool: size must be positive");
+
+    if (poolOptions.minIdle > poolOptions.size)
+        throw std::invalid_argument("ConnectionPool: minIdle is larger than size");
+
+    if (poolOptions.targetWait.total_microseconds() > 0)
+    {
+        if (poolOptions.minSize > poolOptions.size)
+            throw std::invalid_argument("ConnectionPool: minSize is larger than size");
+
+        if (poolOptions.scaleInterval.total_microseconds() <= 0)
+            throw std::invalid_argument("ConnectionPool: scaleInterval must be positive");
 
-        _move(std::move(that));
+        poolOptions.minSize = std::max(poolOptions.minSize, std::max<size_t>(poolOptions.minIdle, 1));
+        entries.setLimit(poolOptions.minSize);
     }
 
-    return *this;
+    warmUp(poolOptions.minIdle);
+
+    if (poolOptions.maxIdleTime.total_microseconds() > 0 ||
+            poolOptions.targetWait.total_microseconds() > 0 ||
+            poolOptions.healthCheckInterval.total_microseconds() > 0)
+        maintenance = std::thread([this]() { maintain(); });
 }
 
-Connection ConnectionPool::fetch() {
-    std::unique_lock<std::mutex> lock(_mutex);
+ConnectionPool::ConnectionPool(boost::asio::io_service &ioService,
+        const boost::asio::ip::tcp::endpoint &endpoint,
+        const ConnectionPoolOptions &options,
+        std::function<void(RedisSyncClient &)> configure)
+    : ConnectionPool([&ioService, endpoint, configure]() {
+            RedisSyncClient client(ioService);
 
-    if (_pool.empty()) {
-        if (_used_connections == _pool_opts.size) {
-            _wait_for_connection(lock);
-        } else {
-            // Lazily create a new connection.
-            // why ooonly one?
-            auto connection = _create();
+            if (configure)
+                configure(client);
 
-            ++_used_connections;
+            client.connect(endpoint);
+            return client;
+        }, options)
+{
+}
 
-            return connection;
+ConnectionPool::~ConnectionPool()
+{
+    if (maintenance.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(maintenanceMutex);
+            stopping = true;
         }
+
+        maintenanceCv.notify_one();
+        maintenance.join();
     }
+}
 
-    // _pool is NOT empty.
-    auto connection = _fetch();
+PooledConnection ConnectionPool::fetch()
+{
+    boost::system::error_code ec;
+    PooledConnection connection = fetch(ec);
 
-    auto connection_lifetime = _pool_opts.connection_lifetime;
+    detail::throwIfError(ec);
+    return connection;
+}
 
-    if (_sentinel) {
-        auto opts = _opts;
-        auto role_changed = _role_changed(connection.options());
-        auto sentinel = _sentinel;
+PooledConnection ConnectionPool::fetch(boost::system::error_code &ec)
+{
+    ObjectPool<Entry>::Deadline deadline = ObjectPool<Entry>::Deadline::max();
 
-        lock.unlock();
+    if (poolOptions.waitTimeout.total_microseconds() > 0)
+    {
+        deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(poolOptions.waitTimeout.total_microseconds());
+    }
 
-        if (role_changed || _need_reconnect(connection, connection_lifetime)) {
-            try {
-                connection = _create(sentinel, opts, false);
-            } catch (const Error &e) {
-                // Failed to reconnect, return it to the pool, and retry latter.
-                release(std::move(connection));
-                throw;
-            }
+    for(;;)
+    {
+        std::chrono::steady_clock::duration waited;
+        size_t slot;
+
+        try
+        {
+            slot = entries.acquire(deadline, waited);
+        }
+        catch(const boost::system::system_error &e)
+        {
+            ec = e.code();
+            return PooledConnection();
         }
 
-        return connection;
-    }
+        recordWait(waited);
+
+        if (slot == ObjectPool<Entry>::npos)
+        {
+            ec = boost::asio::error::timed_out;
+            return PooledConnection();
+        }
+
+        if (usable(entries.get(slot)))
+        {
+            size_t count = ++inUse;
+            size_t peak = peakInUse.load();
 
-    lock.unlock();
+            while (peak < count && !peakInUse.compare_exchange_weak(peak, count))
+                ;
 
-    if (_need_reconnect(connection, connection_lifetime)) {
-        try {
-            connection.reconnect();
-        } catch (const Error &e) {
-            // Failed to reconnect, return it to the pool, and retry latter.
-            release(std::move(connection));
-            throw;
+            return PooledConnection(this, slot);
         }
+
+        // Broken or expired, the next acquire() reconnects in this slot.
+        entries.discard(slot);
     }
+}
 
-    return connection;
+const ConnectionPoolOptions &ConnectionPool::options() const
+{
+    return poolOptions;
 }
 
-ConnectionOptions ConnectionPool::connection_options() {
-    std::lock_guard<std::mutex> lock(_mutex);
+size_t ConnectionPool::size() const
+{
+    return entries.size();
+}
+
+size_t ConnectionPool::capacity() const
+{
+    return entries.limit();
+}
 
-    return _opts;
+void ConnectionPool::resize(size_t size)
+{
+    entries.setLimit(size);
 }
 
-// //将连接放回连接池
-void ConnectionPool::release(Connection connection) {
+void ConnectionPool::warmUp(size_t count)
+{
+    // Enough to hide the connect latency, few enough to start anywhere.
+    static const size_t maxWorkers = 8;
+
+    std::vector<size_t> slots(count, ObjectPool<Entry>::npos);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+
+    // Connect in parallel, startup costs about count / maxWorkers
+    // connects. A connection failing here is created on demand later.
+    auto work = [this, &slots, &next, count]() {
+        for(size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                slots[i] = entries.tryCreate();
+            }
+            catch(const std::exception &)
+            {
+            }
+        }
+    };
+
+    try
+    {
+        for(size_t i = 1; i < std::min(count, maxWorkers); ++i)
+            workers.emplace_back(work);
+    }
+    catch(const std::system_error &)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
+        // Out of threads: the ones started and this one do the rest.
+    }
+
+    work();
 
-        _pool.push_back(std::move(connection));
+    for(auto &worker: workers)
+        worker.join();
+
+    for(size_t slot: slots)
+    {
+        if (slot != ObjectPool<Entry>::npos)
+            entries.release(slot);
     }
+}
 
-    _cv.notify_one();
+bool ConnectionPool::usable(Entry &entry) const
+{
+    return entry.client.isConnected() && std::chrono::steady_clock::now() < entry.expires;
 }
 
-Connection ConnectionPool::create() {
-    std::unique_lock<std::mutex> lock(_mutex);
+std::chrono::steady_clock::time_point ConnectionPool::expiryTime() const
+{
+    int64_t lifetime = poolOptions.connectionLifetime.total_microseconds();
+    int64_t jitter = poolOptions.lifetimeJitter.total_microseconds();
 
-    auto opts = _opts;
+    if (lifetime <= 0)
+        return std::chrono::steady_clock::time_point::max();
 
-    if (_sentinel) {
-        auto sentinel = _sentinel;
+    if (jitter > 0)
+    {
+        static thread_local std::mt19937_64 random(std::random_device{}());
+        // Never expire on connect.
+        std::uniform_int_distribution<int64_t> distribution(0, std::min(jitter, lifetime / 2));
 
-        lock.unlock();
+        lifetime -= distribution(random);
+    }
 
-        return _create(sentinel, opts, false);
-    } else {
-        lock.unlock();
+    return std::chrono::steady_clock::now() + std::chrono::microseconds(lifetime);
+}
 
-        return Connection(opts);
+void ConnectionPool::release(size_t slot)
+{
+    Entry &entry = entries.get(slot);
+
+    --inUse;
+
+    if (entry.client.isConnected())
+    {
+        entry.lastUsed = std::chrono::steady_clock::now();
+        entries.release(slot);
+    }
+    else
+    {
+        entries.discard(slot);
     }
 }
 
-ConnectionPool ConnectionPool::clone() {
-    std::unique_lock<std::mutex> lock(_mutex);
+void ConnectionPool::maintain()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::duration reapInterval =
+        std::chrono::microseconds(poolOptions.maxIdleTime.total_microseconds() / 2);
+    const Clock::duration scaleInterval =
+        std::chrono::microseconds(poolOptions.scaleInterval.total_microseconds());
+    const Clock::duration healthCheckInterval =
+        std::chrono::microseconds(poolOptions.healthCheckInterval.total_microseconds());
+
+    // Checking twice per maxIdleTime, a connection is closed at most
+    // maxIdleTime / 2 late.
+    Clock::time_point nextReap = reapInterval > Clock::duration::zero() ?
+        Clock::now() + reapInterval : Clock::time_point::max();
+    Clock::time_point nextScale = poolOptions.targetWait.total_microseconds() > 0 ?
+        Clock::now() + scaleInterval : Clock::time_point::max();
+    Clock::time_point nextCheck = healthCheckInterval > Clock::duration::zero() ?
+        Clock::now() + healthCheckInterval : Clock::time_point::max();
+
+    std::unique_lock<std::mutex> lock(maintenanceMutex);
+
+    while (!maintenanceCv.wait_until(lock, std::min(std::min(nextReap, nextScale), nextCheck),
+                [this]() { return stopping; }))
+    {
+        lock.unlock();
 
-    auto opts = _opts;
-    auto pool_opts = _pool_opts;
+        Clock::time_point now = Clock::now();
 
-    if (_sentinel) {
-        auto sentinel = _sentinel;
+        if (now >= nextReap)
+        {
+            reapIdle();
+            nextReap = now + reapInterval;
+        }
 
-        lock.unlock();
+        if (now >= nextScale)
+        {
+            autoscale();
+            nextScale = now + scaleInterval;
+        }
 
-        return ConnectionPool(sentinel, pool_opts, opts);
-    } else {
-        lock.unlock();
+        if (now >= nextCheck)
+        {
+            checkHealth();
+            nextCheck = Clock::now() + healthCheckInterval;
+        }
 
-        return ConnectionPool(pool_opts, opts);
+        lock.lock();
     }
 }
 
-void ConnectionPool::_move(ConnectionPool &&that) {
-    _opts = std::move(that._opts);
-    _pool_opts = std::move(that._pool_opts);
-    _pool = std::move(that._pool);
-    _used_connections = that._used_connections;
-    _sentinel = std::move(that._sentinel);
+void ConnectionPool::reapIdle()
+{
+    const std::chrono::microseconds maxIdleTime(poolOptions.maxIdleTime.total_microseconds());
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    entries.reap([now, maxIdleTime](Entry &entry) {
+            return now - entry.lastUsed > maxIdleTime;
+        }, poolOptions.minIdle);
 }
 
-Connection ConnectionPool::_create() {
-    if (_sentinel) {
-        // Get Redis host and port info from sentinel.
-        return _create(_sentinel, _opts, true);
-    }
+void ConnectionPool::checkHealth()
+{
+    const std::chrono::microseconds interval(poolOptions.healthCheckInterval.total_microseconds());
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
-    return Connection(_opts);
-}
+    // Recently used connections are known to work and stay in the pool.
+    std::vector<size_t> slots = entries.acquireIdle([now, interval](Entry &entry) {
+            return !entry.client.isConnected() || now >= entry.expires ||
+                (now - entry.lastUsed >= interval && now - entry.lastChecked >= interval);
+        });
 
-Connection ConnectionPool::_create(SimpleSentinel &sentinel,
-                                    const ConnectionOptions &opts,
-                                    bool locked) {
-    try {
-        auto connection = sentinel.create(opts);
+    for(size_t slot: slots)
+    {
+        Entry &entry = entries.get(slot);
+        bool healthy = entry.client.isConnected() && now < entry.expires;
 
-        std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
-        if (!locked) {
-            lock.lock();
+        if (healthy)
+        {
+            boost::system::error_code ec;
+            RedisValue result = entry.client.command("PING", {},
+                    poolOptions.healthCheckTimeout, ec);
+
+            healthy = !ec && !result.isError();
         }
 
-        const auto &connection_opts = connection.options();
-        if (_role_changed(connection_opts)) {
-            // Master/Slave has been changed, reconnect all connections.
-            _update_connection_opts(connection_opts.host, connection_opts.port);
+        if (healthy)
+        {
+            entry.lastChecked = now;
         }
+        else
+        {
+            // The new connection is as idle as the old one for the reaper.
+            std::chrono::steady_clock::time_point lastUsed = entry.lastUsed;
+
+            try
+            {
+                entries.recreate(slot);
+            }
+            catch(const std::exception &)
+            {
+                // Discarded, fetch() will try to connect again.
+                continue;
+            }
 
-        return connection;
-    } catch (const StopIterError &e) {
-        throw Error("Failed to create connection with sentinel");
+            entries.get(slot).lastUsed = lastUsed;
+        }
+
+        entries.release(slot);
     }
+
+    // Replace connections dropped since (e.g. broken in use).
+    if (entries.size() < poolOptions.minIdle)
+        warmUp(poolOptions.minIdle - entries.size());
 }
 
-Connection ConnectionPool::_fetch() {
-    assert(!_pool.empty());
+void ConnectionPool::autoscale()
+{
+    const size_t buckets = sizeof(waits) / sizeof(waits[0]);
+    uint64_t counts[buckets];
+    uint64_t total = 0;
 
-    auto connection = std::move(_pool.front());
-    _pool.pop_front();
+    for(size_t i = 0; i < buckets; ++i)
+    {
+        counts[i] = waits[i].exchange(0);
+        total += counts[i];
+    }
 
-    return connection;
-}
+    // Upper bound of the bucket holding the 95th percentile, so p95 is
+    // overestimated by up to 2x.
+    int64_t p95 = 0;
 
-void ConnectionPool::_wait_for_connection(std::unique_lock<std::mutex> &lock) {
-    auto timeout = _pool_opts.wait_timeout;
-    if (timeout > std::chrono::milliseconds(0)) {
-        // Wait until _pool is no longer empty or timeout.
-        if (!_cv.wait_for(lock,
-                    timeout,
-                    [this] { return !(this->_pool).empty(); })) {
-            throw Error("Failed to fetch a connection in "
-                    + std::to_string(timeout.count()) + " milliseconds");
+    for(size_t i = 0, seen = 0; i < buckets && total > 0; ++i)
+    {
+        seen += counts[i];
+
+        if (seen * 100 >= total * 95)
+        {
+            p95 = int64_t(1) << i;
+            break;
         }
-    } else {
-        // Wait forever.
-        _cv.wait(lock, [this] { return !(this->_pool).empty(); });
     }
-}
 
-bool ConnectionPool::_need_reconnect(const Connection &connection,
-                                    const std::chrono::milliseconds &connection_lifetime) const {
-    if (connection.broken()) {
-        return true;
-    }
+    const size_t capacity = entries.limit();
+    const size_t peak = peakInUse.exchange(inUse.load());
+    const size_t step = std::max<size_t>(capacity / 4, 1);
 
-    if (connection_lifetime > std::chrono::milliseconds(0)) {
-        auto now = std::chrono::steady_clock::now();
-        if (now - connection.last_active() > connection_lifetime) {
-            return true;
-        }
+    if (peak >= capacity && p95 > poolOptions.targetWait.total_microseconds())
+    {
+        lowIntervals = 0;
+        entries.setLimit(std::min(capacity + step, poolOptions.size));
+    }
+    else if (peak * 2 > capacity)
+    {
+        lowIntervals = 0;
+    }
+    else if (++lowIntervals >= 3)
+    {
+        lowIntervals = 0;
+        entries.setLimit(std::max(capacity - step, std::max(peak, poolOptions.minSize)));
     }
+}
+
+void ConnectionPool::recordWait(std::chrono::steady_clock::duration wait)
+{
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+    size_t bucket = 0;
+
+    while (bucket + 1 < sizeof(waits) / sizeof(waits[0]) && (int64_t(1) << bucket) <= us)
+        ++bucket;
+
+    waits[bucket].fetch_add(1, std::memory_order_relaxed);
+}
 
-    return false;
 }
 
-}
\ No newline at end of file
+#endif // REDISCLIENT_CONNECTIONPOOL_CPP
@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_GLOBMATCHER_CPP
+#define REDISCLIENT_GLOBMATCHER_CPP
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "redisclient/globmatcher.h"
+
+namespace redisclient {
+
+const size_t GlobMatcher::defaultCacheBytes;
+
+GlobMatcher::GlobMatcher(size_t maxCacheBytes)
+    : trie(1), count(0), compiled(false), cacheBytes(0), maxCacheBytes(maxCacheBytes)
+{
+    trie[0].loop = false;
+}
+
+size_t GlobMatcher::add(const std::string &pattern)
+{
+    std::vector<Token> tokens = parse(pattern);
+    uint32_t node = 0;
+
+    for(const Token &token: tokens)
+    {
+        uint32_t next = static_cast<uint32_t>(trie.size());
+
+        if (token.type == Star)
+        {
+            if (trie[node].star.empty())
+                trie[node].star.push_back(next);
+            else
+                next = trie[node].star.front();
+        }
+        else
+        {
+            for(const auto &edge: trie[node].edges)
+            {
+                if (sameToken(edge.first, token))
+                {
+                    next = edge.second;
+                    break;
+                }
+            }
+
+            if (next == trie.size())
+                trie[node].edges.emplace_back(token, next);
+        }
+
+        if (next == trie.size())
+        {
+            trie.push_back(Node());
+            trie.back().loop = token.type == Star;
+        }
+
+        node = next;
+    }
+
+    trie[node].accept.push_back(static_cast<uint32_t>(count));
+    compiled = false;
+
+    return count++;
+}
+
+size_t GlobMatcher::patterns() const
+{
+    return count;
+}
+
+const std::vector<uint32_t> &GlobMatcher::match(const char *data, size_t size)
+{
+    // As in Redis, an empty string matches the empty pattern only, not "*".
+    if (size == 0)
+        return trie[0].accept;
+
+    if (!compiled)
+        compile();
+
+    int32_t current = 1;
+
+    for(size_t i = 0; i < size && current != 0; ++i)
+    {
+        uint8_t byteClass = classOf[static_cast<unsigned char>(data[i])];
+        int32_t next = states[current].next[byteClass];
+
+        current = next < 0 ? step(current, byteClass) : next;
+    }
+
+    return states[current].accept;
+}
+
+// Same tokens as stringmatchlen() of Redis, without nocase.
+std::vector<GlobMatcher::Token> GlobMatcher::parse(const std::string &pattern)
+{
+    std::vector<Token> tokens;
+    size_t i = 0;
+
+    while (i < pattern.size())
+    {
+        Token token;
+
+        token.type = Literal;
+        token.c = 0;
+
+        char c = pattern[i++];
+
+        if (c == '*')
+        {
+            while (i < pattern.size() && pattern[i] == '*')
+                ++i;
+
+            token.type = Star;
+        }
+        else if (c == '?')
+        {
+            token.type = AnyChar;
+        }
+        else if (c == '[')
+        {
+            bool negate = i < pattern.size() && pattern[i] == '^';
+
+            if (negate)
+                ++i;
+
+            token.type = CharClass;
+
+            while (i < pattern.size() && pattern[i] != ']')
+            {
+                if (pattern[i] == '\\' && i + 1 < pattern.size())
+                {
+                    token.chars.set(static_cast<unsigned char>(pattern[i + 1]));
+                    i += 2;
+                }
+                else if (i + 2 < pattern.size() && pattern[i + 1] == '-')
+                {
+                    unsigned char from = static_cast<unsigned char>(pattern[i]);
+                    unsigned char to = static_cast<unsigned char>(pattern[i + 2]);
+
+                    if (from > to)
+                        std::swap(from, to);
+
+                    for(unsigned int ch = from; ch <= to; ++ch)
+                        token.chars.set(ch);
+
+                    i += 3;
+                }
+                else
+                {
+                    token.chars.set(static_cast<unsigned char>(pattern[i++]));
+                }
+            }
+
+            // Skip ']'; an unterminated class ends with the pattern.
+            if (i < pattern.size())
+                ++i;
+
+            if (negate)
+                token.chars.flip();
+        }
+        else
+        {
+            if (c == '\\' && i < pattern.size())
+                c = pattern[i++];
+
+            token.c = static_cast<unsigned char>(c);
+        }
+
+        tokens.push_back(token);
+    }
+
+    return tokens;
+}
+
+bool GlobMatcher::sameToken(const Token &a, const Token &b)
+{
+    if (a.type != b.type)
+        return false;
+
+    if (a.type == Literal)
+        return a.c == b.c;
+
+    if (a.type == CharClass)
+        return a.chars == b.chars;
+
+    return true;
+}
+
+bool GlobMatcher::tokenMatches(const Token &token, unsigned char c)
+{
+    switch (token.type)
+    {
+    case Literal:
+        return token.c == c;
+    case CharClass:
+        return token.chars.test(c);
+    default:
+        return true;
+    }
+}
+
+// Node and the nodes after its Star edges, which match nothing too.
+void GlobMatcher::closure(uint32_t node, std::vector<uint32_t> &nodes) const
+{
+    nodes.push_back(node);
+
+    for(uint32_t next: trie[node].star)
+        closure(next, nodes);
+}
+
+int32_t GlobMatcher::state(std::vector<uint32_t> nodes)
+{
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+    size_t h = 0xcbf29ce484222325ull;
+
+    for(uint32_t node: nodes)
+        h = (h ^ node) * 0x100000001b3ull;
+
+    auto range = stateIndex.equal_range(h);
+
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        if (states[it->second].nodes == nodes)
+            return it->second;
+    }
+
+    State state;
+
+    for(uint32_t node: nodes)
+        state.accept.insert(state.accept.end(), trie[node].accept.begin(), trie[node].accept.end());
+
+    std::sort(state.accept.begin(), state.accept.end());
+    state.next.assign(representative.size(), nodes.empty() ? 0 : -1);
+    state.nodes = std::move(nodes);
+
+    int32_t index = static_cast<int32_t>(states.size());
+
+    cacheBytes += sizeof(State) + 4 * (state.nodes.size() + state.accept.size() +
+            state.next.size() + 8);
+    states.push_back(std::move(state));
+    stateIndex.emplace(h, index);
+
+    return index;
+}
+
+int32_t GlobMatcher::step(int32_t from, uint8_t byteClass)
+{
+    std::vector<uint32_t> nodes;
+    unsigned char c = representative[byteClass];
+
+    for(uint32_t node: states[from].nodes)
+    {
+        if (trie[node].loop)
+            closure(node, nodes);
+
+        for(const auto &edge: trie[node].edges)
+        {
+            if (tokenMatches(edge.first, c))
+                closure(edge.second, nodes);
+        }
+    }
+
+    if (cacheBytes >= maxCacheBytes)
+    {
+        // from is gone with the cache, its transition is not kept.
+        resetStates();
+        return state(std::move(nodes));
+    }
+
+    int32_t to = state(std::move(nodes));
+
+    states[from].next[byteClass] = to;
+    return to;
+}
+
+// Split the bytes into classes matched by the same tokens, refining the
+// partition by the byte set of every token.
+void GlobMatcher::compile()
+{
+    size_t classes = 1;
+
+    std::memset(classOf, 0, sizeof(classOf));
+
+    for(const Node &node: trie)
+    {
+        for(const auto &edge: node.edges)
+        {
+            if (edge.first.type == AnyChar)
+                continue;
+
+            // New class of (old class, in token) pairs.
+            int split[256][2];
+            size_t next = 0;
+
+            std::fill(&split[0][0], &split[0][0] + classes * 2, -1);
+
+            for(unsigned int c = 0; c < 256; ++c)
+            {
+                int &id = split[classOf[c]][tokenMatches(edge.first, c)];
+
+                if (id < 0)
+                    id = static_cast<int>(next++);
+
+                classOf[c] = static_cast<uint8_t>(id);
+            }
+
+            classes = next;
+        }
+    }
+
+    representative.assign(classes, 0);
+
+    for(unsigned int c = 256; c-- > 0;)
+        representative[classOf[c]] = static_cast<unsigned char>(c);
+
+    resetStates();
+    compiled = true;
+}
+
+void GlobMatcher::resetStates()
+{
+    std::vector<uint32_t> start;
+
+    states.clear();
+    stateIndex.clear();
+    cacheBytes = 0;
+
+    closure(0, start);
+    state(std::vector<uint32_t>());
+    state(std::move(start));
+}
+
+}
+
+#endif // REDISCLIENT_GLOBMATCHER_CPP
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_HASHRING_CPP
+#define REDISCLIENT_HASHRING_CPP
+
+#include <algorithm>
+#include <cassert>
+
+#include "redisclient/clusterslot.h"
+#include "redisclient/hashring.h"
+
+namespace redisclient {
+
+const size_t HashRing::defaultPoints;
+
+HashRing::HashRing(size_t pointsPerShard_)
+    : pointsPerShard(std::max<size_t>(pointsPerShard_, 1)), indexShift(32)
+{
+}
+
+size_t HashRing::add(const std::string &name, size_t weight)
+{
+    shardList.emplace_back(name, std::max<size_t>(weight, 1));
+    rebuild();
+
+    return shardList.size() - 1;
+}
+
+size_t HashRing::shards() const
+{
+    return shardList.size();
+}
+
+const std::string &HashRing::name(size_t shard) const
+{
+    assert(shard < shardList.size());
+    return shardList[shard].first;
+}
+
+size_t HashRing::shard(const char *key, size_t size) const
+{
+    return shardOfHash(hash(key, size));
+}
+
+size_t HashRing::shardOfHash(uint32_t hash) const
+{
+    assert(!points.empty());
+
+    size_t bucket = indexShift == 32 ? 0 : hash >> indexShift;
+    std::vector<uint32_t>::const_iterator begin = points.begin() + index[bucket];
+    std::vector<uint32_t>::const_iterator end = points.begin() + index[bucket + 1];
+    size_t point = std::lower_bound(begin, end, hash) - points.begin();
+
+    // Past the last point the ring wraps around to the first one.
+    return owners[point == points.size() ? 0 : point];
+}
+
+uint32_t HashRing::hash(const char *key, size_t size)
+{
+    std::pair<const char *, size_t> tag = keyHashTag(key, size);
+
+    return hashBytes(tag.first, tag.second);
+}
+
+uint32_t HashRing::hashBytes(const char *data, size_t size)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    // FNV-1a alone spreads short similar keys poorly; finish with the
+    // MurmurHash3 64-bit mix.
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return static_cast<uint32_t>(h >> 32);
+}
+
+void HashRing::rebuild()
+{
+    std::vector<std::pair<uint32_t, uint32_t>> ring;
+
+    for(size_t shard = 0; shard < shardList.size(); ++shard)
+    {
+        const std::string &name = shardList[shard].first;
+        size_t count = pointsPerShard * shardList[shard].second;
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            std::string point = name + "-" + std::to_string(i);
+
+            ring.emplace_back(hashBytes(point.data(), point.size()),
+                    static_cast<uint32_t>(shard));
+        }
+    }
+
+    // Points of equal hash are ordered by name, not by index, so that
+    // the placement does not depend on the order of add().
+    std::sort(ring.begin(), ring.end(),
+            [this](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) {
+                if (a.first != b.first)
+                    return a.first < b.first;
+
+                return shardList[a.second].first < shardList[b.second].first;
+            });
+
+    points.resize(ring.size());
+    owners.resize(ring.size());
+
+    for(size_t i = 0; i < ring.size(); ++i)
+    {
+        points[i] = ring[i].first;
+        owners[i] = ring[i].second;
+    }
+
+    // About one point per bucket, at most 2^16 buckets.
+    unsigned int bits = 0;
+
+    while (bits < 16 && (size_t(1) << bits) < points.size())
+        ++bits;
+
+    indexShift = 32 - bits;
+    index.resize((size_t(1) << bits) + 1);
+
+    size_t point = 0;
+
+    for(size_t bucket = 0; bucket + 1 < index.size(); ++bucket)
+    {
+        uint64_t start = static_cast<uint64_t>(bucket) << indexShift;
+
+        while (point < points.size() && points[point] < start)
+            ++point;
+
+        index[bucket] = static_cast<uint32_t>(point);
+    }
+
+    index.back() = static_cast<uint32_t>(points.size());
+}
+
+}
+
+#endif // REDISCLIENT_HASHRING_CPP
@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_IOURING_CPP
+#define REDISCLIENT_IOURING_CPP
+
+#include <boost/asio/error.hpp>
+
+#include <string.h>
+#include <errno.h>
+
+#include "iouring.h"
+
+#ifdef REDIS_CLIENT_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace redisclient {
+
+#ifdef REDIS_CLIENT_HAS_IO_URING
+
+namespace
+{
+    enum : uint64_t {
+        sendTag = 1,
+        readTag = 2,
+        timeoutTag = 3
+    };
+
+    inline unsigned loadAcquire(const unsigned *p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    inline void storeRelease(unsigned *p, unsigned value)
+    {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+
+    inline boost::system::error_code systemError(int error)
+    {
+        return boost::system::error_code(error,
+                boost::asio::error::get_system_category());
+    }
+}
+
+IoUring::IoUring()
+    : enters(0), ringFd(-1), sqRing(nullptr), cqRing(nullptr), sqes(nullptr),
+    sqRingSize(0), cqRingSize(0), sqesSize(0),
+    sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+    cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr),
+    fixedBuffer(nullptr), fixedBufferSize(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    close();
+}
+
+bool IoUring::open(char *buffer, size_t size, boost::system::error_code &ec)
+{
+    close();
+
+    io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, 8, &params));
+
+    if (fd < 0)
+    {
+        ec = systemError(errno);
+        return false;
+    }
+
+    ringFd = fd;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (singleMmap)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+
+    if (sqRing == MAP_FAILED)
+    {
+        sqRing = nullptr;
+        ec = systemError(errno);
+        close();
+        return false;
+    }
+
+    if (singleMmap)
+    {
+        cqRing = sqRing;
+    }
+    else
+    {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+
+        if (cqRing == MAP_FAILED)
+        {
+            cqRing = nullptr;
+            ec = systemError(errno);
+            close();
+            return false;
+        }
+    }
+
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED)
+    {
+        sqes = nullptr;
+        ec = systemError(errno);
+        close();
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRing);
+    char *cq = static_cast<char *>(cqRing);
+
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+
+    // Registered buffers save the page pinning on every read. They may be
+    // refused (RLIMIT_MEMLOCK), then plain recv is used.
+    iovec iov;
+
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iov, 1) == 0)
+    {
+        fixedBuffer = buffer;
+        fixedBufferSize = size;
+    }
+
+    return true;
+}
+
+void IoUring::close()
+{
+    if (sqes)
+        munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing)
+        munmap(sqRing, sqRingSize);
+    if (ringFd >= 0)
+        ::close(ringFd);
+
+    ringFd = -1;
+    sqRing = cqRing = sqes = nullptr;
+    fixedBuffer = nullptr;
+    fixedBufferSize = 0;
+}
+
+bool IoUring::isOpen() const
+{
+    return ringFd >= 0;
+}
+
+bool IoUring::probe(boost::system::error_code &ec)
+{
+#ifdef IO_URING_OP_SUPPORTED
+    const unsigned opsCount = 256;
+    std::vector<char> storage(sizeof(io_uring_probe) +
+            opsCount * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *info = reinterpret_cast<io_uring_probe *>(storage.data());
+
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE,
+                info, opsCount) != 0)
+    {
+        ec = systemError(errno);
+        return false;
+    }
+
+    const unsigned required[] = {
+        IORING_OP_SENDMSG,
+        IORING_OP_RECV,
+        IORING_OP_READ_FIXED,
+        IORING_OP_LINK_TIMEOUT
+    };
+
+    for(unsigned opcode: required)
+    {
+        if (opcode >= info->ops_len ||
+                (info->ops[opcode].flags & IO_URING_OP_SUPPORTED) == 0)
+        {
+            ec = boost::asio::error::operation_not_supported;
+            return false;
+        }
+    }
+
+    return true;
+#else
+    // Headers older than the probe interface lack IORING_OP_RECV too.
+    ec = boost::asio::error::operation_not_supported;
+    return false;
+#endif
+}
+
+void *IoUring::nextSqe()
+{
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes) + index;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    storeRelease(sqTail, tail + 1);
+
+    return sqe;
+}
+
+void IoUring::prepareRead(int socket, char *buffer, size_t size, bool link)
+{
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+
+    if (fixedBuffer && buffer >= fixedBuffer &&
+            buffer + size <= fixedBuffer + fixedBufferSize)
+    {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->buf_index = 0;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_RECV;
+    }
+
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(size);
+    sqe->user_data = readTag;
+
+    if (link)
+        sqe->flags |= IOSQE_IO_LINK;
+}
+
+void IoUring::prepareTimeout(const Deadline &deadline, void *ts)
+{
+    __kernel_timespec *timespec = static_cast<__kernel_timespec *>(ts);
+    Deadline now = std::chrono::steady_clock::now();
+    auto nsec = deadline > now ?
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count() : 0;
+
+    timespec->tv_sec = nsec / 1000000000;
+    timespec->tv_nsec = nsec % 1000000000;
+
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(timespec);
+    sqe->len = 1;
+    sqe->user_data = timeoutTag;
+}
+
+bool IoUring::submitAndWait(unsigned count, std::vector<Completion> &completions,
+        boost::system::error_code &ec)
+{
+    completions.clear();
+
+    while (completions.size() < count)
+    {
+        unsigned toSubmit = *sqTail - loadAcquire(sqHead);
+        unsigned toWait = count - static_cast<unsigned>(completions.size());
+
+        int result = static_cast<int>(syscall(__NR_io_uring_enter, ringFd,
+                    toSubmit, toWait, IORING_ENTER_GETEVENTS, nullptr, 0));
+
+        ++enters;
+
+        if (result < 0 && errno != EINTR)
+        {
+            ec = systemError(errno);
+            return false;
+        }
+
+        unsigned head = *cqHead;
+        unsigned tail = loadAcquire(cqTail);
+
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe &cqe =
+                static_cast<const io_uring_cqe *>(cqes)[head & *cqMask];
+            Completion completion = { cqe.user_data, cqe.res };
+
+            completions.push_back(completion);
+        }
+
+        storeRelease(cqHead, head);
+    }
+
+    return true;
+}
+
+void IoUring::sendAndRead(int socket,
+        const std::vector<boost::asio::const_buffer> &buffers,
+        char *buffer, size_t size, const Deadline &deadline,
+        size_t &bytesSent, size_t &bytesRead, boost::system::error_code &ec)
+{
+    std::vector<iovec> iov(buffers.size());
+    size_t total = 0;
+
+    for(size_t i = 0; i < buffers.size(); ++i)
+    {
+        iov[i].iov_base = const_cast<char *>(
+                boost::asio::buffer_cast<const char *>(buffers[i]));
+        iov[i].iov_len = boost::asio::buffer_size(buffers[i]);
+        total += iov[i].iov_len;
+    }
+
+    msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = iov.size();
+
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(nextSqe());
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = sendTag;
+
+    bool withTimeout = deadline != Deadline::max();
+    __kernel_timespec ts;
+
+    prepareRead(socket, buffer, size, withTimeout);
+
+    if (withTimeout)
+        prepareTimeout(deadline, &ts);
+
+    std::vector<Completion> completions;
+
+    bytesSent = 0;
+    bytesRead = 0;
+
+    if (!submitAndWait(withTimeout ? 3 : 2, completions, ec))
+        return;
+
+    int sendResult = 0;
+    int readResult = 0;
+    int timeoutResult = 0;
+
+    for(const auto &completion: completions)
+    {
+        if (completion.userData == sendTag)
+            sendResult = completion.result;
+        else if (completion.userData == readTag)
+            readResult = completion.result;
+        else
+            timeoutResult = completion.result;
+    }
+
+    if (sendResult < 0)
+    {
+        ec = systemError(-sendResult);
+        return;
+    }
+
+    bytesSent = static_cast<size_t>(sendResult);
+
+    if (bytesSent < total)
+    {
+        // Short write broke the link, caller finishes the write.
+        return;
+    }
+
+    if (readResult > 0)
+        bytesRead = static_cast<size_t>(readResult);
+    else if (readResult == 0)
+        ec = boost::asio::error::eof;
+    else if (readResult == -ECANCELED && timeoutResult == -ETIME)
+        ec = systemError(ETIMEDOUT);
+    else if (readResult == -EINTR || readResult == -EAGAIN)
+        return; // caller reads the reply with read()
+    else
+        ec = systemError(-readResult);
+}
+
+size_t IoUring::read(int socket, char *buffer, size_t size,
+        const Deadline &deadline, boost::system::error_code &ec)
+{
+    for(;;)
+    {
+        bool withTimeout = deadline != Deadline::max();
+        __kernel_timespec ts;
+
+        prepareRead(socket, buffer, size, withTimeout);
+
+        if (withTimeout)
+            prepareTimeout(deadline, &ts);
+
+        std::vector<Completion> completions;
+
+        if (!submitAndWait(withTimeout ? 2 : 1, completions, ec))
+            return 0;
+
+        int readResult = 0;
+        int timeoutResult = 0;
+
+        for(const auto &completion: completions)
+        {
+            if (completion.userData == readTag)
+                readResult = completion.result;
+            else
+                timeoutResult = completion.result;
+        }
+
+        if (readResult > 0)
+            return static_cast<size_t>(readResult);
+        else if (readResult == 0)
+            ec = boost::asio::error::eof;
+        else if (readResult == -ECANCELED && timeoutResult == -ETIME)
+            ec = systemError(ETIMEDOUT);
+        else if (readResult == -EINTR || readResult == -EAGAIN)
+            continue;
+        else
+            ec = systemError(-readResult);
+
+        return 0;
+    }
+}
+
+#else // REDIS_CLIENT_HAS_IO_URING
+
+IoUring::IoUring()
+    : enters(0), ringFd(-1), sqRing(nullptr), cqRing(nullptr), sqes(nullptr),
+    sqRingSize(0), cqRingSize(0), sqesSize(0),
+    sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr),
+    cqHead(nullptr), cqTail(nullptr), cqMask(nullptr), cqes(nullptr),
+    fixedBuffer(nullptr), fixedBufferSize(0)
+{
+}
+
+IoUring::~IoUring()
+{
+}
+
+bool IoUring::open(char *, size_t, boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+    return false;
+}
+
+void IoUring::close()
+{
+}
+
+bool IoUring::isOpen() const
+{
+    return false;
+}
+
+bool IoUring::probe(boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+    return false;
+}
+
+void IoUring::sendAndRead(int, const std::vector<boost::asio::const_buffer> &,
+        char *, size_t, const Deadline &, size_t &bytesSent, size_t &bytesRead,
+        boost::system::error_code &ec)
+{
+    bytesSent = bytesRead = 0;
+    ec = boost::asio::error::operation_not_supported;
+}
+
+size_t IoUring::read(int, char *, size_t, const Deadline &,
+        boost::system::error_code &ec)
+{
+    ec = boost::asio::error::operation_not_supported;
+    return 0;
+}
+
+#endif // REDIS_CLIENT_HAS_IO_URING
+
+}
+
+#endif // REDISCLIENT_IOURING_CPP
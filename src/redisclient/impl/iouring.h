@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_IOURING_H
+#define REDISCLIENT_IOURING_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <vector>
+#include <chrono>
+
+#include "redisclient/config.h"
+
+#if defined(__linux__) && defined(__has_include)
+#    if __has_include(<linux/io_uring.h>)
+#        define REDIS_CLIENT_HAS_IO_URING
+#    endif
+#endif
+
+namespace redisclient {
+
+// Minimal io_uring ring for the sync client, built on the raw syscalls
+// (no liburing). One ring per connection, used from one thread.
+// If io_uring is not compiled in or the kernel refuses it, open()
+// fails and the caller falls back to poll().
+class IoUring : boost::noncopyable {
+public:
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+    REDIS_CLIENT_DECL IoUring();
+    REDIS_CLIENT_DECL ~IoUring();
+
+    // Create the ring and register [buffer, buffer + size) for fixed reads.
+    REDIS_CLIENT_DECL bool open(char *buffer, size_t size,
+            boost::system::error_code &ec);
+    REDIS_CLIENT_DECL void close();
+    REDIS_CLIENT_DECL bool isOpen() const;
+
+    // Return true if the kernel supports every opcode used by
+    // sendAndRead() and read() (IORING_REGISTER_PROBE, Linux 5.6+).
+    REDIS_CLIENT_DECL bool probe(boost::system::error_code &ec);
+
+    // Write buffers and read the reply with a single io_uring_enter():
+    // sendmsg is linked to a read into [buffer, buffer + size). The read
+    // is skipped (bytesRead == 0, no error) if the write was short or
+    // the read was interrupted (EINTR, EAGAIN).
+    REDIS_CLIENT_DECL void sendAndRead(int socket,
+            const std::vector<boost::asio::const_buffer> &buffers,
+            char *buffer, size_t size, const Deadline &deadline,
+            size_t &bytesSent, size_t &bytesRead,
+            boost::system::error_code &ec);
+
+    // Read into [buffer, buffer + size) until some data, eof or deadline.
+    REDIS_CLIENT_DECL size_t read(int socket, char *buffer, size_t size,
+            const Deadline &deadline, boost::system::error_code &ec);
+
+    // Number of io_uring_enter() calls.
+    size_t enters;
+
+private:
+    struct Completion {
+        uint64_t userData;
+        int32_t result;
+    };
+
+    REDIS_CLIENT_DECL void *nextSqe();
+    REDIS_CLIENT_DECL void prepareRead(int socket, char *buffer, size_t size,
+            bool link);
+    REDIS_CLIENT_DECL void prepareTimeout(const Deadline &deadline, void *ts);
+    REDIS_CLIENT_DECL bool submitAndWait(unsigned count,
+            std::vector<Completion> &completions, boost::system::error_code &ec);
+
+    int ringFd;
+    void *sqRing;
+    void *cqRing;
+    void *sqes;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    void *cqes;
+
+    char *fixedBuffer;
+    size_t fixedBufferSize;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "iouring.cpp"
+#endif
+
+#endif // REDISCLIENT_IOURING_H
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_KEY_CPP
+#define REDISCLIENT_KEY_CPP
+
+#include <cstring>
+
+#include "redisclient/clusterslot.h"
+#include "redisclient/key.h"
+
+namespace redisclient {
+
+Key::Key(const char *key, size_t size)
+{
+    std::shared_ptr<Impl> impl = std::make_shared<Impl>();
+    std::string header = "$" + std::to_string(size) + "\r\n";
+
+    impl->encoded.reserve(header.size() + size + 2);
+    impl->encoded.insert(impl->encoded.end(), header.begin(), header.end());
+    impl->encoded.insert(impl->encoded.end(), key, key + size);
+    impl->encoded.push_back('\r');
+    impl->encoded.push_back('\n');
+    impl->offset = header.size();
+    impl->hash = HashRing::hash(key, size);
+    impl->slot = keySlot(key, size);
+
+    this->impl = std::move(impl);
+}
+
+Key::Key(const char *key)
+    : Key(key, std::strlen(key))
+{
+}
+
+Key::Key(const std::string &key)
+    : Key(key.data(), key.size())
+{
+}
+
+std::string Key::str() const
+{
+    return std::string(data(), size());
+}
+
+}
+
+#endif // REDISCLIENT_KEY_CPP
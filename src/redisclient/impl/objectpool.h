@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_OBJECTPOOL_H
+#define REDISCLIENT_OBJECTPOOL_H
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace redisclient {
+
+// Fixed capacity pool of lazily created objects (connections), addressed
+// by slot index. Idle objects are reused LIFO, so the most recently used
+// (hottest) one is taken first. Idle slots are found without locks: first in a small
+// per-thread cache of recently released slots, then in a lock-free global
+// stack, then by scanning for slots cached by other threads (the most
+// recently released of them). A thread
+// parks only when nothing is idle and the pool is full. Released objects
+// go to the releasing thread's cache (so it may take them again) unless
+// the oldest parked thread waits longer than handoffDelay; then they are
+// handed to it directly, so busy threads can't starve parked ones.
+// Every release wakes a different parked thread, and a thread leaving
+// acquire() wakes the next one if objects are still available.
+// The number of objects may be limited below capacity at runtime, see
+// setLimit(). The factory is never called with the mutex held.
+template<typename T>
+class ObjectPool : boost::noncopyable {
+public:
+    typedef std::function<T()> Factory;
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    ObjectPool(size_t capacity, Factory factory);
+
+    // Take an idle object or create a new one. Return npos if the pool
+    // is full and all objects are in use.
+    size_t tryAcquire();
+
+    // Create a new object, even if others are idle. Return npos if the
+    // pool is full.
+    size_t tryCreate();
+
+    // As tryAcquire(), but wait for a released object (until deadline).
+    // waited is set to the time spent parked, without creating objects.
+    size_t acquire();
+    size_t acquire(const Deadline &deadline);
+    size_t acquire(const Deadline &deadline, std::chrono::steady_clock::duration &waited);
+
+    // Give back an acquired object.
+    void release(size_t slot);
+
+    // Destroy an acquired object (e.g. a broken connection); its slot
+    // may be used to create a new one.
+    void discard(size_t slot);
+
+    // Replace an acquired object by a new one from the factory. If the
+    // factory throws, the slot is discarded.
+    void recreate(size_t slot);
+
+    // Acquire all idle objects for which select(object) is true, e.g. to
+    // check them outside of the pool. Others stay idle, in their order.
+    std::vector<size_t> acquireIdle(const std::function<bool(T &)> &select);
+
+    // Object of an acquired slot.
+    T &get(size_t slot);
+
+    size_t capacity() const;
+
+    // Max number of objects, at most capacity (the default). Lowering it
+    // destroys idle objects above the new limit now and objects in use
+    // when released.
+    void setLimit(size_t limit);
+    size_t limit() const;
+
+    // Number of objects, idle or in use.
+    size_t size() const;
+
+    // Destroy idle objects for which expired(object) is true, as long as
+    // more than keep objects remain. Return the number destroyed. Idle
+    // objects are held by the caller while checked.
+    size_t reap(const std::function<bool(T &)> &expired, size_t keep);
+
+private:
+    enum SlotState { Empty, InUse, IdleLocal, IdleGlobal };
+
+    struct Slot {
+        std::unique_ptr<T> value;
+        std::atomic<int> state;
+        std::atomic<uint32_t> next;
+        std::atomic<uint64_t> released; // stamp of the last IdleLocal release
+    };
+
+    // Per-thread hints: slots released by this thread. A slot may still
+    // be taken by another thread, so every hint is checked by a CAS.
+    struct LocalCache {
+        uint64_t pool;
+        uint32_t size;
+        uint32_t slots[4];
+    };
+
+    // Thread parked in acquire(). release() hands a slot to the oldest.
+    // notified is set by a wakeup not yet looked at, so that each
+    // wakeup goes to a different thread.
+    struct Waiter {
+        Waiter()
+            : slot(npos), notified(false), parked(std::chrono::steady_clock::now())
+        {
+        }
+
+        size_t slot;
+        bool notified;
+        std::chrono::steady_clock::time_point parked;
+        std::condition_variable cv;
+    };
+
+    static std::chrono::steady_clock::duration handoffDelay()
+    {
+        return std::chrono::milliseconds(1);
+    }
+
+    static const uint32_t nil = static_cast<uint32_t>(-1);
+
+    static LocalCache &localCache();
+    static uint64_t nextPoolId();
+
+    // Treiber stack with a tag in the high half of head against ABA.
+    uint32_t pop(std::atomic<uint64_t> &head);
+    void push(std::atomic<uint64_t> &head, uint32_t index);
+
+    size_t takeIdle();
+    std::vector<uint32_t> takeAllIdle();
+    void putBackIdle(const std::vector<uint32_t> &idle);
+    uint32_t takeEmpty();
+    bool dropObject(size_t keep);
+    void destroy(size_t slot);
+    bool handOff(size_t slot);
+    size_t create(uint32_t index);
+    bool available() const;
+    void unpark(Waiter &waiter);
+    void notifyParked();
+    void wakeWaiter();
+
+    const uint64_t id;
+    const size_t slotCount;
+    Factory factory;
+    std::unique_ptr<Slot[]> slots;
+
+    std::atomic<uint64_t> idleHead;
+    std::atomic<uint64_t> emptyHead;
+    std::atomic<size_t> objects; // including ones being created
+    std::atomic<size_t> maxObjects;
+    std::atomic<uint64_t> releases;
+
+    std::atomic<size_t> waiters; // parked.size()
+    std::mutex mutex;
+    std::deque<Waiter *> parked; // guarded by mutex
+};
+
+template<typename T>
+const size_t ObjectPool<T>::npos;
+
+template<typename T>
+const uint32_t ObjectPool<T>::nil;
+
+template<typename T>
+ObjectPool<T>::ObjectPool(size_t capacity, Factory factory_)
+    : id(nextPoolId()), slotCount(capacity), factory(std::move(factory_)),
+    slots(new Slot[capacity]), idleHead(nil), emptyHead(nil), objects(0), maxObjects(capacity), releases(0), waiters(0)
+{
+    for(size_t i = capacity; i > 0; --i)
+    {
+        slots[i - 1].state.store(Empty);
+        slots[i - 1].released.store(0);
+        push(emptyHead, static_cast<uint32_t>(i - 1));
+    }
+}
+
+template<typename T>
+size_t ObjectPool<T>::tryAcquire()
+{
+    size_t slot = takeIdle();
+
+    if (slot != npos)
+        return slot;
+
+    uint32_t index = takeEmpty();
+
+    if (index != nil)
+        return create(index);
+
+    return npos;
+}
+
+template<typename T>
+size_t ObjectPool<T>::tryCreate()
+{
+    uint32_t index = takeEmpty();
+
+    if (index != nil)
+        return create(index);
+
+    return npos;
+}
+
+template<typename T>
+size_t ObjectPool<T>::acquire()
+{
+    return acquire(Deadline::max());
+}
+
+template<typename T>
+size_t ObjectPool<T>::acquire(const Deadline &deadline)
+{
+    std::chrono::steady_clock::duration waited;
+
+    return acquire(deadline, waited);
+}
+
+template<typename T>
+size_t ObjectPool<T>::acquire(const Deadline &deadline,
+        std::chrono::steady_clock::duration &waited)
+{
+    waited = std::chrono::steady_clock::duration::zero();
+
+    size_t slot = tryAcquire();
+
+    if (slot != npos)
+        return slot;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    Waiter self;
+
+    parked.push_back(&self);
+    ++waiters;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for(;;)
+    {
+        if (self.slot != npos)
+        {
+            waited = std::chrono::steady_clock::now() - self.parked;
+            return self.slot;
+        }
+
+        // A wakeup is for one object, this look takes care of it.
+        self.notified = false;
+        slot = takeIdle();
+
+        if (slot != npos)
+            break;
+
+        uint32_t index = takeEmpty();
+
+        if (index != nil)
+        {
+            unpark(self);
+
+            if (available())
+                notifyParked();
+
+            lock.unlock();
+            waited = std::chrono::steady_clock::now() - self.parked;
+            return create(index);
+        }
+
+        if (deadline == Deadline::max())
+        {
+            self.cv.wait(lock);
+        }
+        else if (self.cv.wait_until(lock, deadline) == std::cv_status::timeout)
+        {
+            if (self.slot != npos)
+            {
+                waited = std::chrono::steady_clock::now() - self.parked;
+                return self.slot;
+            }
+
+            slot = takeIdle();
+            break;
+        }
+    }
+
+    waited = std::chrono::steady_clock::now() - self.parked;
+    unpark(self);
+
+    // Wakeups may have raced with this one (or with the timeout):
+    // pass on what is left to the next waiter.
+    if (available())
+        notifyParked();
+
+    return slot;
+}
+
+template<typename T>
+void ObjectPool<T>::release(size_t slot)
+{
+    if (dropObject(maxObjects.load()))
+    {
+        // Above the limit after setLimit().
+        destroy(slot);
+        return;
+    }
+
+    if (handOff(slot))
+        return;
+
+    LocalCache &cache = localCache();
+
+    if (cache.pool != id)
+    {
+        // Hints of another pool; its slots remain reachable by scanning.
+        cache.pool = id;
+        cache.size = 0;
+    }
+
+    if (cache.size < sizeof(cache.slots) / sizeof(cache.slots[0]))
+    {
+        cache.slots[cache.size++] = static_cast<uint32_t>(slot);
+        slots[slot].released.store(++releases, std::memory_order_relaxed);
+        slots[slot].state.store(IdleLocal);
+    }
+    else
+    {
+        slots[slot].state.store(IdleGlobal);
+        push(idleHead, static_cast<uint32_t>(slot));
+    }
+
+    wakeWaiter();
+}
+
+template<typename T>
+void ObjectPool<T>::discard(size_t slot)
+{
+    --objects;
+    destroy(slot);
+}
+
+template<typename T>
+void ObjectPool<T>::recreate(size_t slot)
+{
+    try
+    {
+        slots[slot].value.reset(new T(factory()));
+    }
+    catch(...)
+    {
+        discard(slot);
+        throw;
+    }
+}
+
+template<typename T>
+std::vector<size_t> ObjectPool<T>::acquireIdle(const std::function<bool(T &)> &select)
+{
+    std::vector<uint32_t> idle = takeAllIdle();
+    std::vector<uint32_t> kept;
+    std::vector<size_t> selected;
+
+    for(uint32_t index: idle)
+    {
+        if (select(*slots[index].value))
+            selected.push_back(index);
+        else
+            kept.push_back(index);
+    }
+
+    putBackIdle(kept);
+    return selected;
+}
+
+template<typename T>
+T &ObjectPool<T>::get(size_t slot)
+{
+    return *slots[slot].value;
+}
+
+template<typename T>
+size_t ObjectPool<T>::capacity() const
+{
+    return slotCount;
+}
+
+template<typename T>
+void ObjectPool<T>::setLimit(size_t limit)
+{
+    limit = std::min(std::max<size_t>(limit, 1), slotCount);
+
+    if (maxObjects.exchange(limit) > limit)
+        reap([](T &) { return true; }, limit);
+    else
+        wakeWaiter(); // may create objects now
+}
+
+template<typename T>
+size_t ObjectPool<T>::limit() const
+{
+    return maxObjects.load();
+}
+
+template<typename T>
+size_t ObjectPool<T>::size() const
+{
+    return objects.load();
+}
+
+template<typename T>
+size_t ObjectPool<T>::reap(const std::function<bool(T &)> &expired, size_t keep)
+{
+    std::vector<uint32_t> idle = takeAllIdle();
+    std::vector<uint32_t> kept;
+    size_t destroyed = 0;
+
+    for(uint32_t index: idle)
+    {
+        if (objects.load() > keep && expired(*slots[index].value) && dropObject(keep))
+        {
+            destroy(index);
+            ++destroyed;
+        }
+        else
+        {
+            kept.push_back(index);
+        }
+    }
+
+    putBackIdle(kept);
+    return destroyed;
+}
+
+template<typename T>
+typename ObjectPool<T>::LocalCache &ObjectPool<T>::localCache()
+{
+    static thread_local LocalCache cache = { 0, 0, { 0, 0, 0, 0 } };
+
+    return cache;
+}
+
+template<typename T>
+uint64_t ObjectPool<T>::nextPoolId()
+{
+    static std::atomic<uint64_t> seq(0);
+
+    return ++seq;
+}
+
+template<typename T>
+uint32_t ObjectPool<T>::pop(std::atomic<uint64_t> &head)
+{
+    uint64_t old = head.load(std::memory_order_acquire);
+
+    for(;;)
+    {
+        uint32_t index = static_cast<uint32_t>(old);
+
+        if (index == nil)
+            return nil;
+
+        uint64_t next = slots[index].next.load(std::memory_order_relaxed);
+        uint64_t desired = (((old >> 32) + 1) << 32) | next;
+
+        if (head.compare_exchange_weak(old, desired,
+                    std::memory_order_acq_rel, std::memory_order_acquire))
+            return index;
+    }
+}
+
+template<typename T>
+void ObjectPool<T>::push(std::atomic<uint64_t> &head, uint32_t index)
+{
+    uint64_t old = head.load(std::memory_order_relaxed);
+
+    for(;;)
+    {
+        slots[index].next.store(static_cast<uint32_t>(old), std::memory_order_relaxed);
+
+        uint64_t desired = (((old >> 32) + 1) << 32) | index;
+
+        if (head.compare_exchange_weak(old, desired,
+                    std::memory_order_release, std::memory_order_relaxed))
+            return;
+    }
+}
+
+template<typename T>
+size_t ObjectPool<T>::takeIdle()
+{
+    LocalCache &cache = localCache();
+
+    if (cache.pool == id)
+    {
+        while (cache.size > 0)
+        {
+            uint32_t index = cache.slots[--cache.size];
+            int expected = IdleLocal;
+
+            if (slots[index].state.compare_exchange_strong(expected, InUse))
+                return index;
+        }
+    }
+
+    uint32_t index = pop(idleHead);
+
+    if (index != nil)
+    {
+        slots[index].state.store(InUse);
+        return index;
+    }
+
+    // Slots idle in the caches of other threads, most recently released
+    // first. Retry if another thread takes it first.
+    for(;;)
+    {
+        size_t best = npos;
+        uint64_t bestReleased = 0;
+
+        for(size_t i = 0; i < slotCount; ++i)
+        {
+            if (slots[i].state.load(std::memory_order_relaxed) == IdleLocal)
+            {
+                uint64_t released = slots[i].released.load(std::memory_order_relaxed);
+
+                if (best == npos || released > bestReleased)
+                {
+                    best = i;
+                    bestReleased = released;
+                }
+            }
+        }
+
+        if (best == npos)
+            return npos;
+
+        int expected = IdleLocal;
+
+        if (slots[best].state.compare_exchange_strong(expected, InUse))
+            return best;
+    }
+}
+
+template<typename T>
+std::vector<uint32_t> ObjectPool<T>::takeAllIdle()
+{
+    // Most recently used first.
+    std::vector<uint32_t> idle;
+
+    for(uint32_t index = pop(idleHead); index != nil; index = pop(idleHead))
+        idle.push_back(index);
+
+    size_t global = idle.size();
+
+    for(size_t i = 0; i < slotCount; ++i)
+    {
+        int expected = IdleLocal;
+
+        if (slots[i].state.compare_exchange_strong(expected, InUse))
+            idle.push_back(static_cast<uint32_t>(i));
+    }
+
+    std::sort(idle.begin() + global, idle.end(), [this](uint32_t a, uint32_t b) {
+        return slots[a].released.load(std::memory_order_relaxed) >
+            slots[b].released.load(std::memory_order_relaxed);
+    });
+
+    return idle;
+}
+
+template<typename T>
+void ObjectPool<T>::putBackIdle(const std::vector<uint32_t> &idle)
+{
+    // Push back least recently used first, to keep the LIFO order.
+    for(auto it = idle.rbegin(); it != idle.rend(); ++it)
+    {
+        if (!handOff(*it))
+        {
+            slots[*it].state.store(IdleGlobal);
+            push(idleHead, *it);
+        }
+    }
+
+    wakeWaiter();
+}
+
+template<typename T>
+uint32_t ObjectPool<T>::takeEmpty()
+{
+    // Count the new object first, so that the limit is never exceeded.
+    size_t count = objects.load();
+
+    do
+    {
+        if (count >= maxObjects.load())
+            return nil;
+    } while (!objects.compare_exchange_weak(count, count + 1));
+
+    uint32_t index = pop(emptyHead);
+
+    if (index == nil)
+        --objects; // a discarded slot is not pushed yet
+    return index;
+}
+
+template<typename T>
+bool ObjectPool<T>::dropObject(size_t keep)
+{
+    // Uncount an object if more than keep remain; the caller destroys it.
+    size_t count = objects.load();
+
+    do
+    {
+        if (count <= keep)
+            return false;
+    } while (!objects.compare_exchange_weak(count, count - 1));
+
+    return true;
+}
+
+template<typename T>
+void ObjectPool<T>::destroy(size_t slot)
+{
+    slots[slot].value.reset();
+    slots[slot].state.store(Empty);
+    push(emptyHead, static_cast<uint32_t>(slot));
+
+    wakeWaiter();
+}
+
+template<typename T>
+bool ObjectPool<T>::available() const
+{
+    if (static_cast<uint32_t>(idleHead.load()) != nil ||
+            objects.load() < maxObjects.load())
+        return true;
+
+    for(size_t i = 0; i < slotCount; ++i)
+    {
+        if (slots[i].state.load(std::memory_order_relaxed) == IdleLocal)
+            return true;
+    }
+
+    return false;
+}
+
+template<typename T>
+void ObjectPool<T>::unpark(Waiter &waiter)
+{
+    // Called with the mutex held.
+    for(auto it = parked.begin(); it != parked.end(); ++it)
+    {
+        if (*it == &waiter)
+        {
+            parked.erase(it);
+            --waiters;
+            return;
+        }
+    }
+}
+
+template<typename T>
+bool ObjectPool<T>::handOff(size_t slot)
+{
+    if (waiters.load() == 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (parked.empty() ||
+            std::chrono::steady_clock::now() - parked.front()->parked <= handoffDelay())
+        return false;
+
+    Waiter *waiter = parked.front();
+
+    parked.pop_front();
+    --waiters;
+
+    // It won't look for the object it was woken for, pass it on.
+    if (waiter->notified)
+        notifyParked();
+
+    waiter->slot = slot;
+    waiter->cv.notify_one();
+    return true;
+}
+
+template<typename T>
+size_t ObjectPool<T>::create(uint32_t index)
+{
+    try
+    {
+        slots[index].value.reset(new T(factory()));
+    }
+    catch(...)
+    {
+        --objects;
+        push(emptyHead, index);
+        wakeWaiter();
+        throw;
+    }
+
+    slots[index].state.store(InUse);
+    return index;
+}
+
+template<typename T>
+void ObjectPool<T>::wakeWaiter()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (waiters.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        notifyParked();
+    }
+}
+
+template<typename T>
+void ObjectPool<T>::notifyParked()
+{
+    // Called with the mutex held. Let the oldest waiter not woken yet
+    // look for the object; if all are, one of them will find it.
+    for(Waiter *waiter: parked)
+    {
+        if (!waiter->notified)
+        {
+            waiter->notified = true;
+            waiter->cv.notify_one();
+            return;
+        }
+    }
+}
+
+}
+
+#endif // REDISCLIENT_OBJECTPOOL_H
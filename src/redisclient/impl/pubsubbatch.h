@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_PUBSUBBATCH_H
+#define REDISCLIENT_PUBSUBBATCH_H
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+
+#include <utility>
+#include <vector>
+
+#include "redisclient/pubsubmessage.h"
+
+namespace redisclient {
+
+// Messages of a batched subscription waiting for delivery. Shared by the
+// subscribers of all channels of the subscription.
+struct PubSubBatch {
+    PubSubBatch(boost::asio::io_service &ioService, PubSubBatchHandler handler_,
+                const PubSubBatchOptions &options_)
+        : handler(std::move(handler_)), options(options_), timer(ioService),
+          pending(false), timerArmed(false)
+    {
+        if (options.maxMessages == 0)
+            options.maxMessages = 1;
+
+        messages.reserve(options.maxMessages);
+    }
+
+    PubSubBatchHandler handler;
+    PubSubBatchOptions options;
+    std::vector<PubSubMessagePtr> messages;
+    boost::asio::deadline_timer timer; // maxDelay
+    bool pending;    // in RedisClientImpl::pendingBatches
+    bool timerArmed;
+};
+
+}
+
+#endif // REDISCLIENT_PUBSUBBATCH_H
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_PUBSUBRING_CPP
+#define REDISCLIENT_PUBSUBRING_CPP
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#include "redisclient/pubsubring.h"
+
+namespace redisclient {
+
+PubSubRing::PubSubRing(size_t capacity, PubSubOverflow overflow_)
+    : slots(new Slot[roundUp(capacity)]), mask(roundUp(capacity) - 1),
+      overflow(overflow_), head(0), cachedTail(0), dropped(0), blocked(0),
+      maxLag(0), tail(0), popped(0), consumerWaiting(false),
+      producerWaiting(false), isClosed(false)
+{
+    for(size_t i = 0; i <= mask; ++i)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool PubSubRing::push(PubSubMessagePtr message)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+
+    if (isClosed.load(std::memory_order_acquire))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (h - cachedTail > mask)
+    {
+        cachedTail = tail.load(std::memory_order_acquire);
+
+        while (h - cachedTail > mask)
+        {
+            if (overflow == PubSubOverflow::DropNewest)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else if (overflow == PubSubOverflow::DropOldest)
+            {
+                uint64_t index;
+
+                // Lost to the consumer if it took the message first.
+                if (claim(index, 1) != 0)
+                {
+                    slots[index & mask].message.reset();
+                    release(index);
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            else if (!waitForRoom(h))
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+    }
+
+    Slot &slot = slots[h & mask];
+
+    // The consumer may be moving out the message of the last lap.
+    while (slot.seq.load(std::memory_order_acquire) != h)
+        std::this_thread::yield();
+
+    slot.message = std::move(message);
+    head.store(h + 1, std::memory_order_release);
+
+    // cachedTail may be far behind, so this lag is an upper bound; load
+    // tail only when it could be a new maximum.
+    size_t lag = static_cast<size_t>(h + 1 - cachedTail);
+
+    if (lag > maxLag.load(std::memory_order_relaxed))
+    {
+        cachedTail = tail.load(std::memory_order_acquire);
+        lag = static_cast<size_t>(h + 1 - cachedTail);
+
+        if (lag > maxLag.load(std::memory_order_relaxed))
+            maxLag.store(lag, std::memory_order_relaxed);
+    }
+
+    wakeConsumer();
+    return true;
+}
+
+bool PubSubRing::tryPop(PubSubMessagePtr &message)
+{
+    if (!take(message))
+        return false;
+
+    wakeProducer();
+    return true;
+}
+
+size_t PubSubRing::tryPop(std::vector<PubSubMessagePtr> &messages, size_t maxMessages)
+{
+    uint64_t from;
+    size_t count = claim(from, maxMessages);
+
+    for(uint64_t index = from; index != from + count; ++index)
+    {
+        messages.push_back(std::move(slots[index & mask].message));
+        release(index);
+    }
+
+    if (count != 0)
+    {
+        popped.fetch_add(count, std::memory_order_relaxed);
+        wakeProducer();
+    }
+
+    return count;
+}
+
+bool PubSubRing::pop(PubSubMessagePtr &message)
+{
+    return popUntil(message, nullptr);
+}
+
+bool PubSubRing::pop(PubSubMessagePtr &message,
+                     const boost::posix_time::time_duration &timeout)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::microseconds(timeout.total_microseconds());
+
+    return popUntil(message, &deadline);
+}
+
+void PubSubRing::close()
+{
+    isClosed.store(true, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    condition.notify_all();
+}
+
+bool PubSubRing::closed() const
+{
+    return isClosed.load(std::memory_order_acquire);
+}
+
+size_t PubSubRing::capacity() const
+{
+    return mask + 1;
+}
+
+PubSubRing::Stats PubSubRing::stats() const
+{
+    Stats result;
+
+    // tail first: head is not behind it.
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    result.pushed = head.load(std::memory_order_acquire);
+    result.popped = popped.load(std::memory_order_relaxed);
+    result.dropped = dropped.load(std::memory_order_relaxed);
+    result.blocked = blocked.load(std::memory_order_relaxed);
+    result.lag = static_cast<size_t>(result.pushed - t);
+    result.maxLag = maxLag.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+size_t PubSubRing::roundUp(size_t capacity)
+{
+    size_t size = 1;
+
+    while (size < capacity)
+        size *= 2;
+
+    return size;
+}
+
+size_t PubSubRing::claim(uint64_t &from, size_t n)
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    for(;;)
+    {
+        uint64_t available = head.load(std::memory_order_acquire) - t;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(n, available));
+
+        if (count == 0)
+            return 0;
+
+        // The producer dropping the oldest message is the other writer.
+        if (tail.compare_exchange_weak(t, t + count,
+                    std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            from = t;
+            return count;
+        }
+    }
+}
+
+void PubSubRing::release(uint64_t index)
+{
+    slots[index & mask].seq.store(index + mask + 1, std::memory_order_release);
+}
+
+bool PubSubRing::take(PubSubMessagePtr &message)
+{
+    uint64_t index;
+
+    if (claim(index, 1) == 0)
+        return false;
+
+    message = std::move(slots[index & mask].message);
+    release(index);
+    popped.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool PubSubRing::waitForRoom(uint64_t h)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    blocked.fetch_add(1, std::memory_order_relaxed);
+    producerWaiting.store(true, std::memory_order_relaxed);
+
+    // Pairs with the fence of wakeProducer(): either the consumer sees
+    // producerWaiting or the producer sees the room it made.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Wait for half of the ring, not for one slot: the threads do not
+    // wake each other for every message.
+    while (h - tail.load(std::memory_order_acquire) > mask / 2 &&
+            !isClosed.load(std::memory_order_acquire))
+        condition.wait(lock);
+
+    producerWaiting.store(false, std::memory_order_relaxed);
+
+    return !isClosed.load(std::memory_order_acquire);
+}
+
+void PubSubRing::wakeConsumer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (consumerWaiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+}
+
+void PubSubRing::wakeProducer()
+{
+    if (overflow != PubSubOverflow::Block)
+        return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (producerWaiting.load(std::memory_order_relaxed) &&
+            head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed) <= mask / 2)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+}
+
+bool PubSubRing::popUntil(PubSubMessagePtr &message,
+                          const std::chrono::steady_clock::time_point *deadline)
+{
+    bool found = take(message);
+
+    if (!found)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        consumerWaiting.store(true, std::memory_order_relaxed);
+
+        // Pairs with the fence of wakeConsumer().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (!(found = take(message)) && !isClosed.load(std::memory_order_acquire))
+        {
+            if (deadline == nullptr)
+            {
+                condition.wait(lock);
+            }
+            else if (condition.wait_until(lock, *deadline) == std::cv_status::timeout)
+            {
+                found = take(message);
+                break;
+            }
+        }
+
+        consumerWaiting.store(false, std::memory_order_relaxed);
+    }
+
+    if (found)
+        wakeProducer();
+
+    return found;
+}
+
+}
+
+#endif // REDISCLIENT_PUBSUBRING_CPP
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_PUBSUBTABLE_H
+#define REDISCLIENT_PUBSUBTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redisclient/pubsubmessage.h"
+
+namespace redisclient {
+
+struct PubSubBatch;
+
+// Subscribers by channel (or pattern), in an open addressing hash table
+// with linear probing. find() takes the channel bytes of the parsed
+// message, no std::string is built. The subscribers of a channel are an
+// immutable vector replaced on every change, so a handler called from
+// the vector returned by find() may subscribe or unsubscribe.
+class PubSubTable {
+public:
+    struct Subscriber {
+        size_t id;
+        std::shared_ptr<const PubSubHandler> handler; // shared by a bulk subscribe
+        bool singleShot;
+        std::shared_ptr<PubSubBatch> batch; // batched delivery, instead of handler
+    };
+
+    typedef std::shared_ptr<const std::vector<Subscriber>> Subscribers;
+
+    PubSubTable()
+        : slots(16), used(0), count(0)
+    {
+    }
+
+    void add(bool pattern, const std::string &name, Subscriber subscriber)
+    {
+        uint32_t h = hash(pattern, name.data(), name.size());
+        size_t index = lookup(pattern, name.data(), name.size(), h);
+        std::shared_ptr<std::vector<Subscriber>> subscribers =
+            std::make_shared<std::vector<Subscriber>>();
+
+        if (index != npos)
+        {
+            subscribers->reserve(slots[index].subscribers->size() + 1);
+            *subscribers = *slots[index].subscribers;
+            subscribers->push_back(std::move(subscriber));
+            slots[index].subscribers = std::move(subscribers);
+            return;
+        }
+
+        if ((used + 1) * 2 > slots.size())
+            rehash(count + 1);
+
+        subscribers->push_back(std::move(subscriber));
+
+        Slot &slot = slots[vacant(h)];
+
+        if (slot.state == Empty)
+            ++used;
+
+        slot.state = Full;
+        slot.hash = h;
+        slot.pattern = pattern;
+        slot.name = name;
+        slot.subscribers = std::move(subscribers);
+        ++count;
+    }
+
+    // Remove subscriber id of name. Return the number of subscribers
+    // left on name.
+    size_t remove(bool pattern, const char *name, size_t size, size_t id)
+    {
+        size_t index = lookup(pattern, name, size, hash(pattern, name, size));
+
+        if (index == npos)
+            return 0;
+
+        Slot &slot = slots[index];
+        std::shared_ptr<std::vector<Subscriber>> subscribers =
+            std::make_shared<std::vector<Subscriber>>();
+
+        subscribers->reserve(slot.subscribers->size());
+
+        for(const Subscriber &subscriber: *slot.subscribers)
+        {
+            if (subscriber.id != id)
+                subscribers->push_back(subscriber);
+        }
+
+        if (subscribers->empty())
+        {
+            slot.state = Deleted;
+            slot.name.clear();
+            slot.subscribers.reset();
+            --count;
+            return 0;
+        }
+
+        size_t left = subscribers->size();
+
+        slot.subscribers = std::move(subscribers);
+        return left;
+    }
+
+    // Subscribers of name, null if none.
+    Subscribers find(bool pattern, const char *name, size_t size) const
+    {
+        size_t index = lookup(pattern, name, size, hash(pattern, name, size));
+
+        return index == npos ? Subscribers() : slots[index].subscribers;
+    }
+
+    // Make room for names channels and patterns in all.
+    void reserve(size_t names)
+    {
+        if (names * 2 > slots.size())
+            rehash(names);
+    }
+
+    // Number of channels and patterns with subscribers.
+    size_t size() const
+    {
+        return count;
+    }
+
+    void clear()
+    {
+        std::vector<Slot>(16).swap(slots);
+        used = 0;
+        count = 0;
+    }
+
+private:
+    enum State : uint8_t {
+        Empty,
+        Full,
+        Deleted
+    };
+
+    struct Slot {
+        Slot()
+            : hash(0), state(Empty), pattern(false)
+        {
+        }
+
+        uint32_t hash;
+        State state;
+        bool pattern;
+        std::string name;
+        Subscribers subscribers;
+    };
+
+    static const size_t npos = size_t(-1);
+
+    // FNV-1a, with patterns and channels of the same name apart.
+    static uint32_t hash(bool pattern, const char *data, size_t size)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        uint32_t h = pattern ? 0x050c5d1fu : 0x811c9dc5u;
+
+        for(size_t i = 0; i < size; ++i)
+        {
+            h ^= p[i];
+            h *= 0x01000193u;
+        }
+
+        return h ^ (h >> 15);
+    }
+
+    size_t lookup(bool pattern, const char *name, size_t size, uint32_t h) const
+    {
+        size_t mask = slots.size() - 1;
+
+        for(size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = slots[i];
+
+            if (slot.state == Empty)
+                return npos;
+
+            if (slot.state == Full && slot.hash == h && slot.pattern == pattern &&
+                    slot.name.size() == size &&
+                    (size == 0 || std::memcmp(slot.name.data(), name, size) == 0))
+                return i;
+        }
+    }
+
+    // First empty or deleted slot of the probe sequence of h.
+    size_t vacant(uint32_t h) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+
+        while (slots[i].state == Full)
+            i = (i + 1) & mask;
+
+        return i;
+    }
+
+    // Drop deleted slots, doubling the table until names fill at most
+    // half of it.
+    void rehash(size_t names)
+    {
+        size_t capacity = slots.size();
+
+        while (names * 2 > capacity)
+            capacity *= 2;
+
+        std::vector<Slot> old(capacity);
+
+        old.swap(slots);
+        used = count;
+
+        for(Slot &slot: old)
+        {
+            if (slot.state == Full)
+                slots[vacant(slot.hash)] = std::move(slot);
+        }
+    }
+
+    std::vector<Slot> slots; // a power of 2
+    size_t used;  // full and deleted slots
+    size_t count; // full slots
+};
+
+}
+
+#endif // REDISCLIENT_PUBSUBTABLE_H
@@ -11,11 +11,54 @@
 
 #include "redisclient/impl/throwerror.h"
 #include "redisclient/redisasyncclient.h"
+#include "redisclient/globmatcher.h"
 
 namespace redisclient {
 
+// Local patterns of a coarse pattern. compiled is replaced on every
+// change, so a handler may add or remove local patterns while the
+// message is dispatched from the old one.
+struct RedisAsyncClient::LocalPatterns {
+    struct Entry {
+        size_t id;
+        std::string pattern;
+        PubSubHandler handler;
+    };
+
+    struct Compiled {
+        GlobMatcher matcher;        // pattern i is entries[i]
+        std::vector<Entry> entries;
+    };
+
+    std::shared_ptr<Compiled> compiled;
+    Handle server;
+
+    // The matcher cannot drop a pattern and its cache is not worth a
+    // copy, it is built again on every change.
+    static std::shared_ptr<Compiled> compile(std::vector<Entry> entries)
+    {
+        std::shared_ptr<Compiled> result = std::make_shared<Compiled>();
+
+        for(const Entry &entry: entries)
+            result->matcher.add(entry.pattern);
+
+        result->entries = std::move(entries);
+        return result;
+    }
+
+    void dispatch(const PubSubMessagePtr &message) const
+    {
+        std::shared_ptr<Compiled> current = compiled;
+        const std::vector<char> &channel = message->channel;
+
+        for(uint32_t i: current->matcher.match(channel.data(), channel.size()))
+            current->entries[i].handler(message);
+    }
+};
+
 RedisAsyncClient::RedisAsyncClient(boost::asio::io_service &ioService)
-    : pimpl(std::make_shared<RedisClientImpl>(ioService))
+    : pimpl(std::make_shared<RedisClientImpl>(ioService)),
+    commandTimeout(boost::posix_time::not_a_date_time), localPatternSeq(0)
 {
     pimpl->errorHandler = std::bind(&RedisClientImpl::defaulErrorHandler, std::placeholders::_1);
 }
@@ -37,6 +80,7 @@ void RedisAsyncClient::connect(const boost::asio::ip::tcp::endpoint &endpoint,
     if( pimpl->state == State::Unconnected || pimpl->state == State::Closed )
     {
         pimpl->state = State::Connecting;
+        pimpl->endpoint = endpoint;
         pimpl->socket.async_connect(endpoint, std::bind(&RedisClientImpl::handleAsyncConnect,
                     pimpl, std::placeholders::_1, std::move(handler)));
     }
@@ -58,6 +102,7 @@ void RedisAsyncClient::connect(const boost::asio::local::stream_protocol::endpoi
     if( pimpl->state == State::Unconnected || pimpl->state == State::Closed )
     {
         pimpl->state = State::Connecting;
+        pimpl->endpoint = endpoint;
         pimpl->socket.async_connect(endpoint, std::bind(&RedisClientImpl::handleAsyncConnect,
                     pimpl, std::placeholders::_1, std::move(handler)));
     }
@@ -81,6 +126,8 @@ bool RedisAsyncClient::isConnected() const
 
 void RedisAsyncClient::disconnect()
 {
+    // close() drops the subscriptions of the local patterns too.
+    localPatterns.clear();
     pimpl->close();
 }
 
@@ -91,13 +138,124 @@ void RedisAsyncClient::installErrorHandler(std::function<void(const std::string
 
 void RedisAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
                           std::function<void(RedisValue)> handler)
+{
+    command(cmd, std::move(args), commandTimeout, std::move(handler));
+}
+
+void RedisAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+                          const boost::posix_time::time_duration &timeout,
+                          std::function<void(RedisValue)> handler)
 {
     if(stateValid())
     {
         args.emplace_front(cmd);
 
-        pimpl->post(std::bind(&RedisClientImpl::doAsyncCommand, pimpl,
-                    pimpl->makeCommand(args), std::move(handler)));
+        RedisClientImpl::QueuedCommand command;
+
+        command.data = pimpl->makeCommand(args);
+        command.handler = std::move(handler);
+
+        pimpl->post(std::bind(&RedisClientImpl::doAsyncTimedCommand, pimpl,
+                    std::move(command), timeout));
+    }
+}
+
+void RedisAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+                          const boost::posix_time::ptime &deadline,
+                          std::function<void(RedisValue)> handler)
+{
+    if(stateValid())
+    {
+        args.emplace_front(cmd);
+
+        RedisClientImpl::QueuedCommand command;
+
+        command.data = pimpl->makeCommand(args);
+        command.handler = std::move(handler);
+        command.deadline = deadline;
+
+        pimpl->post(std::bind(&RedisClientImpl::doAsyncTimedCommand, pimpl,
+                    std::move(command), commandTimeout));
+    }
+}
+
+void RedisAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+                          const CancellationToken &token,
+                          std::function<void(RedisValue)> handler)
+{
+    command(cmd, std::move(args), boost::posix_time::ptime(), token, std::move(handler));
+}
+
+void RedisAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+                          const boost::posix_time::ptime &deadline,
+                          const CancellationToken &token,
+                          std::function<void(RedisValue)> handler)
+{
+    if(stateValid())
+    {
+        args.emplace_front(cmd);
+
+        RedisClientImpl::QueuedCommand command;
+
+        command.data = pimpl->makeCommand(args);
+        command.handler = std::move(handler);
+        command.deadline = deadline;
+        command.cancelled = token.state();
+
+        pimpl->post(std::bind(&RedisClientImpl::doAsyncTimedCommand, pimpl,
+                    std::move(command), commandTimeout));
+    }
+}
+
+size_t RedisAsyncClient::cancelledCommands() const
+{
+    return pimpl->cancelledCommands.load();
+}
+
+size_t RedisAsyncClient::cancelledBytes() const
+{
+    return pimpl->cancelledBytes.load();
+}
+
+RedisAsyncClient &RedisAsyncClient::setCommandTimeout(
+        const boost::posix_time::time_duration &timeout)
+{
+    commandTimeout = timeout;
+    return *this;
+}
+
+RedisAsyncClient &RedisAsyncClient::setConnectOptions(const ConnectOptions &options)
+{
+    pimpl->connectOptions = options;
+    return *this;
+}
+
+RedisAsyncClient &RedisAsyncClient::setAutoReconnect(
+        const boost::posix_time::time_duration &minDelay,
+        const boost::posix_time::time_duration &maxDelay)
+{
+    pimpl->autoReconnect = true;
+    pimpl->reconnectMinDelay = minDelay;
+    pimpl->reconnectMaxDelay = maxDelay;
+    return *this;
+}
+
+namespace
+{
+    // Wrap a handler taking its own copy of the payload.
+    inline PubSubHandler payloadHandler(
+            std::function<void(std::vector<char> msg)> msgHandler)
+    {
+        return [msgHandler](const PubSubMessagePtr &message) {
+            msgHandler(message->payload);
+        };
+    }
+
+    inline PubSubHandler ringHandler(std::shared_ptr<PubSubRing> ring)
+    {
+        return [ring](const PubSubMessagePtr &message) {
+            ring->push(message);
+        };
     }
 }
 
@@ -106,8 +264,7 @@ RedisAsyncClient::Handle RedisAsyncClient::subscribe(
         std::function<void(std::vector<char> msg)> msgHandler,
         std::function<void(RedisValue)> handler)
 {
-    auto handleId = pimpl->subscribe("subscribe", channel, msgHandler, handler);    
-    return { handleId , channel };
+    return subscribeShared(channel, payloadHandler(std::move(msgHandler)), std::move(handler));
 }
 
 RedisAsyncClient::Handle RedisAsyncClient::psubscribe(
@@ -115,8 +272,223 @@ RedisAsyncClient::Handle RedisAsyncClient::psubscribe(
     std::function<void(std::vector<char> msg)> msgHandler,
     std::function<void(RedisValue)> handler)
 {
-    auto handleId = pimpl->subscribe("psubscribe", pattern, msgHandler, handler);
-    return{ handleId , pattern };
+    return psubscribeShared(pattern, payloadHandler(std::move(msgHandler)), std::move(handler));
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::subscribeShared(
+        const std::string &channel,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribe("subscribe", channel, std::move(msgHandler), std::move(handler));
+    return { handleId , channel };
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::psubscribeShared(
+        const std::string &pattern,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribe("psubscribe", pattern, std::move(msgHandler), std::move(handler));
+    return { handleId , pattern };
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::subscribe(
+        const std::vector<std::string> &channels,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribe("subscribe", channels, std::move(msgHandler), std::move(handler));
+    return { handleId, channels };
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::psubscribe(
+        const std::vector<std::string> &patterns,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribe("psubscribe", patterns, std::move(msgHandler), std::move(handler));
+    return { handleId, patterns };
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::subscribeBatch(
+        const std::string &channel,
+        PubSubBatchHandler msgHandler,
+        const PubSubBatchOptions &options,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribeBatch("subscribe", std::vector<std::string>(1, channel),
+            std::move(msgHandler), options, std::move(handler));
+    return { handleId, channel };
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::psubscribeBatch(
+        const std::string &pattern,
+        PubSubBatchHandler msgHandler,
+        const PubSubBatchOptions &options,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribeBatch("psubscribe", std::vector<std::string>(1, pattern),
+            std::move(msgHandler), options, std::move(handler));
+    return { handleId, pattern };
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::subscribeBatch(
+        const std::vector<std::string> &channels,
+        PubSubBatchHandler msgHandler,
+        const PubSubBatchOptions &options,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribeBatch("subscribe", channels,
+            std::move(msgHandler), options, std::move(handler));
+    return { handleId, channels };
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::psubscribeBatch(
+        const std::vector<std::string> &patterns,
+        PubSubBatchHandler msgHandler,
+        const PubSubBatchOptions &options,
+        std::function<void(RedisValue)> handler)
+{
+    auto handleId = pimpl->subscribeBatch("psubscribe", patterns,
+            std::move(msgHandler), options, std::move(handler));
+    return { handleId, patterns };
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::subscribeRing(
+        const std::string &channel,
+        std::shared_ptr<PubSubRing> ring,
+        std::function<void(RedisValue)> handler)
+{
+    return subscribeShared(channel, ringHandler(std::move(ring)), std::move(handler));
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::psubscribeRing(
+        const std::string &pattern,
+        std::shared_ptr<PubSubRing> ring,
+        std::function<void(RedisValue)> handler)
+{
+    return psubscribeShared(pattern, ringHandler(std::move(ring)), std::move(handler));
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::subscribeRing(
+        const std::vector<std::string> &channels,
+        std::shared_ptr<PubSubRing> ring,
+        std::function<void(RedisValue)> handler)
+{
+    return subscribe(channels, ringHandler(std::move(ring)), std::move(handler));
+}
+
+RedisAsyncClient::BulkHandle RedisAsyncClient::psubscribeRing(
+        const std::vector<std::string> &patterns,
+        std::shared_ptr<PubSubRing> ring,
+        std::function<void(RedisValue)> handler)
+{
+    return psubscribe(patterns, ringHandler(std::move(ring)), std::move(handler));
+}
+
+RedisAsyncClient::Handle RedisAsyncClient::psubscribeLocal(
+        const std::string &coarse,
+        const std::string &pattern,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler)
+{
+    auto it = localPatterns.find(coarse);
+    std::shared_ptr<LocalPatterns> local;
+    std::vector<LocalPatterns::Entry> entries;
+
+    // The connection was closed (e.g. a failed handshake) since: its
+    // PSUBSCRIBE is gone, send it again.
+    if( it != localPatterns.end() && !localServerSubscribed(*it->second) )
+    {
+        localPatterns.erase(it);
+        it = localPatterns.end();
+    }
+
+    if( it == localPatterns.end() )
+    {
+        local = std::make_shared<LocalPatterns>();
+    }
+    else
+    {
+        local = it->second;
+        entries = local->compiled->entries;
+    }
+
+    LocalPatterns::Entry entry = { localPatternSeq, pattern, std::move(msgHandler) };
+
+    entries.push_back(std::move(entry));
+    local->compiled = LocalPatterns::compile(std::move(entries));
+
+    if( it == localPatterns.end() )
+    {
+        std::weak_ptr<LocalPatterns> weak = local;
+
+        local->server = psubscribeShared(coarse, [weak](const PubSubMessagePtr &message) {
+            if( std::shared_ptr<LocalPatterns> local = weak.lock() )
+                local->dispatch(message);
+        }, std::move(handler));
+
+        // Not subscribed, the error is reported by the error handler.
+        if( pimpl->state != State::Subscribed )
+            return { localPatternSeq, coarse };
+
+        localPatterns.emplace(coarse, local);
+    }
+    else
+    {
+        pimpl->post(std::bind(handler, RedisValue()));
+    }
+
+    return { localPatternSeq++, coarse };
+}
+
+void RedisAsyncClient::punsubscribeLocal(const Handle &handle)
+{
+    auto it = localPatterns.find(handle.channel);
+
+    if( it == localPatterns.end() )
+        return;
+
+    std::shared_ptr<LocalPatterns> local = it->second;
+    std::vector<LocalPatterns::Entry> entries;
+
+    for(const LocalPatterns::Entry &entry: local->compiled->entries)
+    {
+        if( entry.id != handle.id )
+            entries.push_back(entry);
+    }
+
+    if( entries.empty() )
+    {
+        localPatterns.erase(it);
+        punsubscribe(local->server);
+    }
+
+    local->compiled = LocalPatterns::compile(std::move(entries));
+}
+
+bool RedisAsyncClient::localServerSubscribed(const LocalPatterns &local) const
+{
+    PubSubTable::Subscribers subscribers = pimpl->pubSubTable.find(
+            true, local.server.channel.data(), local.server.channel.size());
+
+    if( !subscribers )
+        return false;
+
+    for(const PubSubTable::Subscriber &subscriber: *subscribers)
+    {
+        if( subscriber.id == local.server.id )
+            return true;
+    }
+
+    return false;
+}
+
+RedisAsyncClient &RedisAsyncClient::setPubSubDispatch(PubSubDispatch dispatch)
+{
+    pimpl->pubSubDispatch = dispatch;
+    return *this;
 }
 
 void RedisAsyncClient::unsubscribe(const Handle &handle)
@@ -129,18 +501,30 @@ void RedisAsyncClient::punsubscribe(const Handle &handle)
     pimpl->unsubscribe("punsubscribe", handle.id, handle.channel, dummyHandler);
 }
 
+void RedisAsyncClient::unsubscribe(const BulkHandle &handle,
+                                   std::function<void(RedisValue)> handler)
+{
+    pimpl->unsubscribe("unsubscribe", handle.id, handle.channels, std::move(handler));
+}
+
+void RedisAsyncClient::punsubscribe(const BulkHandle &handle,
+                                    std::function<void(RedisValue)> handler)
+{
+    pimpl->unsubscribe("punsubscribe", handle.id, handle.channels, std::move(handler));
+}
+
 void RedisAsyncClient::singleShotSubscribe(const std::string &channel,
                                            std::function<void(std::vector<char> msg)> msgHandler,
                                            std::function<void(RedisValue)> handler)
 {
-    pimpl->singleShotSubscribe("subscribe", channel, msgHandler, handler);
+    pimpl->singleShotSubscribe("subscribe", channel, payloadHandler(std::move(msgHandler)), handler);
 }
 
 void RedisAsyncClient::singleShotPSubscribe(const std::string &pattern,
     std::function<void(std::vector<char> msg)> msgHandler,
     std::function<void(RedisValue)> handler)
 {
-    pimpl->singleShotSubscribe("psubscribe", pattern, msgHandler, handler);
+    pimpl->singleShotSubscribe("psubscribe", pattern, payloadHandler(std::move(msgHandler)), handler);
 }
 
 void RedisAsyncClient::publish(const std::string &channel, const RedisBuffer &msg,
@@ -179,9 +563,12 @@ RedisAsyncClient::State RedisAsyncClient::state() const
 
 bool RedisAsyncClient::stateValid() const
 {
-    assert( pimpl->state == State::Connected );
+    // While reconnecting commands are queued and sent after reconnect.
+    bool reconnecting = pimpl->autoReconnect && pimpl->state == State::Connecting;
+
+    assert( pimpl->state == State::Connected || reconnecting );
 
-    if( pimpl->state != State::Connected )
+    if( pimpl->state != State::Connected && !reconnecting )
     {
         std::stringstream ss;
 
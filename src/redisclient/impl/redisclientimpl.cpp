@@ -9,6 +9,8 @@
 #include <boost/asio/write.hpp>
 
 #include <algorithm>
+#include <climits>
+#include <iterator>
 
 #include "redisclientimpl.h"
 
@@ -24,10 +26,7 @@ namespace
 
     inline void bufferAppend(std::vector<char> &vec, const redisclient::RedisBuffer &buf)
     {
-        if (buf.data.type() == typeid(std::string))
-            bufferAppend(vec, boost::get<std::string>(buf.data));
-        else
-            bufferAppend(vec, boost::get<std::vector<char>>(buf.data));
+        vec.insert(vec.end(), buf.bytes(), buf.bytes() + buf.size());
     }
 
     inline void bufferAppend(std::vector<char> &vec, const std::string &s)
@@ -57,13 +56,35 @@ namespace
         vec.insert(vec.end(), s, s + size);
     }
 
+    template<size_t size>
+    inline bool bufferEqual(const redisclient::RedisValue &value, const char (&s)[size])
+    {
+        if (!value.isByteArray())
+            return false;
+
+        const std::vector<char> &bytes = value.getByteArray();
+
+        return bytes.size() == size - 1 && std::equal(bytes.begin(), bytes.end(), s);
+    }
+
+    // Bytes of a bulk string, moved out of value.
+    inline std::vector<char> takeBytes(redisclient::RedisValue &value)
+    {
+        return value.isByteArray() ? std::move(value.getByteArray()) : std::vector<char>();
+    }
+
+    typedef redisclient::RedisClientImpl::IoStats IoStats;
+    typedef std::chrono::steady_clock::time_point Deadline;
+
     ssize_t socketReadSomeImpl(int socket, char *buffer, size_t size,
-            size_t timeoutMsec)
+            size_t timeoutMsec, IoStats &stats)
     {
         struct timeval tv = {static_cast<time_t>(timeoutMsec / 1000),
             static_cast<__suseconds_t>((timeoutMsec % 1000) * 1000)};
         int result = setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
+        ++stats.sockopts;
+
         if (result != 0)
         {
             return result;
@@ -75,8 +96,11 @@ namespace
         pfd.events = POLLIN;
 
         result = ::poll(&pfd, 1, timeoutMsec);
+        ++stats.polls;
+
         if (result > 0)
         {
+            ++stats.reads;
             return recv(socket, buffer, size, MSG_DONTWAIT);
         }
         else
@@ -87,7 +111,7 @@ namespace
 
     size_t socketReadSome(int socket, boost::asio::mutable_buffer buffer,
             const boost::posix_time::time_duration &timeout,
-            boost::system::error_code &ec)
+            boost::system::error_code &ec, IoStats &stats)
     {
         size_t bytesRecv = 0;
         size_t timeoutMsec = timeout.total_milliseconds();
@@ -96,7 +120,7 @@ namespace
         {
             ssize_t result = socketReadSomeImpl(socket,
                     boost::asio::buffer_cast<char *>(buffer) + bytesRecv,
-                    boost::asio::buffer_size(buffer) - bytesRecv, timeoutMsec);
+                    boost::asio::buffer_size(buffer) - bytesRecv, timeoutMsec, stats);
 
             if (result < 0)
             {
@@ -130,12 +154,14 @@ namespace
 
 
     ssize_t socketWriteImpl(int socket, const char *buffer, size_t size,
-            size_t timeoutMsec)
+            size_t timeoutMsec, IoStats &stats)
     {
         struct timeval tv = {static_cast<time_t>(timeoutMsec / 1000),
             static_cast<__suseconds_t>((timeoutMsec % 1000) * 1000)};
         int result = setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
+        ++stats.sockopts;
+
         if (result != 0)
         {
             return result;
@@ -147,8 +173,11 @@ namespace
         pfd.events = POLLOUT;
 
         result = ::poll(&pfd, 1, timeoutMsec);
+        ++stats.polls;
+
         if (result > 0)
         {
+            ++stats.writes;
             return send(socket, buffer, size, 0);
         }
         else
@@ -159,7 +188,7 @@ namespace
 
     size_t socketWrite(int socket, boost::asio::const_buffer buffer,
             const boost::posix_time::time_duration &timeout,
-            boost::system::error_code &ec)
+            boost::system::error_code &ec, IoStats &stats)
     {
         size_t bytesSend = 0;
         size_t timeoutMsec = timeout.total_milliseconds();
@@ -168,7 +197,7 @@ namespace
         {
             ssize_t result = socketWriteImpl(socket,
                     boost::asio::buffer_cast<const char *>(buffer) + bytesSend,
-                    boost::asio::buffer_size(buffer) - bytesSend, timeoutMsec);
+                    boost::asio::buffer_size(buffer) - bytesSend, timeoutMsec, stats);
 
             if (result < 0)
             {
@@ -201,12 +230,12 @@ namespace
 
     size_t socketWrite(int socket, const std::vector<boost::asio::const_buffer> &buffers,
             const boost::posix_time::time_duration &timeout,
-            boost::system::error_code &ec)
+            boost::system::error_code &ec, IoStats &stats)
     {
         size_t bytesSend = 0;
         for(const auto &buffer: buffers)
         {
-            bytesSend += socketWrite(socket, buffer, timeout, ec);
+            bytesSend += socketWrite(socket, buffer, timeout, ec, stats);
 
             if (ec)
                 break;
@@ -214,13 +243,269 @@ namespace
 
         return bytesSend;
     }
+
+    int remainingMsec(const Deadline &deadline)
+    {
+        Deadline now = std::chrono::steady_clock::now();
+
+        if (now >= deadline)
+            return 0;
+
+        auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - now).count() + 1;
+
+        return msec > INT_MAX ? INT_MAX : static_cast<int>(msec);
+    }
+
+    Deadline makeDeadline(const boost::posix_time::time_duration &timeout)
+    {
+        Deadline now = std::chrono::steady_clock::now();
+        auto usec = timeout.total_microseconds();
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+                Deadline::max() - now).count();
+
+        return usec >= left ? Deadline::max() : now + std::chrono::microseconds(usec);
+    }
+
+    // Wait until socket is ready for events or deadline passed.
+    // Return false and set ec on error or timeout.
+    bool socketWait(int socket, short events, const Deadline &deadline,
+            boost::system::error_code &ec, IoStats &stats)
+    {
+        for(;;)
+        {
+            pollfd pfd;
+
+            pfd.fd = socket;
+            pfd.events = events;
+
+            int result = ::poll(&pfd, 1, remainingMsec(deadline));
+            ++stats.polls;
+
+            if (result > 0)
+            {
+                return true;
+            }
+            else if (result == 0)
+            {
+                ec = boost::system::error_code(ETIMEDOUT,
+                        boost::asio::error::get_system_category());
+                return false;
+            }
+            else if (errno != EINTR)
+            {
+                ec = boost::system::error_code(errno,
+                        boost::asio::error::get_system_category());
+                return false;
+            }
+        }
+    }
+
+    // Spin on non-blocking recv() until data arrives or budget is spent.
+    // Return -1 with errno EAGAIN if nothing arrived.
+    ssize_t socketSpinRead(int socket, char *buffer, size_t size,
+            const Deadline &deadline, const std::chrono::microseconds &budget,
+            IoStats &stats)
+    {
+        Deadline stop = std::min(deadline, std::chrono::steady_clock::now() + budget);
+
+        ++stats.spins;
+
+        do
+        {
+            ssize_t result = recv(socket, buffer, size, MSG_DONTWAIT);
+
+            ++stats.reads;
+
+            if (result >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                if (result > 0)
+                    ++stats.spinHits;
+
+                return result;
+            }
+        }
+        while (std::chrono::steady_clock::now() < stop);
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Non-blocking recv() first, poll() only if there is nothing to read yet.
+    // With a spin budget, keep trying recv() for a while before poll().
+    size_t socketReadSomeOptimistic(int socket, boost::asio::mutable_buffer buffer,
+            const Deadline &deadline, const std::chrono::microseconds &spinBudget,
+            boost::system::error_code &ec, IoStats &stats)
+    {
+        // Spin at most once per read, right after the first EAGAIN.
+        bool spin = false;
+        bool spun = false;
+
+        for(;;)
+        {
+            ssize_t result;
+
+            if (spin)
+            {
+                result = socketSpinRead(socket, boost::asio::buffer_cast<char *>(buffer),
+                        boost::asio::buffer_size(buffer), deadline, spinBudget, stats);
+                spin = false;
+                spun = true;
+            }
+            else
+            {
+                result = recv(socket, boost::asio::buffer_cast<char *>(buffer),
+                        boost::asio::buffer_size(buffer), MSG_DONTWAIT);
+                ++stats.reads;
+            }
+
+            if (result > 0)
+            {
+                return result;
+            }
+            else if (result == 0)
+            {
+                ec = boost::asio::error::eof;
+                return 0;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!spun && spinBudget.count() > 0)
+                    spin = true;
+                else if (!socketWait(socket, POLLIN, deadline, ec, stats))
+                    return 0;
+            }
+            else if (errno != EINTR)
+            {
+                ec = boost::system::error_code(errno,
+                        boost::asio::error::get_system_category());
+                return 0;
+            }
+        }
+    }
+
+    // Return the part of buffers not covered by the first bytes.
+    std::vector<boost::asio::const_buffer> consumeBuffers(
+            const std::vector<boost::asio::const_buffer> &buffers, size_t bytes)
+    {
+        std::vector<boost::asio::const_buffer> rest;
+
+        for(const auto &buffer: buffers)
+        {
+            size_t size = boost::asio::buffer_size(buffer);
+
+            if (bytes >= size)
+            {
+                bytes -= size;
+            }
+            else
+            {
+                rest.push_back(buffer + bytes);
+                bytes = 0;
+            }
+        }
+
+        return rest;
+    }
+
+    // Gather all buffers into one sendmsg(), poll() only if the socket
+    // buffer is full.
+    size_t socketWriteOptimistic(int socket,
+            const std::vector<boost::asio::const_buffer> &buffers,
+            const Deadline &deadline, boost::system::error_code &ec, IoStats &stats)
+    {
+        static const size_t maxIov = 1024;
+
+        std::vector<iovec> iov;
+        size_t bytesSend = 0;
+
+        iov.reserve(std::min(buffers.size(), maxIov));
+
+        for(size_t first = 0; first < buffers.size();)
+        {
+            iov.clear();
+
+            for(size_t i = first; i < buffers.size() && iov.size() < maxIov; ++i)
+            {
+                iovec item;
+
+                item.iov_base = const_cast<char *>(
+                        boost::asio::buffer_cast<const char *>(buffers[i]));
+                item.iov_len = boost::asio::buffer_size(buffers[i]);
+                iov.push_back(item);
+            }
+
+            msghdr msg;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov.data();
+            msg.msg_iovlen = iov.size();
+
+            ssize_t result = sendmsg(socket, &msg, MSG_DONTWAIT);
+
+            ++stats.writes;
+
+            if (result < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    if (!socketWait(socket, POLLOUT, deadline, ec, stats))
+                        break;
+                }
+                else if (errno != EINTR)
+                {
+                    ec = boost::system::error_code(errno,
+                            boost::asio::error::get_system_category());
+                    break;
+                }
+
+                continue;
+            }
+
+            bytesSend += result;
+
+            // Skip written buffers, keep the partially written one.
+            size_t written = result;
+
+            while (first < buffers.size() &&
+                    written >= boost::asio::buffer_size(buffers[first]))
+            {
+                written -= boost::asio::buffer_size(buffers[first]);
+                ++first;
+            }
+
+            if (written > 0)
+            {
+                // Rare: finish the partially written buffer separately.
+                boost::asio::const_buffer rest = buffers[first] + written;
+
+                std::vector<boost::asio::const_buffer> tail(1, rest);
+
+                bytesSend += socketWriteOptimistic(socket, tail, deadline, ec, stats);
+                ++first;
+
+                if (ec)
+                    break;
+            }
+        }
+
+        return bytesSend;
+    }
 }
 
 namespace redisclient {
 
+const size_t RedisClientImpl::subscribeChunk;
+
 RedisClientImpl::RedisClientImpl(boost::asio::io_service &ioService_)
     : ioService(ioService_), strand(ioService), socket(ioService),
-    bufSize(0),subscribeSeq(0), state(State::Unconnected)
+    bufSize(0),subscribeSeq(0), ioMode(IoMode::Poll), ioStats(),
+    spinBudget(0), pubSubDispatch(PubSubDispatch::Inline),
+    timingWheel(512, boost::posix_time::milliseconds(10)), wheelTimer(ioService),
+    cancelledCommands(0), cancelledBytes(0),
+    autoReconnect(false), reconnectAttempt(0), connectionSeq(0),
+    reconnectTimer(ioService), random(std::random_device()()),
+    state(State::Unconnected)
 {
 }
 
@@ -233,9 +518,17 @@ void RedisClientImpl::close() noexcept
 {
     boost::system::error_code ignored_ec;
 
-    msgHandlers.clear();
+    pubSubTable.clear();
+    pendingBatches.clear();
+    subscriptions.clear();
     decltype(handlers)().swap(handlers);
 
+    timingWheel.clear();
+    wheelTimer.cancel(ignored_ec);
+    reconnectTimer.cancel(ignored_ec);
+
+    ioUring.close();
+
     socket.cancel(ignored_ec);
     socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
     socket.close(ignored_ec);
@@ -259,42 +552,38 @@ void RedisClientImpl::doProcessMessage(RedisValue v)
 {
     if( state == State::Subscribed )
     {
-        std::vector<RedisValue> result = v.toArray();
+        std::vector<RedisValue> empty;
+        std::vector<RedisValue> &result = v.isArray() ? v.getArray() : empty;
         auto resultSize = result.size();
 
         if( resultSize >= 3 )
         {
-            const RedisValue &command   = result[0];
-            const RedisValue &queueName = result[(resultSize == 3)?1:2];
-            const RedisValue &value     = result[(resultSize == 3)?2:3];
-            const RedisValue &pattern   = (resultSize == 4) ? result[1] : queueName;
-
-            std::string cmd = command.toString();
+            const RedisValue &command = result[0];
 
-            if( cmd == "message" || cmd == "pmessage" )
+            if( bufferEqual(command, "message") || bufferEqual(command, "pmessage") )
             {
-                SingleShotHandlersMap::iterator it = singleShotMsgHandlers.find(pattern.toString());
-                if( it != singleShotMsgHandlers.end() )
-                {
-                    strand.post(std::bind(it->second, value.toByteArray()));
-                    singleShotMsgHandlers.erase(it);
-                }
-
-                std::pair<MsgHandlersMap::iterator, MsgHandlersMap::iterator> pair =
-                        msgHandlers.equal_range(pattern.toString());
-                for(MsgHandlersMap::iterator handlerIt = pair.first;
-                    handlerIt != pair.second; ++handlerIt)
-                {
-                    strand.post(std::bind(handlerIt->second.second, value.toByteArray()));
-                }
+                dispatchMessage(result);
+                return;
             }
-            else if( handlers.empty() == false &&
+
+            std::string cmd = command.toString();
+
+            if( handlers.empty() == false &&
                     (cmd == "subscribe" || cmd == "unsubscribe" ||
                     cmd == "psubscribe" || cmd == "punsubscribe")
                    )
             {
-                handlers.front()(std::move(v));
+                // A command of many channels has a reply per channel.
+                if( handlers.front().replies > 1 )
+                {
+                    --handlers.front().replies;
+                    return;
+                }
+
+                std::function<void(RedisValue)> handler = std::move(handlers.front().handler);
+
                 handlers.pop();
+                handler(std::move(v));
             }
             else
             {
@@ -318,8 +607,11 @@ void RedisClientImpl::doProcessMessage(RedisValue v)
     {
         if( handlers.empty() == false )
         {
-            handlers.front()(std::move(v));
+            // Pop first: the handler may close the connection.
+            std::function<void(RedisValue)> handler = std::move(handlers.front().handler);
+
             handlers.pop();
+            handler(std::move(v));
         }
         else
         {
@@ -334,113 +626,608 @@ void RedisClientImpl::doProcessMessage(RedisValue v)
     }
 }
 
-void RedisClientImpl::asyncWrite(const boost::system::error_code &ec, size_t)
+void RedisClientImpl::dispatchMessage(std::vector<RedisValue> &result)
 {
-    dataWrited.clear();
+    // message, channel, payload or pmessage, pattern, channel, payload.
+    bool pattern = result.size() == 4;
+    const RedisValue &name = result[1];
 
-    if( ec )
-    {
-        errorHandler(ec.message());
+    if( !name.isByteArray() )
         return;
+
+    const std::vector<char> &bytes = name.getByteArray();
+    PubSubTable::Subscribers subscribers = pubSubTable.find(
+            pattern, bytes.data(), bytes.size());
+
+    if( !subscribers )
+        return;
+
+    std::shared_ptr<PubSubMessage> message = std::make_shared<PubSubMessage>();
+
+    if( pattern )
+    {
+        message->pattern = takeBytes(result[1]);
+        message->channel = takeBytes(result[2]);
+        message->payload = takeBytes(result[3]);
+    }
+    else
+    {
+        message->channel = takeBytes(result[1]);
+        message->payload = takeBytes(result[2]);
     }
 
-    if( dataQueued.empty() == false )
+    PubSubMessagePtr shared = std::move(message);
+    const std::vector<char> &key = pattern ? shared->pattern : shared->channel;
+    bool singleShot = false;
+
+    // subscribers stays valid if a handler changes the table.
+    for(const PubSubTable::Subscriber &subscriber: *subscribers)
     {
-        std::vector<boost::asio::const_buffer> buffers(dataQueued.size());
+        // One single shot handler per message, then it is removed.
+        if( subscriber.singleShot )
+        {
+            if( singleShot )
+                continue;
+
+            singleShot = true;
+
+            if( pubSubTable.remove(pattern, key.data(), key.size(), subscriber.id) == 0 )
+                subscriptions.erase(std::make_pair(pattern, std::string(key.begin(), key.end())));
+        }
 
-        for(size_t i = 0; i < dataQueued.size(); ++i)
+        if( subscriber.batch )
         {
-            buffers[i] = boost::asio::buffer(dataQueued[i]);
+            batchMessage(subscriber.batch, shared);
+
+            // Closed by the handler of a full batch.
+            if( state == State::Closed )
+                return;
+
+            continue;
         }
 
-        std::swap(dataQueued, dataWrited);
+        if( pubSubDispatch == PubSubDispatch::Post )
+        {
+            std::shared_ptr<const PubSubHandler> handler = subscriber.handler;
+
+            strand.post([handler, shared]() { (*handler)(shared); });
+        }
+        else
+        {
+            (*subscriber.handler)(shared);
 
-        boost::asio::async_write(socket, buffers,
-                std::bind(&RedisClientImpl::asyncWrite, shared_from_this(),
-                    std::placeholders::_1, std::placeholders::_2));
+            // Closed by the handler.
+            if( state == State::Closed )
+                return;
+        }
     }
 }
 
-void RedisClientImpl::handleAsyncConnect(const boost::system::error_code &ec,
-            std::function<void(boost::system::error_code)> handler)
+void RedisClientImpl::batchMessage(const std::shared_ptr<PubSubBatch> &batch,
+        const PubSubMessagePtr &message)
 {
-    if( !ec )
+    batch->messages.push_back(message);
+
+    if( batch->messages.size() >= batch->options.maxMessages )
     {
-        boost::system::error_code ec2; // Ignore errors in set_option
-        socket.set_option(boost::asio::ip::tcp::no_delay(true), ec2);
-        state = State::Connected;
-        handler(ec);
-        processMessage();
+        flushBatch(*batch);
     }
-    else
+    else if( batch->options.maxDelay <= boost::posix_time::time_duration() )
     {
-        state = State::Unconnected;
-        handler(ec);
+        if( !batch->pending )
+        {
+            batch->pending = true;
+            pendingBatches.push_back(batch);
+        }
+    }
+    else if( !batch->timerArmed )
+    {
+        batch->timerArmed = true;
+        batch->timer.expires_from_now(batch->options.maxDelay);
+        batch->timer.async_wait(strand.wrap(std::bind(&RedisClientImpl::batchTimeout,
+                        shared_from_this(), batch, std::placeholders::_1)));
     }
 }
 
-std::vector<char> RedisClientImpl::makeCommand(const std::deque<RedisBuffer> &items)
+void RedisClientImpl::flushBatch(PubSubBatch &batch)
 {
-    std::vector<char> result;
+    if( batch.messages.empty() )
+        return;
 
-    bufferAppend(result, '*');
-    bufferAppend(result, std::to_string(items.size()));
-    bufferAppend<>(result, crlf);
+    std::vector<PubSubMessagePtr> messages;
 
-    for(const auto &item: items)
-    {
-        bufferAppend(result, '$');
-        bufferAppend(result, std::to_string(item.size()));
-        bufferAppend<>(result, crlf);
-        bufferAppend(result, item);
-        bufferAppend<>(result, crlf);
-    }
+    messages.reserve(batch.options.maxMessages);
+    messages.swap(batch.messages);
 
-    return result;
+    if( pubSubDispatch == PubSubDispatch::Post )
+        strand.post(std::bind(batch.handler, std::move(messages)));
+    else
+        batch.handler(messages);
 }
-RedisValue RedisClientImpl::doSyncCommand(const std::deque<RedisBuffer> &command,
-        const boost::posix_time::time_duration &timeout,
-        boost::system::error_code &ec)
+
+void RedisClientImpl::flushBatches()
 {
-    std::vector<char> data = makeCommand(command);
-    socketWrite(socket.native_handle(), boost::asio::buffer(data), timeout, ec);
+    if( pendingBatches.empty() )
+        return;
 
-    if( ec )
+    std::vector<std::shared_ptr<PubSubBatch>> batches;
+
+    batches.swap(pendingBatches);
+
+    for(const std::shared_ptr<PubSubBatch> &batch: batches)
     {
-        return RedisValue();
-    }
+        batch->pending = false;
+        flushBatch(*batch);
 
-    return syncReadResponse(timeout, ec);
+        // Closed by the handler.
+        if( state == State::Closed )
+            return;
+    }
 }
 
-RedisValue RedisClientImpl::doSyncCommand(const std::deque<std::deque<RedisBuffer>> &commands,
-        const boost::posix_time::time_duration &timeout,
-        boost::system::error_code &ec)
+void RedisClientImpl::batchTimeout(const std::shared_ptr<PubSubBatch> &batch,
+        const boost::system::error_code &ec)
 {
-    std::vector<std::vector<char>> data;
-    std::vector<boost::asio::const_buffer> buffers;
+    batch->timerArmed = false;
 
-    data.reserve(commands.size());
-    buffers.reserve(commands.size());
+    if( ec || state == State::Closed )
+        return;
 
-    for(const auto &command: commands)
-    {
-        data.push_back(makeCommand(command));
-        buffers.push_back(boost::asio::buffer(data.back()));
-    }
+    flushBatch(*batch);
+}
+
+void RedisClientImpl::asyncWriteDone(size_t connection,
+        const boost::system::error_code &ec, size_t size)
+{
+    // Completion of a write on a connection which is already replaced.
+    if( connection != connectionSeq )
+        return;
 
-    socketWrite(socket.native_handle(), buffers, timeout, ec);
+    asyncWrite(ec, size);
+}
+
+void RedisClientImpl::asyncWrite(const boost::system::error_code &ec, size_t)
+{
+    dataWrited.clear();
 
     if( ec )
     {
-        return RedisValue();
+        if( !autoReconnect || ec != boost::asio::error::operation_aborted )
+            onConnectionLost(ec);
+        return;
     }
 
-    std::vector<RedisValue> responses;
+    if( state != State::Connected && state != State::Subscribed )
+    {
+        // Keep commands queued until (re)connected.
+        return;
+    }
+
+    if( dataQueued.empty() == false )
+    {
+        std::vector<boost::asio::const_buffer> buffers;
+        std::vector<std::function<void(RedisValue)>> dropped;
+        boost::posix_time::ptime now;
+
+        buffers.reserve(dataQueued.size());
+
+        for(auto &command: dataQueued)
+        {
+            bool expired = command.cancelled && command.cancelled->load();
+
+            if( !expired && !command.deadline.is_special() )
+            {
+                if( now.is_special() )
+                    now = boost::posix_time::microsec_clock::universal_time();
+
+                expired = command.deadline <= now;
+            }
+
+            if( expired )
+            {
+                ++cancelledCommands;
+                cancelledBytes += command.data.size();
+                dropped.push_back(std::move(command.handler));
+                continue;
+            }
+
+            PendingReply pending = { std::move(command.handler), command.replies };
+
+            handlers.push(std::move(pending));
+            dataWrited.push_back(std::move(command.data));
+            buffers.push_back(boost::asio::buffer(dataWrited.back()));
+        }
+
+        dataQueued.clear();
+
+        if( buffers.empty() == false )
+        {
+            boost::asio::async_write(socket, buffers,
+                    std::bind(&RedisClientImpl::asyncWriteDone, shared_from_this(),
+                        connectionSeq, std::placeholders::_1, std::placeholders::_2));
+        }
+
+        for(auto &handler: dropped)
+            handler(cancelledError());
+    }
+}
+
+void RedisClientImpl::handleAsyncConnect(const boost::system::error_code &ec,
+            std::function<void(boost::system::error_code)> handler)
+{
+    if( !ec )
+    {
+        boost::system::error_code ec2; // Ignore errors in set_option
+        socket.set_option(boost::asio::ip::tcp::no_delay(true), ec2);
+        state = State::Connected;
+
+        std::shared_ptr<RedisClientImpl> self = shared_from_this();
+
+        queueHandshake([self, handler](boost::system::error_code ec) {
+            if( ec )
+                self->close();
+
+            handler(ec);
+        });
+
+        processMessage();
+
+        // Handshake and commands issued while connecting (auto reconnect mode).
+        if( dataWrited.empty() && dataQueued.empty() == false )
+            asyncWrite(boost::system::error_code(), 0);
+    }
+    else
+    {
+        state = State::Unconnected;
+
+        // Commands issued while connecting (auto reconnect mode) have
+        // no connection to be sent on.
+        failQueued();
+        handler(ec);
+    }
+}
+
+void RedisClientImpl::failQueued()
+{
+    std::deque<QueuedCommand> queued;
+
+    queued.swap(dataQueued);
 
+    for(auto &command: queued)
+        command.handler(connectionLostError());
+}
+
+void RedisClientImpl::onConnectionLost(const boost::system::error_code &ec)
+{
+    if( !autoReconnect || state == State::Closed )
+    {
+        errorHandler(ec.message());
+        return;
+    }
+
+    if( state == State::Connecting )
+    {
+        // Already reconnecting.
+        return;
+    }
+
+    boost::system::error_code ignored_ec;
+
+    ++connectionSeq;
+    state = State::Connecting;
+
+    socket.cancel(ignored_ec);
+    socket.close(ignored_ec);
+
+    dataWrited.clear();
+    redisParser = RedisParser();
+
+    // Commands already written may or may not have been executed,
+    // so they are not replayed.
+    decltype(handlers) inFlight;
+
+    inFlight.swap(handlers);
+
+    while( inFlight.empty() == false )
+    {
+        inFlight.front().handler(connectionLostError());
+        inFlight.pop();
+    }
+
+    scheduleReconnect();
+}
+
+void RedisClientImpl::scheduleReconnect()
+{
+    // Full jitter: uniform in [min, min * 2^attempt], capped at max, so
+    // many clients losing the same server do not reconnect in lockstep.
+    int64_t minUsec = std::max<int64_t>(reconnectMinDelay.total_microseconds(), 1);
+    int64_t maxUsec = std::max(reconnectMaxDelay.total_microseconds(), minUsec);
+    int64_t ceilUsec = minUsec;
+
+    for(size_t i = 0; i < reconnectAttempt && ceilUsec < maxUsec; ++i)
+        ceilUsec *= 2;
+
+    ceilUsec = std::min(ceilUsec, maxUsec);
+
+    std::uniform_int_distribution<int64_t> distribution(minUsec, ceilUsec);
+
+    reconnectTimer.expires_from_now(boost::posix_time::microseconds(distribution(random)));
+    reconnectTimer.async_wait(strand.wrap(std::bind(&RedisClientImpl::reconnect,
+                    shared_from_this(), std::placeholders::_1)));
+}
+
+void RedisClientImpl::reconnect(const boost::system::error_code &ec)
+{
+    if( ec || state != State::Connecting )
+        return;
+
+    socket.async_connect(endpoint, strand.wrap(std::bind(&RedisClientImpl::handleReconnect,
+                    shared_from_this(), std::placeholders::_1)));
+}
+
+void RedisClientImpl::handleReconnect(const boost::system::error_code &ec)
+{
+    if( state != State::Connecting )
+        return;
+
+    if( ec )
+    {
+        boost::system::error_code ignored_ec;
+
+        socket.close(ignored_ec);
+        ++reconnectAttempt;
+        scheduleReconnect();
+        return;
+    }
+
+    boost::system::error_code ec2; // Ignore errors in set_option
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ec2);
+
+    state = State::Connected;
+
+    restoreSubscriptions();
+
+    std::shared_ptr<RedisClientImpl> self = shared_from_this();
+
+    // Goes before the restored subscriptions. Their replies, and the
+    // replies of the handshake, are read in Connected state; only then
+    // the connection is switched to Subscribed.
+    queueHandshake([self](boost::system::error_code ec) {
+        if( ec )
+        {
+            ++self->reconnectAttempt;
+            self->onConnectionLost(ec);
+        }
+        else
+        {
+            self->reconnectAttempt = 0;
+
+            if( self->subscriptions.empty() == false )
+                self->state = State::Subscribed;
+        }
+    });
+
+    processMessage();
+
+    if( dataWrited.empty() )
+        asyncWrite(boost::system::error_code(), 0);
+}
+
+void RedisClientImpl::restoreSubscriptions()
+{
+    if( subscriptions.empty() )
+        return;
+
+    std::vector<std::string> channels;
+    std::vector<std::string> patterns;
+
+    for(const auto &subscription: subscriptions)
+    {
+        if( subscription.first )
+            patterns.push_back(subscription.second);
+        else
+            channels.push_back(subscription.second);
+    }
+
+    std::vector<QueuedCommand> commands = bulkCommands("subscribe", channels,
+            [](RedisValue) {});
+    std::vector<QueuedCommand> patternCommands = bulkCommands("psubscribe", patterns,
+            [](RedisValue) {});
+
+    commands.insert(commands.end(), std::make_move_iterator(patternCommands.begin()),
+            std::make_move_iterator(patternCommands.end()));
+
+    // Must go before the replayed commands.
+    for(auto it = commands.rbegin(); it != commands.rend(); ++it)
+        dataQueued.push_front(std::move(*it));
+}
+
+std::vector<char> RedisClientImpl::makeCommand(const std::deque<RedisBuffer> &items)
+{
+    std::vector<char> result;
+    size_t size = 16;
+
+    // Room for the "$len\r\n" header and crlf of each item.
+    for(const auto &item: items)
+        size += item.size() + 16;
+
+    result.reserve(size);
+
+    bufferAppend(result, '*');
+    bufferAppend(result, std::to_string(items.size()));
+    bufferAppend<>(result, crlf);
+
+    for(const auto &item: items)
+    {
+        if (const redisclient::Key *key = boost::get<redisclient::Key>(&item.data))
+        {
+            bufferAppend(result, key->encoded());
+            continue;
+        }
+
+        bufferAppend(result, '$');
+        bufferAppend(result, std::to_string(item.size()));
+        bufferAppend<>(result, crlf);
+        bufferAppend(result, item);
+        bufferAppend<>(result, crlf);
+    }
+
+    return result;
+}
+void RedisClientImpl::queueHandshake(std::function<void(boost::system::error_code)> handler)
+{
+    struct Handshake
+    {
+        std::deque<std::deque<RedisBuffer>> commands;
+        std::vector<RedisValue> replies;
+        std::function<void(boost::system::error_code)> handler;
+    };
+
+    std::shared_ptr<Handshake> handshake = std::make_shared<Handshake>();
+
+    handshake->commands = handshakeCommands(connectOptions);
+
+    if( handshake->commands.empty() )
+    {
+        handler(boost::system::error_code());
+        return;
+    }
+
+    handshake->handler = std::move(handler);
+
+    for(auto it = handshake->commands.rbegin(); it != handshake->commands.rend(); ++it)
+    {
+        QueuedCommand command;
+
+        command.data = makeCommand(*it);
+        command.handler = [handshake](RedisValue v) {
+            handshake->replies.push_back(std::move(v));
+
+            if( handshake->replies.size() == handshake->commands.size() )
+                handshake->handler(handshakeError(handshake->commands, handshake->replies));
+        };
+
+        dataQueued.push_front(std::move(command));
+    }
+}
+
+std::deque<std::deque<RedisBuffer>> RedisClientImpl::handshakeCommands(
+        const ConnectOptions &options)
+{
+    std::deque<std::deque<RedisBuffer>> commands;
+    bool defaultUser = options.user.empty() || options.user == "default";
+
+    if( options.hello )
+    {
+        std::deque<RedisBuffer> hello{ "HELLO", "2" };
+
+        if( !options.password.empty() )
+        {
+            hello.push_back("AUTH");
+            hello.push_back(defaultUser ? std::string("default") : options.user);
+            hello.push_back(options.password);
+        }
+
+        if( !options.clientName.empty() )
+        {
+            hello.push_back("SETNAME");
+            hello.push_back(options.clientName);
+        }
+
+        commands.push_back(std::move(hello));
+    }
+    else
+    {
+        if( !options.password.empty() )
+        {
+            if( defaultUser )
+                commands.push_back({ "AUTH", options.password });
+            else
+                commands.push_back({ "AUTH", options.user, options.password });
+        }
+
+        if( !options.clientName.empty() )
+            commands.push_back({ "CLIENT", "SETNAME", options.clientName });
+    }
+
+    if( options.database != 0 )
+        commands.push_back({ "SELECT", std::to_string(options.database) });
+
+    if( options.readonly )
+        commands.push_back({ "READONLY" });
+
+    return commands;
+}
+
+boost::system::error_code RedisClientImpl::handshakeError(
+        const std::deque<std::deque<RedisBuffer>> &commands,
+        const std::vector<RedisValue> &replies)
+{
     for(size_t i = 0; i < commands.size(); ++i)
     {
-        responses.push_back(syncReadResponse(timeout, ec));
+        if( i < replies.size() && !replies[i].isError() )
+            continue;
+
+        const RedisBuffer &name = commands[i].front();
+        bool auth = boost::get<std::string>(name.data) == "AUTH" ||
+            boost::get<std::string>(name.data) == "HELLO";
+
+        return boost::system::errc::make_error_code(auth ?
+                boost::system::errc::permission_denied :
+                boost::system::errc::invalid_argument);
+    }
+
+    return boost::system::error_code();
+}
+
+RedisValue RedisClientImpl::doSyncCommand(const std::deque<RedisBuffer> &command,
+        const boost::posix_time::time_duration &timeout,
+        boost::system::error_code &ec)
+{
+    std::chrono::steady_clock::time_point deadline = makeDeadline(timeout);
+    std::vector<char> data = makeCommand(command);
+    std::vector<boost::asio::const_buffer> buffers(1, boost::asio::buffer(data));
+
+    syncWrite(buffers, timeout, deadline, ec);
+
+    if( ec )
+    {
+        return RedisValue();
+    }
+
+    return syncReadResponse(timeout, deadline, ec);
+}
+
+RedisValue RedisClientImpl::doSyncCommand(const std::deque<std::deque<RedisBuffer>> &commands,
+        const boost::posix_time::time_duration &timeout,
+        boost::system::error_code &ec)
+{
+    std::chrono::steady_clock::time_point deadline = makeDeadline(timeout);
+    std::vector<std::vector<char>> data;
+    std::vector<boost::asio::const_buffer> buffers;
+
+    data.reserve(commands.size());
+    buffers.reserve(commands.size());
+
+    for(const auto &command: commands)
+    {
+        data.push_back(makeCommand(command));
+        buffers.push_back(boost::asio::buffer(data.back()));
+    }
+
+    syncWrite(buffers, timeout, deadline, ec);
+
+    if( ec )
+    {
+        return RedisValue();
+    }
+
+    std::vector<RedisValue> responses;
+
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        responses.push_back(syncReadResponse(timeout, deadline, ec));
 
         if (ec)
         {
@@ -451,16 +1238,102 @@ RedisValue RedisClientImpl::doSyncCommand(const std::deque<std::deque<RedisBuffe
     return RedisValue(std::move(responses));
 }
 
+size_t RedisClientImpl::syncWrite(
+        const std::vector<boost::asio::const_buffer> &buffers,
+        const boost::posix_time::time_duration &timeout,
+        const std::chrono::steady_clock::time_point &deadline,
+        boost::system::error_code &ec)
+{
+    if (ioMode == IoMode::IoUring && prepareIoUring() && bufSize < buf.size())
+    {
+        // Read the reply in the same io_uring_enter() as the write,
+        // syncReadResponse() finds it in buf.
+        size_t enters = ioUring.enters;
+        size_t bytesSent = 0;
+        size_t bytesRead = 0;
+
+        ioUring.sendAndRead(socket.native_handle(), buffers,
+                buf.data() + bufSize, buf.size() - bufSize, deadline,
+                bytesSent, bytesRead, ec);
+
+        ioStats.enters += ioUring.enters - enters;
+        bufSize += bytesRead;
+
+        if (!ec && bytesRead == 0)
+        {
+            std::vector<boost::asio::const_buffer> rest = consumeBuffers(buffers, bytesSent);
+
+            if (!rest.empty())
+                bytesSent += socketWriteOptimistic(socket.native_handle(), rest,
+                        deadline, ec, ioStats);
+        }
+
+        return bytesSent;
+    }
+    else if (ioMode == IoMode::Optimistic || ioMode == IoMode::BusyPoll ||
+            ioMode == IoMode::IoUring)
+    {
+        return socketWriteOptimistic(socket.native_handle(), buffers, deadline, ec, ioStats);
+    }
+    else
+    {
+        return socketWrite(socket.native_handle(), buffers, timeout, ec, ioStats);
+    }
+}
+
+bool RedisClientImpl::prepareIoUring()
+{
+    if (!ioUring.isOpen())
+    {
+        boost::system::error_code ec;
+
+        if (!ioUring.open(buf.data(), buf.size(), ec) || !ioUring.probe(ec))
+        {
+            // Not supported, not allowed or missing an opcode (kernels
+            // before 5.6 have no RECV): use the poll path for good.
+            ioUring.close();
+            ioMode = IoMode::Poll;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+RedisValue RedisClientImpl::syncReadResponse(
+        const boost::posix_time::time_duration &timeout,
+        boost::system::error_code &ec)
+{
+    return syncReadResponse(timeout, makeDeadline(timeout), ec);
+}
+
 RedisValue RedisClientImpl::syncReadResponse(
         const boost::posix_time::time_duration &timeout,
+        const std::chrono::steady_clock::time_point &deadline,
         boost::system::error_code &ec)
 {
     for(;;)
     {
         if (bufSize == 0)
         {
-            bufSize = socketReadSome(socket.native_handle(),
-                    boost::asio::buffer(buf), timeout, ec);
+            if (ioMode == IoMode::Optimistic)
+                bufSize = socketReadSomeOptimistic(socket.native_handle(),
+                        boost::asio::buffer(buf), deadline,
+                        std::chrono::microseconds(0), ec, ioStats);
+            else if (ioMode == IoMode::BusyPoll)
+                bufSize = socketReadSomeOptimistic(socket.native_handle(),
+                        boost::asio::buffer(buf), deadline, spinBudget, ec, ioStats);
+            else if (ioMode == IoMode::IoUring && prepareIoUring())
+            {
+                size_t enters = ioUring.enters;
+
+                bufSize = ioUring.read(socket.native_handle(), buf.data(), buf.size(),
+                        deadline, ec);
+                ioStats.enters += ioUring.enters - enters;
+            }
+            else
+                bufSize = socketReadSome(socket.native_handle(),
+                        boost::asio::buffer(buf), timeout, ec, ioStats);
 
             if (ec)
                 return RedisValue();
@@ -496,8 +1369,24 @@ RedisValue RedisClientImpl::syncReadResponse(
 void RedisClientImpl::doAsyncCommand(std::vector<char> buff,
                                      std::function<void(RedisValue)> handler)
 {
-    handlers.push( std::move(handler) );
-    dataQueued.push_back(std::move(buff));
+    QueuedCommand command;
+
+    command.data = std::move(buff);
+    command.handler = std::move(handler);
+
+    enqueueCommand(std::move(command));
+}
+
+void RedisClientImpl::enqueueCommand(QueuedCommand command)
+{
+    if( state == State::Unconnected )
+    {
+        // Issued while connecting, and the connect failed.
+        command.handler(connectionLostError());
+        return;
+    }
+
+    dataQueued.push_back(std::move(command));
 
     if( dataWrited.empty() )
     {
@@ -506,13 +1395,71 @@ void RedisClientImpl::doAsyncCommand(std::vector<char> buff,
     }
 }
 
+void RedisClientImpl::doAsyncTimedCommand(QueuedCommand command,
+                                          const boost::posix_time::time_duration &timeout)
+{
+    if( timeout.is_special() || timeout <= boost::posix_time::time_duration() )
+    {
+        enqueueCommand(std::move(command));
+        return;
+    }
+
+    // Shared between the wheel and the reply queue: whoever comes first
+    // takes the handler, the other one finds it empty.
+    auto pending = std::make_shared<std::function<void(RedisValue)>>(
+            std::move(command.handler));
+
+    if( timingWheel.empty() )
+    {
+        wheelTimer.expires_from_now(timingWheel.tickDuration());
+        wheelTimer.async_wait(strand.wrap(std::bind(&RedisClientImpl::wheelTick,
+                        shared_from_this(), std::placeholders::_1)));
+    }
+
+    TimingWheel::TimerPtr timer = timingWheel.add(timeout, [pending]() {
+        std::function<void(RedisValue)> handler;
+
+        std::swap(handler, *pending);
+        handler(timeoutError());
+    });
+
+    command.handler = [pending, timer](RedisValue v) {
+        TimingWheel::cancel(timer);
+
+        if( *pending )
+        {
+            std::function<void(RedisValue)> handler;
+
+            std::swap(handler, *pending);
+            handler(std::move(v));
+        }
+    };
+
+    enqueueCommand(std::move(command));
+}
+
+void RedisClientImpl::wheelTick(const boost::system::error_code &ec)
+{
+    if( ec )
+        return;
+
+    timingWheel.tick();
+
+    if( timingWheel.empty() == false )
+    {
+        wheelTimer.expires_at(wheelTimer.expires_at() + timingWheel.tickDuration());
+        wheelTimer.async_wait(strand.wrap(std::bind(&RedisClientImpl::wheelTick,
+                        shared_from_this(), std::placeholders::_1)));
+    }
+}
+
 void RedisClientImpl::asyncRead(const boost::system::error_code &ec, const size_t size)
 {
     if( ec || size == 0 )
     {
         if (ec != boost::asio::error::operation_aborted)
         {
-            errorHandler(ec.message());
+            onConnectionLost(ec);
         }
         return;
     }
@@ -524,10 +1471,18 @@ void RedisClientImpl::asyncRead(const boost::system::error_code &ec, const size_
         if( result.second == RedisParser::Completed )
         {
             doProcessMessage(redisParser.result());
+
+            // Closed by a handler.
+            if( state == State::Closed )
+                return;
         }
         else if( result.second == RedisParser::Incompleted )
         {
-            processMessage();
+            flushBatches();
+
+            if( state != State::Closed )
+                processMessage();
+
             return;
         }
         else
@@ -539,7 +1494,10 @@ void RedisClientImpl::asyncRead(const boost::system::error_code &ec, const size_
         pos += result.first;
     }
 
-    processMessage();
+    flushBatches();
+
+    if( state != State::Closed )
+        processMessage();
 }
 
 void RedisClientImpl::onRedisError(const RedisValue &v)
@@ -552,10 +1510,31 @@ void RedisClientImpl::defaulErrorHandler(const std::string &s)
     throw std::runtime_error(s);
 }
 
+RedisValue RedisClientImpl::timeoutError()
+{
+    static const char msg[] = "[RedisClient] command timeout";
+
+    return RedisValue(std::vector<char>(msg, msg + sizeof(msg) - 1), RedisValue::ErrorTag());
+}
+
+RedisValue RedisClientImpl::cancelledError()
+{
+    static const char msg[] = "[RedisClient] command cancelled";
+
+    return RedisValue(std::vector<char>(msg, msg + sizeof(msg) - 1), RedisValue::ErrorTag());
+}
+
+RedisValue RedisClientImpl::connectionLostError()
+{
+    static const char msg[] = "[RedisClient] connection lost";
+
+    return RedisValue(std::vector<char>(msg, msg + sizeof(msg) - 1), RedisValue::ErrorTag());
+}
+
 size_t RedisClientImpl::subscribe(
     const std::string &command,
     const std::string &channel,
-    std::function<void(std::vector<char> msg)> msgHandler,
+    PubSubHandler msgHandler,
     std::function<void(RedisValue)> handler)
 {
     assert(state == State::Connected ||
@@ -564,9 +1543,84 @@ size_t RedisClientImpl::subscribe(
     if (state == State::Connected || state == State::Subscribed)
     {
         std::deque<RedisBuffer> items{ command, channel };
+        PubSubTable::Subscriber subscriber = { subscribeSeq,
+            std::make_shared<const PubSubHandler>(std::move(msgHandler)), false, nullptr };
 
         post(std::bind(&RedisClientImpl::doAsyncCommand, this, makeCommand(items), std::move(handler)));
-        msgHandlers.insert(std::make_pair(channel, std::make_pair(subscribeSeq, std::move(msgHandler))));
+        pubSubTable.add(command == "psubscribe", channel, std::move(subscriber));
+        subscriptions.insert(std::make_pair(command == "psubscribe", channel));
+        state = State::Subscribed;
+
+        return subscribeSeq++;
+    }
+    else
+    {
+        std::stringstream ss;
+
+        ss << "RedisClientImpl::subscribe called with invalid state "
+            << to_string(state);
+
+        errorHandler(ss.str());
+        return 0;
+    }
+}
+
+size_t RedisClientImpl::subscribe(
+    const std::string &command,
+    const std::vector<std::string> &channels,
+    PubSubHandler msgHandler,
+    std::function<void(RedisValue)> handler)
+{
+    PubSubTable::Subscriber subscriber = { 0,
+        std::make_shared<const PubSubHandler>(std::move(msgHandler)), false, nullptr };
+
+    return addSubscribers(command, channels, std::move(subscriber), std::move(handler));
+}
+
+size_t RedisClientImpl::subscribeBatch(
+    const std::string &command,
+    const std::vector<std::string> &channels,
+    PubSubBatchHandler msgHandler,
+    const PubSubBatchOptions &options,
+    std::function<void(RedisValue)> handler)
+{
+    PubSubTable::Subscriber subscriber = { 0, nullptr, false,
+        std::make_shared<PubSubBatch>(ioService, std::move(msgHandler), options) };
+
+    return addSubscribers(command, channels, std::move(subscriber), std::move(handler));
+}
+
+size_t RedisClientImpl::addSubscribers(
+    const std::string &command,
+    const std::vector<std::string> &channels,
+    PubSubTable::Subscriber subscriber,
+    std::function<void(RedisValue)> handler)
+{
+    assert(state == State::Connected ||
+           state == State::Subscribed);
+
+    if (state == State::Connected || state == State::Subscribed)
+    {
+        if (channels.empty())
+        {
+            post(std::bind(handler, RedisValue()));
+            return subscribeSeq++;
+        }
+
+        bool pattern = command == "psubscribe";
+
+        subscriber.id = subscribeSeq;
+        pubSubTable.reserve(pubSubTable.size() + channels.size());
+
+        for(const std::string &channel: channels)
+        {
+            pubSubTable.add(pattern, channel, subscriber);
+            subscriptions.insert(std::make_pair(pattern, channel));
+        }
+
+        for(QueuedCommand &queued: bulkCommands(command, channels, std::move(handler)))
+            post(std::bind(&RedisClientImpl::enqueueCommand, this, std::move(queued)));
+
         state = State::Subscribed;
 
         return subscribeSeq++;
@@ -586,7 +1640,7 @@ size_t RedisClientImpl::subscribe(
 void RedisClientImpl::singleShotSubscribe(
     const std::string &command,
     const std::string &channel,
-    std::function<void(std::vector<char> msg)> msgHandler,
+    PubSubHandler msgHandler,
     std::function<void(RedisValue)> handler)
 {
     assert(state == State::Connected ||
@@ -596,9 +1650,12 @@ void RedisClientImpl::singleShotSubscribe(
         state == State::Subscribed)
     {
         std::deque<RedisBuffer> items{ command, channel };
+        PubSubTable::Subscriber subscriber = { subscribeSeq++,
+            std::make_shared<const PubSubHandler>(std::move(msgHandler)), true, nullptr };
 
         post(std::bind(&RedisClientImpl::doAsyncCommand, this, makeCommand(items), std::move(handler)));
-        singleShotMsgHandlers.insert(std::make_pair(channel, std::move(msgHandler)));
+        pubSubTable.add(command == "psubscribe", channel, std::move(subscriber));
+        subscriptions.insert(std::make_pair(command == "psubscribe", channel));
         state = State::Subscribed;
     }
     else
@@ -628,21 +1685,11 @@ void RedisClientImpl::unsubscribe(const std::string &command,
     if (state == State::Connected ||
         state == State::Subscribed)
     {
-        // Remove subscribe-handler
-        typedef RedisClientImpl::MsgHandlersMap::iterator iterator;
-        std::pair<iterator, iterator> pair = msgHandlers.equal_range(channel);
+        bool pattern = command == "punsubscribe";
 
-        for (iterator it = pair.first; it != pair.second;)
-        {
-            if (it->second.first == handleId)
-            {
-                msgHandlers.erase(it++);
-            }
-            else
-            {
-                ++it;
-            }
-        }
+        // Remove subscribe-handler
+        if (pubSubTable.remove(pattern, channel.data(), channel.size(), handleId) == 0)
+            subscriptions.erase(std::make_pair(pattern, channel));
 
         std::deque<RedisBuffer> items{ command, channel };
 
@@ -669,6 +1716,101 @@ void RedisClientImpl::unsubscribe(const std::string &command,
 #endif
 }
 
+void RedisClientImpl::unsubscribe(const std::string &command,
+                                  size_t handleId,
+                                  const std::vector<std::string> &channels,
+                                  std::function<void(RedisValue)> handler)
+{
+    assert(state == State::Connected ||
+           state == State::Subscribed);
+
+    if (state == State::Connected ||
+        state == State::Subscribed)
+    {
+        bool pattern = command == "punsubscribe";
+        std::vector<std::string> unused;
+
+        for(const std::string &channel: channels)
+        {
+            if (pubSubTable.remove(pattern, channel.data(), channel.size(), handleId) == 0 &&
+                    subscriptions.erase(std::make_pair(pattern, channel)) != 0)
+                unused.push_back(channel);
+        }
+
+        if (unused.empty())
+        {
+            post(std::bind(handler, RedisValue()));
+            return;
+        }
+
+        for(QueuedCommand &queued: bulkCommands(command, unused, std::move(handler)))
+            post(std::bind(&RedisClientImpl::enqueueCommand, this, std::move(queued)));
+    }
+    else
+    {
+        std::stringstream ss;
+
+        ss << "RedisClientImpl::unsubscribe called with invalid state "
+            << to_string(state);
+
+        errorHandler(ss.str());
+    }
+}
+
+std::vector<RedisClientImpl::QueuedCommand> RedisClientImpl::bulkCommands(
+        const std::string &command,
+        const std::vector<std::string> &channels,
+        std::function<void(RedisValue)> handler)
+{
+    struct Bulk {
+        size_t commandsLeft;
+        std::function<void(RedisValue)> handler;
+    };
+
+    size_t count = (channels.size() + subscribeChunk - 1) / subscribeChunk;
+    std::vector<QueuedCommand> commands(count);
+    std::shared_ptr<Bulk> bulk;
+
+    if (count > 1)
+    {
+        bulk = std::make_shared<Bulk>();
+        bulk->commandsLeft = count;
+        bulk->handler = std::move(handler);
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        size_t first = i * subscribeChunk;
+        size_t last = std::min(first + subscribeChunk, channels.size());
+        std::deque<RedisBuffer> items{ command };
+
+        items.insert(items.end(), channels.begin() + first, channels.begin() + last);
+        commands[i].data = makeCommand(items);
+        commands[i].replies = last - first;
+
+        if (!bulk)
+        {
+            commands[i].handler = std::move(handler);
+            continue;
+        }
+
+        commands[i].handler = [bulk](RedisValue v) {
+            if (!bulk->handler)
+                return;
+
+            if (v.isError() || --bulk->commandsLeft == 0)
+            {
+                std::function<void(RedisValue)> handler;
+
+                std::swap(handler, bulk->handler);
+                handler(std::move(v));
+            }
+        };
+    }
+
+    return commands;
+}
+
 }
 
 #endif // REDISCLIENT_REDISCLIENTIMPL_CPP
@@ -13,17 +13,29 @@
 #include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/deadline_timer.hpp>
 
 #include <string>
 #include <vector>
 #include <queue>
 #include <map>
+#include <set>
 #include <functional>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <random>
 
+#include "redisclient/cancellationtoken.h"
 #include "redisclient/redisparser.h"
 #include "redisclient/redisbuffer.h"
 #include "redisclient/config.h"
+#include "redisclient/connectoptions.h"
+#include "redisclient/pubsubmessage.h"
+#include "redisclient/impl/pubsubbatch.h"
+#include "redisclient/impl/pubsubtable.h"
+#include "redisclient/impl/timingwheel.h"
+#include "redisclient/impl/iouring.h"
 
 namespace redisclient {
 
@@ -37,6 +49,55 @@ public:
         Closed
     };
 
+    // I/O strategy of the sync client.
+    enum class IoMode {
+        // poll() before every recv()/send(), timeout restarts on each call.
+        Poll,
+        // Non-blocking recv()/send() first, poll() only on EAGAIN;
+        // one deadline covers the whole command or pipeline.
+        Optimistic,
+        // Like Optimistic, but spin on non-blocking recv() for spinBudget
+        // before blocking in poll(). Trades CPU for wakeup latency.
+        BusyPoll,
+        // Write and read the reply with one io_uring_enter(). Falls back
+        // to Poll if io_uring is not available.
+        IoUring
+    };
+
+    // Syscall counters of the sync client.
+    struct IoStats {
+        size_t polls;
+        size_t reads;
+        size_t writes;
+        size_t sockopts;
+        // BusyPoll: reads that had to spin, and how many of them got
+        // data before the budget ran out.
+        size_t spins;
+        size_t spinHits;
+        // IoUring: io_uring_enter() calls.
+        size_t enters;
+    };
+
+    // Command waiting in dataQueued. Its handler is moved to `handlers`
+    // when the command is written; until then it may be dropped.
+    struct QueuedCommand {
+        std::vector<char> data;
+        std::function<void(RedisValue)> handler;
+        boost::posix_time::ptime deadline;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        // One per channel of a (p)(un)subscribe; handler gets the last.
+        size_t replies = 1;
+    };
+
+    // Handler of a written command, waiting for its replies.
+    struct PendingReply {
+        std::function<void(RedisValue)> handler;
+        size_t replies;
+    };
+
+    // Channels per command of a bulk (p)(un)subscribe.
+    static const size_t subscribeChunk = 1024;
+
     REDIS_CLIENT_DECL RedisClientImpl(boost::asio::io_service &ioService);
     REDIS_CLIENT_DECL ~RedisClientImpl();
 
@@ -44,20 +105,77 @@ public:
             const boost::system::error_code &ec,
             std::function<void(boost::system::error_code)> handler);
 
+    // Auto reconnect. On a broken connection the commands waiting for a
+    // reply fail with connectionLostError(), the client reconnects with
+    // jittered exponential backoff, restores the subscriptions and sends
+    // the commands which were still queued.
+    REDIS_CLIENT_DECL void onConnectionLost(const boost::system::error_code &ec);
+    REDIS_CLIENT_DECL void scheduleReconnect();
+    REDIS_CLIENT_DECL void reconnect(const boost::system::error_code &ec);
+    REDIS_CLIENT_DECL void handleReconnect(const boost::system::error_code &ec);
+    REDIS_CLIENT_DECL void restoreSubscriptions();
+    // Fail the commands of dataQueued with connectionLostError().
+    REDIS_CLIENT_DECL void failQueued();
+
+    // Handshake of connectOptions. queueHandshake() puts the setup
+    // commands in front of dataQueued and calls handler once all
+    // replies arrived.
+    REDIS_CLIENT_DECL void queueHandshake(
+            std::function<void(boost::system::error_code)> handler);
+    REDIS_CLIENT_DECL static std::deque<std::deque<RedisBuffer>> handshakeCommands(
+            const ConnectOptions &options);
+    REDIS_CLIENT_DECL static boost::system::error_code handshakeError(
+            const std::deque<std::deque<RedisBuffer>> &commands,
+            const std::vector<RedisValue> &replies);
+
     REDIS_CLIENT_DECL size_t subscribe(const std::string &command,
         const std::string &channel,
-        std::function<void(std::vector<char> msg)> msgHandler,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler);
+
+    // Subscribe to all channels with one handler id and msgHandler,
+    // subscribeChunk channels per command. handler is called once.
+    REDIS_CLIENT_DECL size_t subscribe(const std::string &command,
+        const std::vector<std::string> &channels,
+        PubSubHandler msgHandler,
+        std::function<void(RedisValue)> handler);
+
+    // Subscribe to all channels with one handler id and one batch of
+    // messages for all of them, see PubSubBatchOptions.
+    REDIS_CLIENT_DECL size_t subscribeBatch(const std::string &command,
+        const std::vector<std::string> &channels,
+        PubSubBatchHandler msgHandler,
+        const PubSubBatchOptions &options,
+        std::function<void(RedisValue)> handler);
+
+    REDIS_CLIENT_DECL size_t addSubscribers(const std::string &command,
+        const std::vector<std::string> &channels,
+        PubSubTable::Subscriber subscriber,
         std::function<void(RedisValue)> handler);
 
     REDIS_CLIENT_DECL void singleShotSubscribe(const std::string &command,
         const std::string &channel,
-        std::function<void(std::vector<char> msg)> msgHandler,
+        PubSubHandler msgHandler,
         std::function<void(RedisValue)> handler);
 
     REDIS_CLIENT_DECL void unsubscribe(const std::string &command,
         size_t handle_id, const std::string &channel,
         std::function<void(RedisValue)> handler);
 
+    // Remove handle id from all channels. Only channels left without
+    // handlers are unsubscribed from, subscribeChunk per command.
+    REDIS_CLIENT_DECL void unsubscribe(const std::string &command,
+        size_t handleId, const std::vector<std::string> &channels,
+        std::function<void(RedisValue)> handler);
+
+    // Commands of command for channels, subscribeChunk channels each,
+    // sharing handler: it is called once, with the last reply or the
+    // first error.
+    REDIS_CLIENT_DECL static std::vector<QueuedCommand> bulkCommands(
+        const std::string &command,
+        const std::vector<std::string> &channels,
+        std::function<void(RedisValue)> handler);
+
     REDIS_CLIENT_DECL void close() noexcept;
 
     REDIS_CLIENT_DECL State getState() const;
@@ -73,19 +191,53 @@ public:
     REDIS_CLIENT_DECL RedisValue syncReadResponse(
             const boost::posix_time::time_duration &timeout,
             boost::system::error_code &ec);
+    REDIS_CLIENT_DECL RedisValue syncReadResponse(
+            const boost::posix_time::time_duration &timeout,
+            const std::chrono::steady_clock::time_point &deadline,
+            boost::system::error_code &ec);
+    REDIS_CLIENT_DECL size_t syncWrite(
+            const std::vector<boost::asio::const_buffer> &buffers,
+            const boost::posix_time::time_duration &timeout,
+            const std::chrono::steady_clock::time_point &deadline,
+            boost::system::error_code &ec);
+    REDIS_CLIENT_DECL bool prepareIoUring();
 
     REDIS_CLIENT_DECL void doAsyncCommand(
             std::vector<char> buff,
             std::function<void(RedisValue)> handler);
 
+    // Like doAsyncCommand, but handler is called with timeoutError() if the
+    // reply does not arrive in time. A late reply is read and dropped.
+    // The command is dropped with cancelledError() if its deadline passes
+    // or it is cancelled before it is written.
+    REDIS_CLIENT_DECL void doAsyncTimedCommand(
+            QueuedCommand command,
+            const boost::posix_time::time_duration &timeout);
+
+    REDIS_CLIENT_DECL void enqueueCommand(QueuedCommand command);
+
     REDIS_CLIENT_DECL void sendNextCommand();
     REDIS_CLIENT_DECL void processMessage();
     REDIS_CLIENT_DECL void doProcessMessage(RedisValue v);
+    REDIS_CLIENT_DECL void dispatchMessage(std::vector<RedisValue> &message);
+    REDIS_CLIENT_DECL void batchMessage(const std::shared_ptr<PubSubBatch> &batch,
+            const PubSubMessagePtr &message);
+    REDIS_CLIENT_DECL void flushBatch(PubSubBatch &batch);
+    // Deliver the batches of the messages parsed from the last read.
+    REDIS_CLIENT_DECL void flushBatches();
+    REDIS_CLIENT_DECL void batchTimeout(const std::shared_ptr<PubSubBatch> &batch,
+            const boost::system::error_code &ec);
     REDIS_CLIENT_DECL void asyncWrite(const boost::system::error_code &ec, const size_t);
+    REDIS_CLIENT_DECL void asyncWriteDone(size_t connection,
+            const boost::system::error_code &ec, const size_t);
     REDIS_CLIENT_DECL void asyncRead(const boost::system::error_code &ec, const size_t);
+    REDIS_CLIENT_DECL void wheelTick(const boost::system::error_code &ec);
 
     REDIS_CLIENT_DECL void onRedisError(const RedisValue &);
     REDIS_CLIENT_DECL static void defaulErrorHandler(const std::string &s);
+    REDIS_CLIENT_DECL static RedisValue timeoutError();
+    REDIS_CLIENT_DECL static RedisValue cancelledError();
+    REDIS_CLIENT_DECL static RedisValue connectionLostError();
 
     template<typename Handler>
     inline void post(const Handler &handler);
@@ -97,18 +249,39 @@ public:
     boost::array<char, 4096> buf;
     size_t bufSize; // only for sync
     size_t subscribeSeq;
+    IoMode ioMode; // only for sync
+    IoStats ioStats; // only for sync
+    std::chrono::microseconds spinBudget; // only for sync
+    IoUring ioUring; // only for sync
 
-    typedef std::pair<size_t, std::function<void(const std::vector<char> &buf)> > MsgHandlerType;
-    typedef std::function<void(const std::vector<char> &buf)> SingleShotHandlerType;
+    std::queue<PendingReply> handlers;
+    std::deque<std::vector<char>> dataWrited;
+    std::deque<QueuedCommand> dataQueued;
+    PubSubTable pubSubTable;
+    PubSubDispatch pubSubDispatch;
+    // Batches without maxDelay holding messages of the current read.
+    std::vector<std::shared_ptr<PubSubBatch>> pendingBatches;
+    // (pattern, channel) of psubscribe/subscribe, to restore after reconnect
+    std::set<std::pair<bool, std::string>> subscriptions;
 
-    typedef std::multimap<std::string, MsgHandlerType> MsgHandlersMap;
-    typedef std::multimap<std::string, SingleShotHandlerType> SingleShotHandlersMap;
+    // One timing wheel per connection drives all command timeouts.
+    TimingWheel timingWheel;
+    boost::asio::deadline_timer wheelTimer;
 
-    std::queue<std::function<void(RedisValue)> > handlers;
-    std::deque<std::vector<char>> dataWrited;
-    std::deque<std::vector<char>> dataQueued;
-    MsgHandlersMap msgHandlers;
-    SingleShotHandlersMap singleShotMsgHandlers;
+    // Commands dropped from dataQueued before being sent.
+    std::atomic<size_t> cancelledCommands;
+    std::atomic<size_t> cancelledBytes;
+
+    ConnectOptions connectOptions;
+
+    boost::asio::generic::stream_protocol::endpoint endpoint;
+    bool autoReconnect;
+    boost::posix_time::time_duration reconnectMinDelay;
+    boost::posix_time::time_duration reconnectMaxDelay;
+    size_t reconnectAttempt;
+    size_t connectionSeq; // bumped on every lost connection
+    boost::asio::deadline_timer reconnectTimer;
+    std::mt19937 random;
 
     std::function<void(const std::string &)> errorHandler;
     State state;
@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REDISCLUSTERCLIENT_CPP
+#define REDISCLIENT_REDISCLUSTERCLIENT_CPP
+
+#include <boost/asio/error.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "redisclient/redisclusterclient.h"
+
+namespace redisclient {
+
+const uint16_t RedisClusterClient::noNode;
+
+RedisClusterClient::RedisClusterClient(boost::asio::io_service &ioService_,
+        std::function<void(RedisAsyncClient &)> configure_)
+    : ioService(ioService_), configure(std::move(configure_)),
+    slots(clusterSlotCount, noNode),
+    refreshInterval(std::chrono::seconds(1)), refreshing(false), maxRedirects(5)
+{
+}
+
+RedisClusterClient::~RedisClusterClient()
+{
+    disconnect();
+}
+
+void RedisClusterClient::connect(const std::vector<boost::asio::ip::tcp::endpoint> &seeds_,
+        std::function<void(boost::system::error_code)> handler)
+{
+    seeds = seeds_;
+    connectSeed(0, std::move(handler));
+}
+
+void RedisClusterClient::disconnect()
+{
+    // Closing a client drops its reply handlers, which hold the nodes.
+    for(NodeEntry &entry: nodes)
+    {
+        if (entry.node)
+            entry.node->client.disconnect();
+    }
+
+    for(auto &node: retired)
+        node->client.disconnect();
+
+    std::fill(slots.begin(), slots.end(), noNode);
+    nodes.clear();
+    nodeIndex.clear();
+    retired.clear();
+    refreshing = false;
+}
+
+void RedisClusterClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    uint16_t slot = args.empty() ? noNode : bufferSlot(args.front());
+
+    command(slot, cmd, std::move(args), std::move(handler));
+}
+
+void RedisClusterClient::command(uint16_t slot,
+        const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    uint16_t index = route(slot);
+
+    if (index == noNode)
+    {
+        handler(clusterError("[RedisClusterClient] no cluster node known"));
+        return;
+    }
+
+    std::shared_ptr<Request> request = std::make_shared<Request>();
+
+    request->cmd = cmd;
+    request->args = std::move(args);
+    request->handler = std::move(handler);
+    request->redirects = 0;
+
+    send(index, std::move(request), false);
+}
+
+void RedisClusterClient::pipelined(std::deque<std::deque<RedisBuffer>> commands,
+        std::function<void(RedisValue)> handler)
+{
+    struct Batch
+    {
+        std::vector<RedisValue> replies;
+        size_t left;
+        std::function<void(RedisValue)> handler;
+    };
+
+    if (commands.empty())
+    {
+        handler(RedisValue(std::vector<RedisValue>()));
+        return;
+    }
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+
+    batch->replies.resize(commands.size());
+    batch->left = commands.size();
+    batch->handler = std::move(handler);
+
+    // Split by node, keeping the order of the commands of each node.
+    std::vector<uint16_t> target(commands.size());
+    std::vector<size_t> count(nodes.size() + 1, 0);
+
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        const std::deque<RedisBuffer> &command = commands[i];
+
+        target[i] = route(command.size() > 1 ? bufferSlot(command[1]) : noNode);
+    }
+
+    std::vector<bool> inBlock = ScatterGather::keepTransactions(commands, target);
+
+    for(size_t i = 0; i < commands.size(); ++i)
+        ++count[target[i] == noNode ? nodes.size() : target[i]];
+
+    std::vector<size_t> offset(count.size(), 0);
+    std::vector<size_t> order(commands.size());
+
+    for(size_t i = 1; i < count.size(); ++i)
+        offset[i] = offset[i - 1] + count[i - 1];
+
+    for(size_t i = 0; i < commands.size(); ++i)
+        order[offset[target[i] == noNode ? nodes.size() : target[i]]++] = i;
+
+    for(size_t i: order)
+    {
+        std::function<void(RedisValue)> reply = [batch, i](RedisValue value) {
+            batch->replies[i] = std::move(value);
+
+            if (--batch->left == 0)
+                batch->handler(RedisValue(std::move(batch->replies)));
+        };
+
+        if (target[i] == noNode || commands[i].empty())
+        {
+            reply(clusterError("[RedisClusterClient] no cluster node known"));
+            continue;
+        }
+
+        std::shared_ptr<Request> request = std::make_shared<Request>();
+
+        request->cmd = bufferString(commands[i].front());
+        commands[i].pop_front();
+        request->args = std::move(commands[i]);
+        request->handler = std::move(reply);
+        // A redirected command would run outside of its transaction.
+        request->redirects = inBlock[i] ? maxRedirects : 0;
+
+        send(target[i], std::move(request), false);
+    }
+}
+
+void RedisClusterClient::mget(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("MGET", ScatterGather::Values, keys, nullptr, std::move(handler));
+}
+
+void RedisClusterClient::mset(const std::vector<std::pair<std::string, RedisBuffer>> &items,
+        std::function<void(RedisValue)> handler)
+{
+    std::vector<std::string> keys;
+    std::vector<RedisBuffer> values;
+
+    keys.reserve(items.size());
+    values.reserve(items.size());
+
+    for(const auto &item: items)
+    {
+        keys.push_back(item.first);
+        values.push_back(item.second);
+    }
+
+    scatter("MSET", ScatterGather::Status, keys, &values, std::move(handler));
+}
+
+void RedisClusterClient::del(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("DEL", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void RedisClusterClient::unlink(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("UNLINK", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void RedisClusterClient::exists(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("EXISTS", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void RedisClusterClient::touch(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("TOUCH", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void RedisClusterClient::refreshSlots()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    if (refreshing || (lastRefresh != std::chrono::steady_clock::time_point() &&
+                now - lastRefresh < refreshInterval))
+        return;
+
+    uint16_t index = anyNode();
+
+    if (index == noNode)
+        return;
+
+    refreshing = true;
+    lastRefresh = now;
+
+    loadSlots(index, [this](bool) {
+        refreshing = false;
+    });
+}
+
+RedisClusterClient &RedisClusterClient::setRefreshInterval(
+        const boost::posix_time::time_duration &interval)
+{
+    refreshInterval = std::chrono::microseconds(interval.total_microseconds());
+    return *this;
+}
+
+RedisClusterClient &RedisClusterClient::setMaxRedirects(size_t redirects)
+{
+    maxRedirects = redirects;
+    return *this;
+}
+
+std::string RedisClusterClient::slotNode(uint16_t slot) const
+{
+    if (slot >= clusterSlotCount || slots[slot] == noNode)
+        return std::string();
+
+    return nodes[slots[slot]].address;
+}
+
+RedisValue RedisClusterClient::clusterError(const std::string &message)
+{
+    return RedisValue(std::vector<char>(message.begin(), message.end()), RedisValue::ErrorTag());
+}
+
+uint16_t RedisClusterClient::bufferSlot(const RedisBuffer &key)
+{
+    if (const Key *prehashed = boost::get<Key>(&key.data))
+        return prehashed->slot();
+
+    return keySlot(key.bytes(), key.size());
+}
+
+std::string RedisClusterClient::bufferString(const RedisBuffer &buffer)
+{
+    return std::string(buffer.bytes(), buffer.size());
+}
+
+uint16_t RedisClusterClient::route(uint16_t slot) const
+{
+    uint16_t index = slot < clusterSlotCount ? slots[slot] : noNode;
+
+    return index == noNode ? anyNode() : index;
+}
+
+void RedisClusterClient::scatter(const std::string &cmd, ScatterGather::Merge merge,
+        const std::vector<std::string> &keys, const std::vector<RedisBuffer> *values,
+        std::function<void(RedisValue)> handler)
+{
+    // Multi-key commands need all keys in one slot, even on one node.
+    std::vector<ScatterGather::Group> groups = ScatterGather::split(keys.size(),
+            [&keys](size_t i) { return keySlot(keys[i]); });
+    ScatterGather gather(keys.size(), groups.size(), merge, std::move(handler));
+
+    for(ScatterGather::Group &group: groups)
+    {
+        std::deque<RedisBuffer> args;
+        uint16_t slot = static_cast<uint16_t>(group.shard);
+
+        for(uint32_t position: group.positions)
+        {
+            args.emplace_back(keys[position]);
+
+            if (values)
+                args.push_back((*values)[position]);
+        }
+
+        command(slot, cmd, std::move(args), gather.gather(std::move(group)));
+    }
+}
+
+uint16_t RedisClusterClient::addNode(const std::string &address)
+{
+    auto it = nodeIndex.find(address);
+
+    if (it != nodeIndex.end())
+        return it->second;
+
+    if (nodes.size() >= noNode)
+        return noNode;
+
+    NodeEntry entry;
+
+    entry.address = address;
+    nodes.push_back(std::move(entry));
+    nodeIndex[address] = static_cast<uint16_t>(nodes.size() - 1);
+
+    return static_cast<uint16_t>(nodes.size() - 1);
+}
+
+uint16_t RedisClusterClient::anyNode() const
+{
+    // Prefer a node already connected.
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].node && nodes[i].node->connected)
+            return static_cast<uint16_t>(i);
+    }
+
+    return nodes.empty() ? noNode : 0;
+}
+
+std::shared_ptr<RedisClusterClient::Node> RedisClusterClient::connection(uint16_t index)
+{
+    NodeEntry &entry = nodes[index];
+
+    if (entry.node)
+        return entry.node;
+
+    // "ip:port", the ip may be IPv6.
+    size_t colon = entry.address.rfind(':');
+    boost::system::error_code ec;
+
+    if (colon == std::string::npos)
+        return nullptr;
+
+    boost::asio::ip::address ip = boost::asio::ip::address::from_string(
+            entry.address.substr(0, colon), ec);
+    int port = std::atoi(entry.address.c_str() + colon + 1);
+
+    if (ec || port <= 0 || port > 65535)
+        return nullptr;
+
+    std::shared_ptr<Node> node = std::make_shared<Node>(ioService);
+
+    node->address = entry.address;
+
+    // Commands lost with a connection fail; queued ones are resent.
+    node->client.setAutoReconnect(boost::posix_time::milliseconds(100),
+            boost::posix_time::seconds(10));
+
+    if (configure)
+        configure(node->client);
+
+    entry.node = node;
+
+    std::weak_ptr<Node> weakNode = node;
+
+    node->client.connect(boost::asio::ip::tcp::endpoint(ip, static_cast<unsigned short>(port)),
+            [this, index, weakNode](boost::system::error_code ec) {
+                handleConnect(index, weakNode, ec);
+            });
+
+    return node;
+}
+
+void RedisClusterClient::handleConnect(uint16_t index, std::weak_ptr<Node> weakNode,
+        boost::system::error_code ec)
+{
+    // Expired if disconnect() was called meanwhile.
+    std::shared_ptr<Node> node = weakNode.lock();
+
+    if (!node)
+        return;
+
+    std::vector<std::pair<std::shared_ptr<Request>, bool>> waiting;
+
+    waiting.swap(node->waiting);
+
+    if (!ec)
+    {
+        node->connected = true;
+
+        for(auto &item: waiting)
+            issue(node, std::move(item.first), item.second);
+
+        return;
+    }
+
+    // Forget the node, the next command for it connects again.
+    if (index < nodes.size() && nodes[index].node == node)
+        nodes[index].node.reset();
+
+    for(auto &item: waiting)
+        item.first->handler(clusterError("[RedisClusterClient] can't connect to " +
+                    node->address + ": " + ec.message()));
+
+    refreshSlots();
+}
+
+void RedisClusterClient::send(uint16_t index, std::shared_ptr<Request> request, bool asking)
+{
+    std::shared_ptr<Node> node = connection(index);
+
+    if (!node)
+        request->handler(clusterError("[RedisClusterClient] bad node address " +
+                    nodes[index].address));
+    else if (!node->connected)
+        node->waiting.emplace_back(std::move(request), asking);
+    else
+        issue(node, std::move(request), asking);
+}
+
+void RedisClusterClient::issue(const std::shared_ptr<Node> &node,
+        std::shared_ptr<Request> request, bool asking)
+{
+    std::weak_ptr<Node> weakNode = node;
+
+    if (asking)
+        node->client.command("ASKING", {});
+
+    ++node->pending;
+    node->client.command(request->cmd, request->args,
+            [this, weakNode, request](RedisValue value) {
+                std::shared_ptr<Node> node = weakNode.lock();
+
+                if (node)
+                    handleReply(node, request, std::move(value));
+            });
+}
+
+void RedisClusterClient::handleReply(const std::shared_ptr<Node> &node,
+        const std::shared_ptr<Request> &request, RedisValue value)
+{
+    --node->pending;
+
+    if (node->pending == 0 && node->waiting.empty())
+    {
+        auto it = std::find(retired.begin(), retired.end(), node);
+
+        if (it != retired.end())
+        {
+            node->client.disconnect();
+            retired.erase(it);
+        }
+    }
+
+    if (value.isError())
+    {
+        std::string message = value.toString();
+
+        if (redirect(request, message))
+            return;
+
+        // E.g. the node failed, its slots may have moved.
+        if (!node->client.isConnected())
+            refreshSlots();
+    }
+
+    request->handler(std::move(value));
+}
+
+bool RedisClusterClient::redirect(const std::shared_ptr<Request> &request,
+        const std::string &message)
+{
+    // "MOVED <slot> <ip>:<port>" or "ASK <slot> <ip>:<port>"
+    bool moved = message.compare(0, 6, "MOVED ") == 0;
+    bool ask = message.compare(0, 4, "ASK ") == 0;
+
+    if ((!moved && !ask) || request->redirects >= maxRedirects)
+        return false;
+
+    size_t slotPos = moved ? 6 : 4;
+    size_t space = message.find(' ', slotPos);
+
+    if (space == std::string::npos)
+        return false;
+
+    long slot = std::atol(message.c_str() + slotPos);
+    uint16_t index = addNode(message.substr(space + 1));
+
+    if (slot < 0 || slot >= static_cast<long>(clusterSlotCount) || index == noNode)
+        return false;
+
+    ++request->redirects;
+
+    if (moved)
+    {
+        slots[slot] = index;
+        refreshSlots();
+    }
+
+    send(index, request, ask);
+    return true;
+}
+
+void RedisClusterClient::loadSlots(uint16_t index, std::function<void(bool)> done)
+{
+    std::shared_ptr<Request> request = std::make_shared<Request>();
+    std::string address = nodes[index].address;
+
+    request->cmd = "CLUSTER";
+    request->args = { "SLOTS" };
+    request->redirects = maxRedirects; // not redirected
+    request->handler = [this, address, done](RedisValue value) {
+        done(!value.isError() && applySlots(value, address));
+    };
+
+    send(index, std::move(request), false);
+}
+
+bool RedisClusterClient::applySlots(const RedisValue &reply, const std::string &queried)
+{
+    if (!reply.isArray())
+        return false;
+
+    std::vector<uint16_t> table(clusterSlotCount, noNode);
+    std::vector<bool> used;
+
+    // Entries: [start, end, [ip, port, id, ...], replicas...]
+    for(const RedisValue &range: reply.getArray())
+    {
+        if (!range.isArray() || range.getArray().size() < 3 ||
+                !range.getArray()[2].isArray() || range.getArray()[2].getArray().size() < 2)
+            continue;
+
+        const std::vector<RedisValue> &primary = range.getArray()[2].getArray();
+        int64_t start = range.getArray()[0].toInt();
+        int64_t end = std::min<int64_t>(range.getArray()[1].toInt(), clusterSlotCount - 1);
+        std::string ip = primary[0].toString();
+
+        // An empty ip is the node queried, "?" is unknown.
+        if (ip.empty())
+            ip = queried.substr(0, queried.rfind(':'));
+        else if (ip == "?")
+            continue;
+
+        uint16_t index = addNode(ip + ":" + std::to_string(primary[1].toInt()));
+
+        if (index == noNode)
+            continue;
+
+        used.resize(nodes.size());
+        used[index] = true;
+
+        for(int64_t slot = std::max<int64_t>(start, 0); slot <= end; ++slot)
+            table[slot] = index;
+    }
+
+    if (used.empty())
+        return false;
+
+    used.resize(nodes.size());
+
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (!used[i] && nodes[i].node)
+        {
+            retire(nodes[i].node);
+            nodes[i].node.reset();
+        }
+    }
+
+    slots.swap(table);
+    return true;
+}
+
+void RedisClusterClient::connectSeed(size_t seed,
+        std::function<void(boost::system::error_code)> handler)
+{
+    if (seed >= seeds.size())
+    {
+        handler(boost::asio::error::not_connected);
+        return;
+    }
+
+    uint16_t index = addNode(seeds[seed].address().to_string() + ":" +
+            std::to_string(seeds[seed].port()));
+
+    refreshing = true;
+    lastRefresh = std::chrono::steady_clock::now();
+
+    loadSlots(index, [this, seed, handler](bool ok) {
+        refreshing = false;
+
+        if (ok)
+            handler(boost::system::error_code());
+        else
+            connectSeed(seed + 1, handler);
+    });
+}
+
+void RedisClusterClient::retire(const std::shared_ptr<Node> &node)
+{
+    // Keep it until commands sent to it get their replies.
+    if (node->pending == 0 && node->waiting.empty())
+        node->client.disconnect();
+    else
+        retired.push_back(node);
+}
+
+}
+
+#endif // REDISCLIENT_REDISCLUSTERCLIENT_CPP
@@ -19,7 +19,7 @@ RedisSyncClient::RedisSyncClient(boost::asio::io_service &ioService)
     : pimpl(std::make_shared<RedisClientImpl>(ioService)),
     connectTimeout(boost::posix_time::hours(365 * 24)),
     commandTimeout(boost::posix_time::hours(365 * 24)),
-    tcpNoDelay(true), tcpKeepAlive(false)
+    tcpNoDelay(true), tcpKeepAlive(false), soBusyPoll(false)
 {
     pimpl->errorHandler = std::bind(&RedisClientImpl::defaulErrorHandler, std::placeholders::_1);
 }
@@ -29,7 +29,8 @@ RedisSyncClient::RedisSyncClient(RedisSyncClient &&other)
     connectTimeout(std::move(other.connectTimeout)),
     commandTimeout(std::move(other.commandTimeout)),
     tcpNoDelay(std::move(other.tcpNoDelay)),
-    tcpKeepAlive(std::move(other.tcpKeepAlive))
+    tcpKeepAlive(std::move(other.tcpKeepAlive)),
+    soBusyPoll(std::move(other.soBusyPoll))
 {
 }
 
@@ -58,6 +59,17 @@ void RedisSyncClient::connect(const boost::asio::ip::tcp::endpoint &endpoint,
 
     // TODO keep alive option
 
+#ifdef SO_BUSY_POLL
+    if (!ec && soBusyPoll)
+    {
+        int usec = static_cast<int>(pimpl->spinBudget.count());
+
+        // Best effort, needs CAP_NET_ADMIN on some kernels.
+        setsockopt(pimpl->socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL,
+                &usec, sizeof(usec));
+    }
+#endif
+
     // boost asio does not support `connect` with timeout
     int socket = pimpl->socket.native_handle();
     struct sockaddr_in addr;
@@ -170,7 +182,7 @@ void RedisSyncClient::connect(const boost::asio::ip::tcp::endpoint &endpoint,
     }
 
     if (!ec)
-        pimpl->state = State::Connected;
+        handshake(ec);
 }
 
 #ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
@@ -192,11 +204,46 @@ void RedisSyncClient::connect(const boost::asio::local::stream_protocol::endpoin
         pimpl->socket.connect(endpoint, ec);
 
     if (!ec)
-        pimpl->state = State::Connected;
+        handshake(ec);
 }
 
 #endif
 
+void RedisSyncClient::handshake(boost::system::error_code &ec)
+{
+    pimpl->state = State::Connected;
+
+    std::deque<std::deque<RedisBuffer>> commands =
+        RedisClientImpl::handshakeCommands(pimpl->connectOptions);
+
+    if (commands.empty())
+        return;
+
+    RedisValue result = pimpl->doSyncCommand(commands, commandTimeout, ec);
+
+    if (!ec)
+    {
+        std::vector<RedisValue> replies;
+
+        if (result.isArray())
+            replies = result.toArray();
+
+        ec = RedisClientImpl::handshakeError(commands, replies);
+    }
+
+    if (ec)
+        pimpl->close();
+}
+
+void RedisSyncClient::fail(const boost::system::error_code &error,
+        boost::system::error_code &ec)
+{
+    // Replies are out of sync after an I/O error or a timeout,
+    // so the connection can't be used any more.
+    pimpl->close();
+    ec = error;
+}
+
 bool RedisSyncClient::isConnected() const
 {
     return pimpl->getState() == State::Connected ||
@@ -225,12 +272,25 @@ RedisValue RedisSyncClient::command(std::string cmd, std::deque<RedisBuffer> arg
 
 RedisValue RedisSyncClient::command(std::string cmd, std::deque<RedisBuffer> args,
             boost::system::error_code &ec)
+{
+    return command(std::move(cmd), std::move(args), commandTimeout, ec);
+}
+
+RedisValue RedisSyncClient::command(std::string cmd, std::deque<RedisBuffer> args,
+            const boost::posix_time::time_duration &timeout,
+            boost::system::error_code &ec)
 {
     if(stateValid())
     {
         args.push_front(std::move(cmd));
 
-        return pimpl->doSyncCommand(args, commandTimeout, ec);
+        boost::system::error_code error;
+        RedisValue result = pimpl->doSyncCommand(args, timeout, error);
+
+        if (error)
+            fail(error, ec);
+
+        return result;
     }
     else
     {
@@ -258,7 +318,13 @@ RedisValue RedisSyncClient::pipelined(std::deque<std::deque<RedisBuffer>> comman
 {
     if(stateValid())
     {
-        return pimpl->doSyncCommand(commands, commandTimeout, ec);
+        boost::system::error_code error;
+        RedisValue result = pimpl->doSyncCommand(commands, commandTimeout, error);
+
+        if (error)
+            fail(error, ec);
+
+        return result;
     }
     else
     {
@@ -304,6 +370,12 @@ RedisSyncClient &RedisSyncClient::setCommandTimeout(
     return *this;
 }
 
+RedisSyncClient &RedisSyncClient::setConnectOptions(const ConnectOptions &options)
+{
+    pimpl->connectOptions = options;
+    return *this;
+}
+
 RedisSyncClient &RedisSyncClient::setTcpNoDelay(bool enable)
 {
     tcpNoDelay = enable;
@@ -316,6 +388,31 @@ RedisSyncClient &RedisSyncClient::setTcpKeepAlive(bool enable)
     return *this;
 }
 
+RedisSyncClient &RedisSyncClient::setIoMode(IoMode mode)
+{
+    pimpl->ioMode = mode;
+    return *this;
+}
+
+RedisSyncClient &RedisSyncClient::setBusyPoll(
+        const boost::posix_time::time_duration &budget, bool enableSoBusyPoll)
+{
+    pimpl->ioMode = IoMode::BusyPoll;
+    pimpl->spinBudget = std::chrono::microseconds(budget.total_microseconds());
+    soBusyPoll = enableSoBusyPoll;
+    return *this;
+}
+
+RedisSyncClient::IoStats RedisSyncClient::ioStats() const
+{
+    return pimpl->ioStats;
+}
+
+void RedisSyncClient::resetIoStats()
+{
+    pimpl->ioStats = IoStats();
+}
+
 }
 
 #endif // REDISCLIENT_REDISSYNCCLIENT_CPP
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REPLICASELECTOR_H
+#define REDISCLIENT_REPLICASELECTOR_H
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace redisclient {
+
+// Picks the replica with the lowest expected delay: its latency EWMA
+// times the number of its commands waiting for a reply (plus one). A
+// replica without samples has zero latency, so every replica is tried.
+class ReplicaSelector : boost::noncopyable {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    explicit ReplicaSelector(size_t count)
+        : replicas(new Replica[count]), count(count)
+    {
+    }
+
+    // Best replica for which usable(index) is true, or npos.
+    template<typename Usable>
+    size_t select(Usable usable) const
+    {
+        size_t best = npos;
+        int64_t bestScore = 0;
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            if (!usable(i))
+                continue;
+
+            int64_t score = (replicas[i].latency.load(std::memory_order_relaxed) + 1) *
+                static_cast<int64_t>(replicas[i].pending.load(std::memory_order_relaxed) + 1);
+
+            if (best == npos || score < bestScore)
+            {
+                best = i;
+                bestScore = score;
+            }
+        }
+
+        return best;
+    }
+
+    void started(size_t index)
+    {
+        ++replicas[index].pending;
+    }
+
+    void finished(size_t index, std::chrono::steady_clock::duration latency)
+    {
+        int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        int64_t old = replicas[index].latency.load(std::memory_order_relaxed);
+        int64_t ewma;
+
+        do
+        {
+            // Weight 1/8 for a new sample, as TCP does for the RTT. Zero
+            // is kept for "no samples".
+            ewma = old == 0 ? std::max<int64_t>(sample, 1) : old + (sample - old) / 8;
+        } while (!replicas[index].latency.compare_exchange_weak(old, ewma));
+
+        --replicas[index].pending;
+    }
+
+    // Command not sent, or dropped without a reply.
+    void cancelled(size_t index)
+    {
+        --replicas[index].pending;
+    }
+
+    // Latency EWMA in microseconds, zero before the first reply.
+    int64_t latency(size_t index) const
+    {
+        return replicas[index].latency.load();
+    }
+
+    size_t pending(size_t index) const
+    {
+        return replicas[index].pending.load();
+    }
+
+private:
+    struct Replica {
+        Replica()
+            : latency(0), pending(0)
+        {
+        }
+
+        std::atomic<int64_t> latency;
+        std::atomic<size_t> pending;
+    };
+
+    std::unique_ptr<Replica[]> replicas;
+    const size_t count;
+};
+
+}
+
+#endif // REDISCLIENT_REPLICASELECTOR_H
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REPLICATEDASYNCCLIENT_CPP
+#define REDISCLIENT_REPLICATEDASYNCCLIENT_CPP
+
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+
+#include "redisclient/replicatedasyncclient.h"
+
+namespace redisclient {
+
+// A command counted on its replica until its handler is called or
+// destroyed without being called, e.g. dropped by close() of the client.
+struct ReplicatedAsyncClient::Outstanding {
+    Outstanding(std::shared_ptr<ReplicaSelector> selector_, size_t index_)
+        : selector(std::move(selector_)), index(index_),
+        start(std::chrono::steady_clock::now())
+    {
+        selector->started(index);
+    }
+
+    ~Outstanding()
+    {
+        if (selector)
+            selector->cancelled(index);
+    }
+
+    void finished()
+    {
+        selector->finished(index, std::chrono::steady_clock::now() - start);
+        selector.reset();
+    }
+
+    std::shared_ptr<ReplicaSelector> selector;
+    size_t index;
+    std::chrono::steady_clock::time_point start;
+};
+
+ReplicatedAsyncClient::ReplicatedAsyncClient(boost::asio::io_service &ioService,
+        size_t replicas)
+    : primaryClient(ioService), selector(std::make_shared<ReplicaSelector>(replicas))
+{
+    replicaClients.reserve(replicas);
+
+    for(size_t i = 0; i < replicas; ++i)
+        replicaClients.emplace_back(new RedisAsyncClient(ioService));
+}
+
+void ReplicatedAsyncClient::connect(const boost::asio::ip::tcp::endpoint &primary,
+        const std::vector<boost::asio::ip::tcp::endpoint> &replicas,
+        std::function<void(boost::system::error_code)> handler)
+{
+    if (replicas.size() != replicaClients.size())
+        throw std::invalid_argument("ReplicatedAsyncClient: wrong number of replica endpoints");
+
+    struct Connecting
+    {
+        size_t left;
+        boost::system::error_code ec;
+        std::function<void(boost::system::error_code)> handler;
+    };
+
+    std::shared_ptr<Connecting> connecting = std::make_shared<Connecting>();
+
+    connecting->left = replicas.size() + 1;
+    connecting->handler = std::move(handler);
+
+    // All handlers run in the io_service, no lock needed.
+    primaryClient.connect(primary, [connecting](boost::system::error_code ec) {
+        connecting->ec = ec;
+
+        if (--connecting->left == 0)
+            connecting->handler(connecting->ec);
+    });
+
+    for(size_t i = 0; i < replicas.size(); ++i)
+    {
+        replicaClients[i]->connect(replicas[i], [connecting](boost::system::error_code) {
+            if (--connecting->left == 0)
+                connecting->handler(connecting->ec);
+        });
+    }
+}
+
+void ReplicatedAsyncClient::disconnect()
+{
+    primaryClient.disconnect();
+
+    for(auto &client: replicaClients)
+        client->disconnect();
+}
+
+void ReplicatedAsyncClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    command(Route::Auto, cmd, std::move(args), std::move(handler));
+}
+
+void ReplicatedAsyncClient::command(Route route,
+        const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    size_t index = ReplicaSelector::npos;
+
+    if (route == Route::Replica || (route == Route::Auto && isReadOnlyCommand(cmd)))
+        index = selectReplica();
+
+    if (index == ReplicaSelector::npos)
+    {
+        primaryClient.command(cmd, std::move(args), std::move(handler));
+        return;
+    }
+
+    // Released by the reply, or when the handler is dropped unrun.
+    std::shared_ptr<Outstanding> outstanding = std::make_shared<Outstanding>(selector, index);
+
+    replicaClients[index]->command(cmd, std::move(args),
+            [outstanding, handler](RedisValue value) {
+                outstanding->finished();
+                handler(std::move(value));
+            });
+}
+
+RedisAsyncClient &ReplicatedAsyncClient::primary()
+{
+    return primaryClient;
+}
+
+RedisAsyncClient &ReplicatedAsyncClient::replica(size_t index)
+{
+    assert(index < replicaClients.size());
+    return *replicaClients[index];
+}
+
+size_t ReplicatedAsyncClient::replicas() const
+{
+    return replicaClients.size();
+}
+
+boost::posix_time::time_duration ReplicatedAsyncClient::replicaLatency(size_t index) const
+{
+    return boost::posix_time::microseconds(selector->latency(index));
+}
+
+size_t ReplicatedAsyncClient::replicaPending(size_t index) const
+{
+    return selector->pending(index);
+}
+
+size_t ReplicatedAsyncClient::selectReplica() const
+{
+    return selector->select([this](size_t i) { return replicaClients[i]->isConnected(); });
+}
+
+}
+
+#endif // REDISCLIENT_REPLICATEDASYNCCLIENT_CPP
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REPLICATEDSYNCCLIENT_CPP
+#define REDISCLIENT_REPLICATEDSYNCCLIENT_CPP
+
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+
+#include "redisclient/replicatedsyncclient.h"
+#include "redisclient/impl/throwerror.h"
+
+namespace redisclient {
+
+ReplicatedSyncClient::ReplicatedSyncClient(boost::asio::io_service &ioService,
+        size_t replicas)
+    : primaryClient(ioService), selector(replicas)
+{
+    replicaClients.reserve(replicas);
+
+    for(size_t i = 0; i < replicas; ++i)
+        replicaClients.emplace_back(ioService);
+}
+
+void ReplicatedSyncClient::connect(const boost::asio::ip::tcp::endpoint &primary,
+        const std::vector<boost::asio::ip::tcp::endpoint> &replicas,
+        boost::system::error_code &ec)
+{
+    if (replicas.size() != replicaClients.size())
+        throw std::invalid_argument("ReplicatedSyncClient: wrong number of replica endpoints");
+
+    primaryClient.connect(primary, ec);
+
+    for(size_t i = 0; i < replicas.size(); ++i)
+    {
+        boost::system::error_code replicaEc;
+
+        replicaClients[i].connect(replicas[i], replicaEc);
+    }
+}
+
+void ReplicatedSyncClient::connect(const boost::asio::ip::tcp::endpoint &primary,
+        const std::vector<boost::asio::ip::tcp::endpoint> &replicas)
+{
+    boost::system::error_code ec;
+
+    connect(primary, replicas, ec);
+    detail::throwIfError(ec);
+}
+
+void ReplicatedSyncClient::disconnect()
+{
+    primaryClient.disconnect();
+
+    for(auto &client: replicaClients)
+        client.disconnect();
+}
+
+RedisValue ReplicatedSyncClient::command(std::string cmd, std::deque<RedisBuffer> args)
+{
+    return command(Route::Auto, std::move(cmd), std::move(args));
+}
+
+RedisValue ReplicatedSyncClient::command(std::string cmd, std::deque<RedisBuffer> args,
+        boost::system::error_code &ec)
+{
+    return command(Route::Auto, std::move(cmd), std::move(args), ec);
+}
+
+RedisValue ReplicatedSyncClient::command(Route route,
+        std::string cmd, std::deque<RedisBuffer> args)
+{
+    boost::system::error_code ec;
+    RedisValue result = command(route, std::move(cmd), std::move(args), ec);
+
+    detail::throwIfError(ec);
+    return result;
+}
+
+RedisValue ReplicatedSyncClient::command(Route route,
+        std::string cmd, std::deque<RedisBuffer> args,
+        boost::system::error_code &ec)
+{
+    size_t index;
+    RedisSyncClient &client = this->route(route, cmd, index);
+
+    if (index == ReplicaSelector::npos)
+        return client.command(std::move(cmd), std::move(args), ec);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    selector.started(index);
+
+    RedisValue result = client.command(std::move(cmd), std::move(args), ec);
+
+    selector.finished(index, std::chrono::steady_clock::now() - start);
+    return result;
+}
+
+RedisSyncClient &ReplicatedSyncClient::primary()
+{
+    return primaryClient;
+}
+
+RedisSyncClient &ReplicatedSyncClient::replica(size_t index)
+{
+    assert(index < replicaClients.size());
+    return replicaClients[index];
+}
+
+size_t ReplicatedSyncClient::replicas() const
+{
+    return replicaClients.size();
+}
+
+boost::posix_time::time_duration ReplicatedSyncClient::replicaLatency(size_t index) const
+{
+    return boost::posix_time::microseconds(selector.latency(index));
+}
+
+RedisSyncClient &ReplicatedSyncClient::route(Route route, const std::string &cmd,
+        size_t &index)
+{
+    index = ReplicaSelector::npos;
+
+    if (route == Route::Replica || (route == Route::Auto && isReadOnlyCommand(cmd)))
+        index = selector.select([this](size_t i) { return replicaClients[i].isConnected(); });
+
+    return index == ReplicaSelector::npos ? primaryClient : replicaClients[index];
+}
+
+}
+
+#endif // REDISCLIENT_REPLICATEDSYNCCLIENT_CPP
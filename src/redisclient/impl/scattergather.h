@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_SCATTERGATHER_H
+#define REDISCLIENT_SCATTERGATHER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redisclient/redisbuffer.h"
+#include "redisclient/redisvalue.h"
+
+namespace redisclient {
+
+// Runs a multi-key command as one command per shard (slot or server)
+// and merges the replies into the caller's key order. Replies of MGET
+// are moved into a results array allocated once for all keys.
+class ScatterGather {
+public:
+    enum Merge {
+        Values, // MGET: array of values in key order
+        Status, // MSET: OK or the first error
+        Sum     // DEL, UNLINK, EXISTS, TOUCH: sum of the counts
+    };
+
+    // Positions (in the caller's keys) of the keys of one shard.
+    struct Group {
+        uint32_t shard;
+        std::vector<uint32_t> positions;
+    };
+
+    // Group keys 0..count-1 by shardOf(key), keeping their order.
+    template<typename ShardOf>
+    static std::vector<Group> split(size_t count, ShardOf shardOf)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> keys(count);
+
+        for(size_t i = 0; i < count; ++i)
+            keys[i] = std::make_pair(static_cast<uint32_t>(shardOf(i)), static_cast<uint32_t>(i));
+
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<Group> groups;
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            if (groups.empty() || groups.back().shard != keys[i].first)
+            {
+                groups.push_back(Group());
+                groups.back().shard = keys[i].first;
+            }
+
+            groups.back().positions.push_back(keys[i].second);
+        }
+
+        return groups;
+    }
+
+    // In a pipeline split by shard, the commands from WATCH or MULTI to
+    // the matching EXEC or DISCARD (UNWATCH, without MULTI) form a
+    // transaction block. Give all commands of a block the shard of its
+    // first command with a key, so that the block isn't split. Return
+    // which commands are in a block.
+    template<typename Shard>
+    static std::vector<bool> keepTransactions(
+            const std::deque<std::deque<RedisBuffer>> &commands, std::vector<Shard> &target)
+    {
+        std::vector<bool> inBlock(commands.size(), false);
+        size_t begin = 0;
+
+        while (begin < commands.size())
+        {
+            std::string name = commandName(commands[begin]);
+
+            if (name != "WATCH" && name != "MULTI")
+            {
+                ++begin;
+                continue;
+            }
+
+            bool multi = name == "MULTI";
+            size_t end = begin + 1;
+
+            // An unterminated block runs to the end of the pipeline.
+            while (end < commands.size())
+            {
+                name = commandName(commands[end++]);
+
+                if (name == "MULTI")
+                    multi = true;
+                else if (name == "EXEC" || name == "DISCARD" || (!multi && name == "UNWATCH"))
+                    break;
+            }
+
+            size_t keyed = begin;
+
+            while (keyed < end && commands[keyed].size() < 2)
+                ++keyed;
+
+            Shard shard = target[keyed < end ? keyed : begin];
+
+            for(size_t i = begin; i < end; ++i)
+            {
+                target[i] = shard;
+                inBlock[i] = true;
+            }
+
+            begin = end;
+        }
+
+        return inBlock;
+    }
+
+    ScatterGather(size_t keys, size_t groups, Merge merge,
+            std::function<void(RedisValue)> handler)
+        : state(std::make_shared<State>())
+    {
+        state->merge = merge;
+        state->left = groups;
+        state->sum = 0;
+        state->failed = false;
+        state->handler = std::move(handler);
+
+        if (merge == Values)
+            state->values.resize(keys);
+
+        if (groups == 0)
+            finish(*state);
+    }
+
+    // Handler for the reply of the command of group.
+    std::function<void(RedisValue)> gather(Group group)
+    {
+        std::shared_ptr<State> state = this->state;
+        std::vector<uint32_t> positions = std::move(group.positions);
+
+        return [state, positions](RedisValue value) {
+            if (state->merge == Values)
+            {
+                if (value.isArray() && value.getArray().size() == positions.size())
+                {
+                    std::vector<RedisValue> &values = value.getArray();
+
+                    for(size_t i = 0; i < positions.size(); ++i)
+                        state->values[positions[i]] = std::move(values[i]);
+                }
+                else
+                {
+                    // The error of the shard for each of its keys.
+                    for(uint32_t position: positions)
+                        state->values[position] = value;
+                }
+            }
+            else if (value.isError())
+            {
+                if (!state->failed)
+                {
+                    state->failed = true;
+                    state->error = std::move(value);
+                }
+            }
+            else if (state->merge == Sum)
+            {
+                state->sum += value.toInt();
+            }
+
+            if (--state->left == 0)
+                finish(*state);
+        };
+    }
+
+private:
+    static std::string commandName(const std::deque<RedisBuffer> &command)
+    {
+        if (command.empty())
+            return std::string();
+
+        std::string name(command.front().bytes(), command.front().size());
+
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        return name;
+    }
+
+    struct State {
+        Merge merge;
+        size_t left;
+        std::vector<RedisValue> values;
+        int64_t sum;
+        bool failed;
+        RedisValue error;
+        std::function<void(RedisValue)> handler;
+    };
+
+    static void finish(State &state)
+    {
+        if (state.failed)
+            state.handler(std::move(state.error));
+        else if (state.merge == Values)
+            state.handler(RedisValue(std::move(state.values)));
+        else if (state.merge == Sum)
+            state.handler(RedisValue(state.sum));
+        else
+            state.handler(RedisValue("OK"));
+    }
+
+    std::shared_ptr<State> state;
+};
+
+}
+
+#endif // REDISCLIENT_SCATTERGATHER_H
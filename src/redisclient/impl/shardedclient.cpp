@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_SHARDEDCLIENT_CPP
+#define REDISCLIENT_SHARDEDCLIENT_CPP
+
+#include <cassert>
+
+#include "redisclient/shardedclient.h"
+
+namespace redisclient {
+
+ShardedClient::ShardedClient(boost::asio::io_service &ioService_, size_t pointsPerShard)
+    : ioService(ioService_), hashRing(pointsPerShard)
+{
+}
+
+ShardedClient::~ShardedClient()
+{
+    disconnect();
+}
+
+size_t ShardedClient::addShard(const boost::asio::ip::tcp::endpoint &endpoint,
+        const std::string &name, size_t weight)
+{
+    shardList.push_back(std::make_shared<Shard>(ioService, endpoint));
+
+    if (name.empty())
+        return hashRing.add(endpoint.address().to_string() + ":" + std::to_string(endpoint.port()), weight);
+    else
+        return hashRing.add(name, weight);
+}
+
+void ShardedClient::connect(std::function<void(boost::system::error_code)> handler)
+{
+    struct Connect
+    {
+        size_t left;
+        boost::system::error_code ec;
+        std::function<void(boost::system::error_code)> handler;
+    };
+
+    std::shared_ptr<Connect> state = std::make_shared<Connect>();
+
+    state->left = 1;
+    state->handler = std::move(handler);
+
+    auto done = [state](boost::system::error_code ec) {
+        if (ec && !state->ec)
+            state->ec = ec;
+
+        if (--state->left == 0)
+            state->handler(state->ec);
+    };
+
+    for(size_t i = 0; i < shardList.size(); ++i)
+    {
+        Shard &shard = *shardList[i];
+
+        if (shard.connected)
+            continue;
+
+        std::weak_ptr<Shard> weakShard = shardList[i];
+
+        ++state->left;
+
+        shard.client.connect(shard.endpoint, [weakShard, done](boost::system::error_code ec) {
+            std::shared_ptr<Shard> shard = weakShard.lock();
+
+            if (!ec && shard)
+                shard->connected = true;
+
+            done(ec);
+        });
+    }
+
+    done(boost::system::error_code());
+}
+
+void ShardedClient::disconnect()
+{
+    for(auto &shard: shardList)
+    {
+        shard->client.disconnect();
+        shard->connected = false;
+    }
+}
+
+void ShardedClient::command(const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    size_t index = args.empty() || shardList.empty() ? 0 : bufferShard(args.front());
+
+    command(index, cmd, std::move(args), std::move(handler));
+}
+
+void ShardedClient::command(size_t index,
+        const std::string &cmd, std::deque<RedisBuffer> args,
+        std::function<void(RedisValue)> handler)
+{
+    if (!ready(index))
+    {
+        handler(shardError("[ShardedClient] shard not connected"));
+        return;
+    }
+
+    shardList[index]->client.command(cmd, std::move(args), std::move(handler));
+}
+
+void ShardedClient::pipelined(std::deque<std::deque<RedisBuffer>> commands,
+        std::function<void(RedisValue)> handler)
+{
+    struct Batch
+    {
+        std::vector<RedisValue> replies;
+        size_t left;
+        std::function<void(RedisValue)> handler;
+    };
+
+    if (commands.empty())
+    {
+        handler(RedisValue(std::vector<RedisValue>()));
+        return;
+    }
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+
+    batch->replies.resize(commands.size());
+    batch->left = commands.size();
+    batch->handler = std::move(handler);
+
+    // Split by shard, keeping the order of the commands of each shard.
+    std::vector<size_t> target(commands.size());
+    std::vector<size_t> count(shardList.size() + 1, 0);
+
+    for(size_t i = 0; i < commands.size(); ++i)
+    {
+        const std::deque<RedisBuffer> &command = commands[i];
+
+        if (command.empty() || shardList.empty())
+            target[i] = shardList.size();
+        else
+            target[i] = command.size() > 1 ? bufferShard(command[1]) : 0;
+    }
+
+    ScatterGather::keepTransactions(commands, target);
+
+    for(size_t i = 0; i < commands.size(); ++i)
+        ++count[target[i]];
+
+    std::vector<size_t> offset(count.size(), 0);
+    std::vector<size_t> order(commands.size());
+
+    for(size_t i = 1; i < count.size(); ++i)
+        offset[i] = offset[i - 1] + count[i - 1];
+
+    for(size_t i = 0; i < commands.size(); ++i)
+        order[offset[target[i]]++] = i;
+
+    for(size_t i: order)
+    {
+        std::function<void(RedisValue)> reply = [batch, i](RedisValue value) {
+            batch->replies[i] = std::move(value);
+
+            if (--batch->left == 0)
+                batch->handler(RedisValue(std::move(batch->replies)));
+        };
+
+        if (target[i] == shardList.size())
+        {
+            reply(shardError("[ShardedClient] no shard for command"));
+            continue;
+        }
+
+        std::string cmd = bufferString(commands[i].front());
+
+        commands[i].pop_front();
+        command(target[i], cmd, std::move(commands[i]), std::move(reply));
+    }
+}
+
+void ShardedClient::mget(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("MGET", ScatterGather::Values, keys, nullptr, std::move(handler));
+}
+
+void ShardedClient::mset(const std::vector<std::pair<std::string, RedisBuffer>> &items,
+        std::function<void(RedisValue)> handler)
+{
+    std::vector<std::string> keys;
+    std::vector<RedisBuffer> values;
+
+    keys.reserve(items.size());
+    values.reserve(items.size());
+
+    for(const auto &item: items)
+    {
+        keys.push_back(item.first);
+        values.push_back(item.second);
+    }
+
+    scatter("MSET", ScatterGather::Status, keys, &values, std::move(handler));
+}
+
+void ShardedClient::del(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("DEL", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void ShardedClient::unlink(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("UNLINK", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void ShardedClient::exists(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("EXISTS", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+void ShardedClient::touch(const std::vector<std::string> &keys,
+        std::function<void(RedisValue)> handler)
+{
+    scatter("TOUCH", ScatterGather::Sum, keys, nullptr, std::move(handler));
+}
+
+size_t ShardedClient::shardOf(const std::string &key) const
+{
+    return hashRing.shard(key);
+}
+
+size_t ShardedClient::shardOf(const Key &key) const
+{
+    return key.shard(hashRing);
+}
+
+RedisAsyncClient &ShardedClient::shard(size_t index)
+{
+    assert(index < shardList.size());
+    return shardList[index]->client;
+}
+
+size_t ShardedClient::shards() const
+{
+    return shardList.size();
+}
+
+const HashRing &ShardedClient::ring() const
+{
+    return hashRing;
+}
+
+RedisValue ShardedClient::shardError(const std::string &message)
+{
+    return RedisValue(std::vector<char>(message.begin(), message.end()), RedisValue::ErrorTag());
+}
+
+std::string ShardedClient::bufferString(const RedisBuffer &buffer)
+{
+    return std::string(buffer.bytes(), buffer.size());
+}
+
+size_t ShardedClient::bufferShard(const RedisBuffer &key) const
+{
+    if (const Key *prehashed = boost::get<Key>(&key.data))
+        return prehashed->shard(hashRing);
+
+    return hashRing.shard(key.bytes(), key.size());
+}
+
+bool ShardedClient::ready(size_t index) const
+{
+    if (index >= shardList.size())
+        return false;
+
+    const Shard &shard = *shardList[index];
+
+    // Once connected, a client with auto reconnect queues commands while
+    // it is connecting again.
+    return shard.client.isConnected() ||
+        (shard.connected && shard.client.state() == RedisAsyncClient::State::Connecting);
+}
+
+void ShardedClient::scatter(const std::string &cmd, ScatterGather::Merge merge,
+        const std::vector<std::string> &keys, const std::vector<RedisBuffer> *values,
+        std::function<void(RedisValue)> handler)
+{
+    if (shardList.empty())
+    {
+        handler(shardError("[ShardedClient] no shard for command"));
+        return;
+    }
+
+    std::vector<ScatterGather::Group> groups = ScatterGather::split(keys.size(),
+            [this, &keys](size_t i) { return hashRing.shard(keys[i]); });
+    ScatterGather gather(keys.size(), groups.size(), merge, std::move(handler));
+
+    for(ScatterGather::Group &group: groups)
+    {
+        std::deque<RedisBuffer> args;
+        size_t index = group.shard;
+
+        for(uint32_t position: group.positions)
+        {
+            args.emplace_back(keys[position]);
+
+            if (values)
+                args.push_back((*values)[position]);
+        }
+
+        command(index, cmd, std::move(args), gather.gather(std::move(group)));
+    }
+}
+
+}
+
+#endif // REDISCLIENT_SHARDEDCLIENT_CPP
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_TIMINGWHEEL_CPP
+#define REDISCLIENT_TIMINGWHEEL_CPP
+
+#include <assert.h>
+
+#include "timingwheel.h"
+
+namespace redisclient {
+
+TimingWheel::TimingWheel(size_t slots,
+        const boost::posix_time::time_duration &tickDuration)
+    : wheel(slots), duration(tickDuration), current(0), timers(0)
+{
+    assert(slots > 0);
+    assert(tickDuration.total_microseconds() > 0);
+}
+
+TimingWheel::TimerPtr TimingWheel::add(
+        const boost::posix_time::time_duration &timeout, Callback callback)
+{
+    int64_t tickUsec = duration.total_microseconds();
+    int64_t ticks = (timeout.total_microseconds() + tickUsec - 1) / tickUsec;
+
+    if (ticks < 1)
+        ticks = 1;
+
+    TimerPtr timer = std::make_shared<Timer>();
+
+    timer->rounds = static_cast<size_t>(ticks - 1) / wheel.size();
+    timer->callback = std::move(callback);
+
+    wheel[(current + static_cast<size_t>(ticks)) % wheel.size()].push_back(timer);
+    ++timers;
+
+    return timer;
+}
+
+void TimingWheel::cancel(const TimerPtr &timer)
+{
+    if (timer)
+        timer->callback = nullptr;
+}
+
+void TimingWheel::tick()
+{
+    current = (current + 1) % wheel.size();
+
+    std::vector<TimerPtr> &slot = wheel[current];
+    std::vector<Callback> expired;
+
+    for(size_t i = 0; i < slot.size();)
+    {
+        TimerPtr &timer = slot[i];
+
+        if (timer->callback && timer->rounds > 0)
+        {
+            --timer->rounds;
+            ++i;
+            continue;
+        }
+
+        if (timer->callback)
+            expired.push_back(std::move(timer->callback));
+
+        timer->callback = nullptr;
+        std::swap(timer, slot.back());
+        slot.pop_back();
+        --timers;
+    }
+
+    // Callbacks may add or cancel timers, so call them after the sweep.
+    for(auto &callback: expired)
+        callback();
+}
+
+void TimingWheel::clear()
+{
+    for(auto &slot: wheel)
+    {
+        for(auto &timer: slot)
+            timer->callback = nullptr;
+
+        slot.clear();
+    }
+
+    timers = 0;
+}
+
+bool TimingWheel::empty() const
+{
+    return timers == 0;
+}
+
+const boost::posix_time::time_duration &TimingWheel::tickDuration() const
+{
+    return duration;
+}
+
+}
+
+#endif // REDISCLIENT_TIMINGWHEEL_CPP
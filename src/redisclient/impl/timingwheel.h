@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_TIMINGWHEEL_H
+#define REDISCLIENT_TIMINGWHEEL_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <vector>
+#include <functional>
+#include <memory>
+
+#include "redisclient/config.h"
+
+namespace redisclient {
+
+// Hashed timing wheel. Timers are hashed into `slots` buckets by their
+// expiration tick, so add and cancel are O(1) and one periodic timer
+// (calling tick()) is enough to drive any number of timeouts.
+// Resolution is one tick. Not thread safe.
+class TimingWheel : boost::noncopyable {
+public:
+    typedef std::function<void()> Callback;
+
+    struct Timer {
+        size_t rounds;
+        Callback callback;
+    };
+
+    typedef std::shared_ptr<Timer> TimerPtr;
+
+    REDIS_CLIENT_DECL TimingWheel(size_t slots,
+            const boost::posix_time::time_duration &tickDuration);
+
+    // Arm a timer. Callback will be called from tick() after timeout.
+    REDIS_CLIENT_DECL TimerPtr add(const boost::posix_time::time_duration &timeout,
+            Callback callback);
+
+    // Disarm a timer. Cancelled timers are swept when their slot comes up.
+    REDIS_CLIENT_DECL static void cancel(const TimerPtr &timer);
+
+    // Advance the wheel one slot and fire expired timers.
+    REDIS_CLIENT_DECL void tick();
+
+    // Drop all timers without calling them.
+    REDIS_CLIENT_DECL void clear();
+
+    // Return true if there are no armed (or not yet swept) timers.
+    REDIS_CLIENT_DECL bool empty() const;
+
+    REDIS_CLIENT_DECL const boost::posix_time::time_duration &tickDuration() const;
+
+private:
+    std::vector<std::vector<TimerPtr>> wheel;
+    boost::posix_time::time_duration duration;
+    size_t current;
+    size_t timers;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "timingwheel.cpp"
+#endif
+
+#endif // REDISCLIENT_TIMINGWHEEL_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_KEY_H
+#define REDISCLIENT_KEY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "redisclient/hashring.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Prehashed key for keys used over and over. Computes once its cluster
+// slot, its HashRing hash and its RESP bulk string ("$len\r\nkey\r\n"),
+// which commands copy as is. Pass it wherever a RedisBuffer is taken;
+// RedisClusterClient and ShardedClient route it without hashing again.
+// Immutable and cheap to copy: copies share the same data.
+class Key {
+public:
+    REDIS_CLIENT_DECL explicit Key(const char *key, size_t size);
+    REDIS_CLIENT_DECL explicit Key(const char *key);
+    REDIS_CLIENT_DECL explicit Key(const std::string &key);
+
+    // Bytes of the key.
+    inline const char *data() const
+    {
+        return impl->encoded.data() + impl->offset;
+    }
+
+    inline size_t size() const
+    {
+        return impl->encoded.size() - impl->offset - 2;
+    }
+
+    REDIS_CLIENT_DECL std::string str() const;
+
+    inline uint16_t slot() const
+    {
+        return impl->slot;
+    }
+
+    inline uint32_t hash() const
+    {
+        return impl->hash;
+    }
+
+    // Shard of the key in ring; a binary search, the key is not hashed.
+    inline size_t shard(const HashRing &ring) const
+    {
+        return ring.shardOfHash(impl->hash);
+    }
+
+    // The key as a RESP bulk string.
+    inline const std::vector<char> &encoded() const
+    {
+        return impl->encoded;
+    }
+
+private:
+    struct Impl {
+        std::vector<char> encoded;
+        size_t offset; // of the key in encoded
+        uint32_t hash;
+        uint16_t slot;
+    };
+
+    std::shared_ptr<const Impl> impl;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/key.cpp"
+#endif
+
+#endif // REDISCLIENT_KEY_H
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_PUBSUBMESSAGE_H
+#define REDISCLIENT_PUBSUBMESSAGE_H
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace redisclient {
+
+// Message received on a subscription. Its bytes are moved out of the
+// parsed reply once and shared by all handlers of the message.
+struct PubSubMessage {
+    std::vector<char> channel;
+    std::vector<char> pattern; // for psubscribe, empty for subscribe
+    std::vector<char> payload;
+};
+
+typedef std::shared_ptr<const PubSubMessage> PubSubMessagePtr;
+typedef std::function<void(const PubSubMessagePtr &)> PubSubHandler;
+typedef std::function<void(const std::vector<PubSubMessagePtr> &)> PubSubBatchHandler;
+
+// Batched delivery of a subscription. Its messages parsed from one read
+// are passed to the handler together, at most maxMessages at a time.
+// With a maxDelay, a batch may also span reads: it is delivered when
+// full or maxDelay after its first message.
+struct PubSubBatchOptions
+{
+    PubSubBatchOptions()
+        : maxMessages(1024), maxDelay(boost::posix_time::microseconds(0))
+    {
+    }
+
+    size_t maxMessages;
+    boost::posix_time::time_duration maxDelay;
+};
+
+// How message handlers are called.
+enum class PubSubDispatch {
+    // From the read handler, as soon as the message is parsed.
+    Inline,
+    // Posted to the strand of the client, one handler at a time.
+    Post
+};
+
+}
+
+#endif // REDISCLIENT_PUBSUBMESSAGE_H
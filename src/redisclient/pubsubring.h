@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_PUBSUBRING_H
+#define REDISCLIENT_PUBSUBRING_H
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "redisclient/pubsubmessage.h"
+#include "config.h"
+
+namespace redisclient {
+
+// What push() does when the ring is full.
+enum class PubSubOverflow {
+    // Drop the oldest message to make room.
+    DropOldest,
+    // Drop the message pushed.
+    DropNewest,
+    // Wait for the consumer to make room. This stalls the thread of the
+    // client, and with it every subscription of the client.
+    Block
+};
+
+// Ring of pub/sub messages from the thread of a client to one worker
+// thread. Slots are allocated once; a slot holds a PubSubMessagePtr, so
+// the message bytes are shared with the other subscribers and nothing
+// is copied. push() and pop() are lock free; a mutex is only taken to
+// sleep, by a consumer in pop() waiting for a message or by a Block
+// producer waiting for room.
+//
+// One producer: fill a ring from one client only, see
+// RedisAsyncClient::subscribeRing(). One consumer thread.
+class PubSubRing : boost::noncopyable {
+public:
+    struct Stats {
+        uint64_t pushed;  // put in the ring
+        uint64_t popped;  // taken by the consumer
+        uint64_t dropped; // lost to overflow, or pushed after close()
+        uint64_t blocked; // pushes which waited for room
+        size_t lag;       // messages in the ring now
+        size_t maxLag;    // largest lag seen
+    };
+
+    // capacity is rounded up to a power of 2.
+    REDIS_CLIENT_DECL explicit PubSubRing(size_t capacity,
+            PubSubOverflow overflow = PubSubOverflow::DropOldest);
+
+    // Producer. Return false if the message was dropped.
+    REDIS_CLIENT_DECL bool push(PubSubMessagePtr message);
+
+    // Consumer. Return false if the ring is empty.
+    REDIS_CLIENT_DECL bool tryPop(PubSubMessagePtr &message);
+
+    // Consumer. Append up to maxMessages messages, return their number.
+    REDIS_CLIENT_DECL size_t tryPop(std::vector<PubSubMessagePtr> &messages,
+                                    size_t maxMessages);
+
+    // Consumer. Wait for a message; return false once the ring is closed
+    // and empty, or when timeout passes.
+    REDIS_CLIENT_DECL bool pop(PubSubMessagePtr &message);
+    REDIS_CLIENT_DECL bool pop(PubSubMessagePtr &message,
+                               const boost::posix_time::time_duration &timeout);
+
+    // Wake the waiting threads; messages pushed from now on are dropped.
+    // The messages in the ring can still be popped.
+    REDIS_CLIENT_DECL void close();
+    REDIS_CLIENT_DECL bool closed() const;
+
+    REDIS_CLIENT_DECL size_t capacity() const;
+
+    // From any thread.
+    REDIS_CLIENT_DECL Stats stats() const;
+
+private:
+    struct Slot {
+        // Index of the next push the slot is free for.
+        std::atomic<uint64_t> seq;
+        PubSubMessagePtr message;
+    };
+
+    REDIS_CLIENT_DECL static size_t roundUp(size_t capacity);
+
+    // Take up to n messages at tail, for the consumer or to drop them.
+    // Return their number, the first is at index from.
+    REDIS_CLIENT_DECL size_t claim(uint64_t &from, size_t n);
+    // Free the slot of a claimed message for the push of the next lap.
+    REDIS_CLIENT_DECL void release(uint64_t index);
+    REDIS_CLIENT_DECL bool take(PubSubMessagePtr &message);
+    REDIS_CLIENT_DECL bool waitForRoom(uint64_t h);
+    REDIS_CLIENT_DECL void wakeConsumer();
+    REDIS_CLIENT_DECL void wakeProducer();
+    REDIS_CLIENT_DECL bool popUntil(PubSubMessagePtr &message,
+            const std::chrono::steady_clock::time_point *deadline);
+
+    std::unique_ptr<Slot[]> slots;
+    const size_t mask;
+    const PubSubOverflow overflow;
+
+    // Written by the producer.
+    char pad0[64];
+    std::atomic<uint64_t> head;
+    uint64_t cachedTail;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> blocked;
+    std::atomic<size_t> maxLag;
+
+    // Written by the consumer, and by the producer dropping the oldest.
+    char pad1[64];
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> popped;
+
+    char pad2[64];
+    std::atomic<bool> consumerWaiting;
+    std::atomic<bool> producerWaiting;
+    std::atomic<bool> isClosed;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/pubsubring.cpp"
+#endif
+
+#endif // REDISCLIENT_PUBSUBRING_H
@@ -11,12 +11,19 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <memory>
+#include <vector>
 #include <type_traits>
 #include <functional>
 
 #include "redisclient/impl/redisclientimpl.h"
+#include "cancellationtoken.h"
 #include "redisvalue.h"
 #include "redisbuffer.h"
+#include "connectoptions.h"
+#include "pubsubmessage.h"
+#include "pubsubring.h"
 #include "config.h"
 
 namespace redisclient {
@@ -31,6 +38,12 @@ public:
         std::string channel;
     };
 
+    // Handle of a bulk subscribe.
+    struct BulkHandle {
+        size_t id;
+        std::vector<std::string> channels;
+    };
+
     typedef RedisClientImpl::State State;
 
     REDIS_CLIENT_DECL RedisAsyncClient(boost::asio::io_service &ioService);
@@ -65,6 +78,57 @@ public:
             const std::string &cmd, std::deque<RedisBuffer> args,
             std::function<void(RedisValue)> handler = dummyHandler);
 
+    // Execute command on Redis server with the list of arguments. If the reply
+    // does not arrive within timeout, handler is called with an error value
+    // and the reply is discarded when it comes.
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            const boost::posix_time::time_duration &timeout,
+            std::function<void(RedisValue)> handler);
+
+    // Execute command on Redis server with the list of arguments. If the
+    // command is still queued when deadline passes or token is cancelled,
+    // it is not sent and handler is called with an error value.
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            const boost::posix_time::ptime &deadline,
+            std::function<void(RedisValue)> handler);
+
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            const CancellationToken &token,
+            std::function<void(RedisValue)> handler);
+
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            const boost::posix_time::ptime &deadline,
+            const CancellationToken &token,
+            std::function<void(RedisValue)> handler);
+
+    // Return the number of commands (and their bytes) dropped
+    // from the queue by a deadline or a cancellation token.
+    REDIS_CLIENT_DECL size_t cancelledCommands() const;
+    REDIS_CLIENT_DECL size_t cancelledBytes() const;
+
+    // Set default timeout for command(). Disabled by default.
+    REDIS_CLIENT_DECL RedisAsyncClient &setCommandTimeout(
+            const boost::posix_time::time_duration &timeout);
+
+    // Setup commands (AUTH, SELECT, ...) pipelined in one round trip
+    // after connect and every reconnect. The connect handler is called
+    // when all of them succeeded; otherwise with permission_denied (AUTH,
+    // HELLO) or invalid_argument, and the connection is closed.
+    REDIS_CLIENT_DECL RedisAsyncClient &setConnectOptions(const ConnectOptions &options);
+
+    // Reconnect automatically when the connection is lost, waiting a
+    // random delay between minDelay and an exponentially growing bound
+    // (capped at maxDelay) between attempts. Commands waiting for a reply
+    // fail with "[RedisClient] connection lost"; queued commands and
+    // subscriptions are sent again after reconnect. Disabled by default.
+    REDIS_CLIENT_DECL RedisAsyncClient &setAutoReconnect(
+            const boost::posix_time::time_duration &minDelay,
+            const boost::posix_time::time_duration &maxDelay);
+
     // Subscribe to channel. Handler msgHandler will be called
     // when someone publish message on channel. Call unsubscribe 
     // to stop the subscription.
@@ -77,10 +141,106 @@ public:
                                         std::function<void(std::vector<char> msg)> msgHandler,
                                         std::function<void(RedisValue)> handler = &dummyHandler);
 
+    // Like subscribe()/psubscribe(), but msgHandler gets the message
+    // (with its channel) shared by all handlers, the payload is not
+    // copied. Keep the pointer to keep the message.
+    REDIS_CLIENT_DECL Handle subscribeShared(const std::string &channelName,
+                                             PubSubHandler msgHandler,
+                                             std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL Handle psubscribeShared(const std::string &pattern,
+                                              PubSubHandler msgHandler,
+                                              std::function<void(RedisValue)> handler = &dummyHandler);
+
+    // Subscribe to many channels at once: one SUBSCRIBE per
+    // RedisClientImpl::subscribeChunk channels and one msgHandler for all
+    // of them. handler is called once, with the last confirmation or the
+    // first error.
+    REDIS_CLIENT_DECL BulkHandle subscribe(const std::vector<std::string> &channels,
+                                           PubSubHandler msgHandler,
+                                           std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL BulkHandle psubscribe(const std::vector<std::string> &patterns,
+                                            PubSubHandler msgHandler,
+                                            std::function<void(RedisValue)> handler = &dummyHandler);
+
+    // Like subscribeShared()/psubscribeShared(), but msgHandler gets the
+    // messages in batches: all messages of the subscription parsed from
+    // one read, or collected for up to options.maxDelay, at most
+    // options.maxMessages at a time. The channels of a bulk subscription
+    // share one batch.
+    REDIS_CLIENT_DECL Handle subscribeBatch(const std::string &channelName,
+                                            PubSubBatchHandler msgHandler,
+                                            const PubSubBatchOptions &options = PubSubBatchOptions(),
+                                            std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL Handle psubscribeBatch(const std::string &pattern,
+                                             PubSubBatchHandler msgHandler,
+                                             const PubSubBatchOptions &options = PubSubBatchOptions(),
+                                             std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL BulkHandle subscribeBatch(const std::vector<std::string> &channels,
+                                                PubSubBatchHandler msgHandler,
+                                                const PubSubBatchOptions &options = PubSubBatchOptions(),
+                                                std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL BulkHandle psubscribeBatch(const std::vector<std::string> &patterns,
+                                                 PubSubBatchHandler msgHandler,
+                                                 const PubSubBatchOptions &options = PubSubBatchOptions(),
+                                                 std::function<void(RedisValue)> handler = &dummyHandler);
+
+    // Push the messages of the subscription into ring, for a worker
+    // thread to pop. The messages are shared, not copied; the ring may
+    // be fed by many subscriptions of this client, and a message goes to
+    // as many rings as it has ring subscriptions. See PubSubRing for
+    // overflow and lag.
+    REDIS_CLIENT_DECL Handle subscribeRing(const std::string &channelName,
+                                           std::shared_ptr<PubSubRing> ring,
+                                           std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL Handle psubscribeRing(const std::string &pattern,
+                                            std::shared_ptr<PubSubRing> ring,
+                                            std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL BulkHandle subscribeRing(const std::vector<std::string> &channels,
+                                               std::shared_ptr<PubSubRing> ring,
+                                               std::function<void(RedisValue)> handler = &dummyHandler);
+
+    REDIS_CLIENT_DECL BulkHandle psubscribeRing(const std::vector<std::string> &patterns,
+                                                std::shared_ptr<PubSubRing> ring,
+                                                std::function<void(RedisValue)> handler = &dummyHandler);
+
+    // Subscribe to pattern locally: one PSUBSCRIBE of coarse is sent
+    // for all local patterns of coarse, and each message of coarse is
+    // passed to the handlers of the local patterns matching its channel,
+    // found in one pass by a GlobMatcher. pattern should be narrower
+    // than coarse. handler gets the reply of PSUBSCRIBE for the first
+    // local pattern of coarse, an empty value for the next ones.
+    REDIS_CLIENT_DECL Handle psubscribeLocal(const std::string &coarse,
+                                             const std::string &pattern,
+                                             PubSubHandler msgHandler,
+                                             std::function<void(RedisValue)> handler = &dummyHandler);
+
+    // Remove a local pattern; the last one of its coarse pattern sends
+    // PUNSUBSCRIBE.
+    REDIS_CLIENT_DECL void punsubscribeLocal(const Handle &handle);
+
+    // Call message handlers inline, as each message is read (the
+    // default), or post them to the strand of the client.
+    REDIS_CLIENT_DECL RedisAsyncClient &setPubSubDispatch(PubSubDispatch dispatch);
+
     // Unsubscribe
     REDIS_CLIENT_DECL void unsubscribe(const Handle &handle);
     REDIS_CLIENT_DECL void punsubscribe(const Handle &handle);
 
+    // Unsubscribe a bulk subscribe, in chunks, from the channels left
+    // without handlers. handler is called once, with an empty value if
+    // no command was needed.
+    REDIS_CLIENT_DECL void unsubscribe(const BulkHandle &handle,
+                                       std::function<void(RedisValue)> handler = &dummyHandler);
+    REDIS_CLIENT_DECL void punsubscribe(const BulkHandle &handle,
+                                        std::function<void(RedisValue)> handler = &dummyHandler);
+
     // Subscribe to channel. Handler msgHandler will be called
     // when someone publish message on channel; it will be 
     // unsubscribed after call.
@@ -105,7 +265,15 @@ protected:
     REDIS_CLIENT_DECL bool stateValid() const;
 
 private:
+    struct LocalPatterns;
+
+    REDIS_CLIENT_DECL bool localServerSubscribed(const LocalPatterns &local) const;
+
     std::shared_ptr<RedisClientImpl> pimpl;
+    boost::posix_time::time_duration commandTimeout;
+    // coarse pattern -> its local patterns
+    std::map<std::string, std::shared_ptr<LocalPatterns>> localPatterns;
+    size_t localPatternSeq;
 };
 
 }
@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 
+#include "redisclient/key.h"
 #include "config.h"
 
 namespace redisclient {
@@ -23,10 +24,14 @@ struct RedisBuffer
     inline RedisBuffer(const char *s);
     inline RedisBuffer(std::string s);
     inline RedisBuffer(std::vector<char> buf);
+    inline RedisBuffer(Key key);
 
     inline size_t size() const;
 
-    boost::variant<std::string,std::vector<char>> data;
+    // Pointer to the size() bytes of the buffer.
+    inline const char *bytes() const;
+
+    boost::variant<std::string,std::vector<char>,Key> data;
 };
 
 
@@ -50,12 +55,29 @@ RedisBuffer::RedisBuffer(std::vector<char> buf)
 {
 }
 
+RedisBuffer::RedisBuffer(Key key)
+    : data(std::move(key))
+{
+}
+
 size_t RedisBuffer::size() const
 {
     if (data.type() == typeid(std::string))
         return boost::get<std::string>(data).size();
-    else
+    else if (data.type() == typeid(std::vector<char>))
         return boost::get<std::vector<char>>(data).size();
+    else
+        return boost::get<Key>(data).size();
+}
+
+const char *RedisBuffer::bytes() const
+{
+    if (data.type() == typeid(std::string))
+        return boost::get<std::string>(data).data();
+    else if (data.type() == typeid(std::vector<char>))
+        return boost::get<std::vector<char>>(data).data();
+    else
+        return boost::get<Key>(data).data();
 }
 
 }
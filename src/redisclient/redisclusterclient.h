@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REDISCLUSTERCLIENT_H
+#define REDISCLIENT_REDISCLUSTERCLIENT_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redisclient/clusterslot.h"
+#include "redisclient/redisasyncclient.h"
+#include "redisclient/impl/scattergather.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Client of a Redis Cluster. Keeps a 16384-entry slot -> node table
+// loaded by CLUSTER SLOTS and one RedisAsyncClient per node, connected
+// on first use (with auto reconnect). A command goes to the node of the
+// slot of its key; a MOVED reply updates that slot, reloads the table
+// (at most once per refreshInterval) and resends the command to the new
+// node; an ASK reply resends it once to the given node after ASKING.
+// Nodes are addressed by IP as reported by the cluster. Like
+// RedisAsyncClient, use it from the io_service thread.
+class RedisClusterClient : boost::noncopyable {
+public:
+    // configure, if set, is called for each node client before connect
+    // (ConnectOptions, command timeout, ...).
+    REDIS_CLIENT_DECL RedisClusterClient(boost::asio::io_service &ioService,
+            std::function<void(RedisAsyncClient &)> configure = nullptr);
+    REDIS_CLIENT_DECL ~RedisClusterClient();
+
+    // Load the slot table from the first seed node that answers.
+    // Handler is called with not_connected if none does.
+    REDIS_CLIENT_DECL void connect(
+            const std::vector<boost::asio::ip::tcp::endpoint> &seeds,
+            std::function<void(boost::system::error_code)> handler);
+
+    // Disconnect all nodes; commands waiting for a reply are dropped.
+    REDIS_CLIENT_DECL void disconnect();
+
+    // Execute command on the node of the slot of args.front(), the key
+    // of most commands. Commands without arguments go to any node.
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Execute command on the node of slot, e.g. for commands with the key
+    // at another position (EVAL) or several keys with one hash tag.
+    REDIS_CLIENT_DECL void command(uint16_t slot,
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Execute commands (command name first, as for
+    // RedisSyncClient::pipelined()) split by node: the commands of each
+    // node are pipelined on its connection, all nodes at once. Handler
+    // gets the array of replies in the order of commands. Only commands
+    // redirected by MOVED/ASK are sent again. A transaction (WATCH or
+    // MULTI up to EXEC or DISCARD) goes as a whole to the node of its
+    // first key; its commands are not redirected, so with a stale slot
+    // table it fails (EXECABORT) instead of being split.
+    REDIS_CLIENT_DECL void pipelined(std::deque<std::deque<RedisBuffer>> commands,
+            std::function<void(RedisValue)> handler);
+
+    // Multi-key commands over keys of any slots, sent as one command per
+    // slot (all at once) and merged in the order of keys. mget() gives
+    // an array of values, with the error of a slot for its keys; mset()
+    // gives OK or the first error; the others the sum of the counts.
+    REDIS_CLIENT_DECL void mget(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler);
+    REDIS_CLIENT_DECL void mset(const std::vector<std::pair<std::string, RedisBuffer>> &items,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void del(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void unlink(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void exists(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler);
+    REDIS_CLIENT_DECL void touch(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Reload the slot table, unless it was loaded within refreshInterval.
+    REDIS_CLIENT_DECL void refreshSlots();
+
+    // Min time between two slot table reloads. 1 second by default.
+    REDIS_CLIENT_DECL RedisClusterClient &setRefreshInterval(
+            const boost::posix_time::time_duration &interval);
+
+    // Max MOVED/ASK redirections followed per command. 5 by default.
+    REDIS_CLIENT_DECL RedisClusterClient &setMaxRedirects(size_t redirects);
+
+    // Address ("ip:port") of the node serving slot, empty if unknown.
+    REDIS_CLIENT_DECL std::string slotNode(uint16_t slot) const;
+
+private:
+    struct Request {
+        std::string cmd;
+        // Kept for redirections, the node client gets a copy.
+        std::deque<RedisBuffer> args;
+        std::function<void(RedisValue)> handler;
+        size_t redirects;
+    };
+
+    struct Node {
+        Node(boost::asio::io_service &ioService)
+            : client(ioService), connected(false), pending(0)
+        {
+        }
+
+        RedisAsyncClient client;
+        std::string address;
+        bool connected;
+        size_t pending; // commands waiting for a reply
+        // Requests (and their ASK flag) sent before the connection is up.
+        std::vector<std::pair<std::shared_ptr<Request>, bool>> waiting;
+    };
+
+    struct NodeEntry {
+        std::string address;
+        std::shared_ptr<Node> node; // null until used or after a failure
+    };
+
+    static const uint16_t noNode = 0xffff;
+
+    REDIS_CLIENT_DECL static RedisValue clusterError(const std::string &message);
+    REDIS_CLIENT_DECL static uint16_t bufferSlot(const RedisBuffer &key);
+    REDIS_CLIENT_DECL static std::string bufferString(const RedisBuffer &buffer);
+
+    REDIS_CLIENT_DECL uint16_t route(uint16_t slot) const;
+    REDIS_CLIENT_DECL void scatter(const std::string &cmd, ScatterGather::Merge merge,
+            const std::vector<std::string> &keys, const std::vector<RedisBuffer> *values,
+            std::function<void(RedisValue)> handler);
+    REDIS_CLIENT_DECL uint16_t addNode(const std::string &address);
+    REDIS_CLIENT_DECL uint16_t anyNode() const;
+    REDIS_CLIENT_DECL std::shared_ptr<Node> connection(uint16_t index);
+    REDIS_CLIENT_DECL void handleConnect(uint16_t index, std::weak_ptr<Node> weakNode,
+            boost::system::error_code ec);
+
+    REDIS_CLIENT_DECL void send(uint16_t index, std::shared_ptr<Request> request, bool asking);
+    REDIS_CLIENT_DECL void issue(const std::shared_ptr<Node> &node,
+            std::shared_ptr<Request> request, bool asking);
+    REDIS_CLIENT_DECL void handleReply(const std::shared_ptr<Node> &node,
+            const std::shared_ptr<Request> &request, RedisValue value);
+    REDIS_CLIENT_DECL bool redirect(const std::shared_ptr<Request> &request,
+            const std::string &message);
+
+    REDIS_CLIENT_DECL void loadSlots(uint16_t index, std::function<void(bool)> done);
+    REDIS_CLIENT_DECL bool applySlots(const RedisValue &reply, const std::string &queried);
+    REDIS_CLIENT_DECL void connectSeed(size_t seed,
+            std::function<void(boost::system::error_code)> handler);
+    REDIS_CLIENT_DECL void retire(const std::shared_ptr<Node> &node);
+
+    boost::asio::io_service &ioService;
+    std::function<void(RedisAsyncClient &)> configure;
+
+    std::vector<boost::asio::ip::tcp::endpoint> seeds;
+    std::vector<uint16_t> slots; // index into nodes for each slot
+    std::vector<NodeEntry> nodes;
+    std::map<std::string, uint16_t> nodeIndex;
+    // Nodes no longer in the table, until their replies arrive.
+    std::vector<std::shared_ptr<Node>> retired;
+
+    std::chrono::steady_clock::duration refreshInterval;
+    std::chrono::steady_clock::time_point lastRefresh;
+    bool refreshing;
+    size_t maxRedirects;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/redisclusterclient.cpp"
+#endif
+
+#endif // REDISCLIENT_REDISCLUSTERCLIENT_H
@@ -16,6 +16,7 @@
 #include "redisclient/impl/redisclientimpl.h"
 #include "redisbuffer.h"
 #include "redisvalue.h"
+#include "connectoptions.h"
 #include "config.h"
 
 namespace redisclient {
@@ -26,6 +27,8 @@ class Pipeline;
 class RedisSyncClient : boost::noncopyable {
 public:
     typedef RedisClientImpl::State State;
+    typedef RedisClientImpl::IoMode IoMode;
+    typedef RedisClientImpl::IoStats IoStats;
 
     REDIS_CLIENT_DECL RedisSyncClient(boost::asio::io_service &ioService);
     REDIS_CLIENT_DECL RedisSyncClient(RedisSyncClient &&other);
@@ -49,7 +52,8 @@ public:
             const boost::asio::local::stream_protocol::endpoint &endpoint);
 #endif
 
-    // Return true if is connected to redis.
+    // Return true if is connected to redis. An I/O error or a timeout
+    // in command() or pipelined() closes the connection.
     REDIS_CLIENT_DECL bool isConnected() const;
 
     // disconnect from redis
@@ -68,6 +72,13 @@ public:
             std::string cmd, std::deque<RedisBuffer> args,
             boost::system::error_code &ec);
 
+    // Same as above, with a timeout for this command instead of the one
+    // set by setCommandTimeout().
+    REDIS_CLIENT_DECL RedisValue command(
+            std::string cmd, std::deque<RedisBuffer> args,
+            const boost::posix_time::time_duration &timeout,
+            boost::system::error_code &ec);
+
     // Create pipeline (see Pipeline)
     REDIS_CLIENT_DECL Pipeline pipelined();
 
@@ -86,11 +97,33 @@ public:
     REDIS_CLIENT_DECL RedisSyncClient &setCommandTimeout(
             const boost::posix_time::time_duration &timeout);
 
+    // Setup commands (AUTH, SELECT, ...) pipelined in one round trip by
+    // connect(). On failure connect() reports permission_denied (AUTH,
+    // HELLO) or invalid_argument and the connection is closed.
+    REDIS_CLIENT_DECL RedisSyncClient &setConnectOptions(const ConnectOptions &options);
+
     REDIS_CLIENT_DECL RedisSyncClient &setTcpNoDelay(bool enable);
     REDIS_CLIENT_DECL RedisSyncClient &setTcpKeepAlive(bool enable);
 
+    // Select socket I/O strategy. See RedisClientImpl::IoMode.
+    REDIS_CLIENT_DECL RedisSyncClient &setIoMode(IoMode mode);
+
+    // Switch to IoMode::BusyPoll: spin on recv() up to budget before
+    // blocking. If soBusyPoll is set, SO_BUSY_POLL is also set on TCP
+    // sockets on connect (Linux only, may require CAP_NET_ADMIN).
+    REDIS_CLIENT_DECL RedisSyncClient &setBusyPoll(
+            const boost::posix_time::time_duration &budget,
+            bool soBusyPoll = false);
+
+    // Return syscall counters of command() and pipelined().
+    REDIS_CLIENT_DECL IoStats ioStats() const;
+    REDIS_CLIENT_DECL void resetIoStats();
+
 protected:
     REDIS_CLIENT_DECL bool stateValid() const;
+    REDIS_CLIENT_DECL void handshake(boost::system::error_code &ec);
+    REDIS_CLIENT_DECL void fail(const boost::system::error_code &error,
+            boost::system::error_code &ec);
 
 private:
     std::shared_ptr<RedisClientImpl> pimpl;
@@ -98,6 +131,7 @@ private:
     boost::posix_time::time_duration commandTimeout;
     bool tcpNoDelay;
     bool tcpKeepAlive;
+    bool soBusyPoll;
 };
 
 }
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REPLICATEDASYNCCLIENT_H
+#define REDISCLIENT_REPLICATEDASYNCCLIENT_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "redisclient/commandtable.h"
+#include "redisclient/redisasyncclient.h"
+#include "redisclient/impl/replicaselector.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Client of a primary and its replicas. Read-only commands (see
+// isReadOnlyCommand()) go to the connected replica with the lowest
+// latency EWMA times outstanding commands, others to the primary.
+// Disconnected replicas are skipped; with none left, reads go to the
+// primary too. A replica notices a lost connection only with auto
+// reconnect enabled (replica(i).setAutoReconnect()).
+class ReplicatedAsyncClient : boost::noncopyable {
+public:
+    REDIS_CLIENT_DECL ReplicatedAsyncClient(boost::asio::io_service &ioService,
+            size_t replicas);
+
+    // Connect the primary and the replicas. Handler is called once with
+    // the error of the primary; replicas failing to connect are skipped.
+    REDIS_CLIENT_DECL void connect(
+            const boost::asio::ip::tcp::endpoint &primary,
+            const std::vector<boost::asio::ip::tcp::endpoint> &replicas,
+            std::function<void(boost::system::error_code)> handler);
+
+    REDIS_CLIENT_DECL void disconnect();
+
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    REDIS_CLIENT_DECL void command(Route route,
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Clients, e.g. to set options before connect().
+    REDIS_CLIENT_DECL RedisAsyncClient &primary();
+    REDIS_CLIENT_DECL RedisAsyncClient &replica(size_t index);
+    REDIS_CLIENT_DECL size_t replicas() const;
+
+    // Latency EWMA of a replica, zero before its first reply.
+    REDIS_CLIENT_DECL boost::posix_time::time_duration replicaLatency(size_t index) const;
+    REDIS_CLIENT_DECL size_t replicaPending(size_t index) const;
+
+private:
+    struct Outstanding;
+
+    REDIS_CLIENT_DECL size_t selectReplica() const;
+
+    RedisAsyncClient primaryClient;
+    std::vector<std::unique_ptr<RedisAsyncClient>> replicaClients;
+    std::shared_ptr<ReplicaSelector> selector;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/replicatedasyncclient.cpp"
+#endif
+
+#endif // REDISCLIENT_REPLICATEDASYNCCLIENT_H
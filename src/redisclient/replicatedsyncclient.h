@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_REPLICATEDSYNCCLIENT_H
+#define REDISCLIENT_REPLICATEDSYNCCLIENT_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include "redisclient/commandtable.h"
+#include "redisclient/redissyncclient.h"
+#include "redisclient/impl/replicaselector.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Synchronous counterpart of ReplicatedAsyncClient: read-only commands
+// go to the connected replica with the lowest latency EWMA, others to
+// the primary. Replicas broken by an I/O error or timeout are skipped.
+class ReplicatedSyncClient : boost::noncopyable {
+public:
+    REDIS_CLIENT_DECL ReplicatedSyncClient(boost::asio::io_service &ioService,
+            size_t replicas);
+
+    // Connect the primary and the replicas. Reports (or throws) the error
+    // of the primary; replicas failing to connect are skipped.
+    REDIS_CLIENT_DECL void connect(
+            const boost::asio::ip::tcp::endpoint &primary,
+            const std::vector<boost::asio::ip::tcp::endpoint> &replicas,
+            boost::system::error_code &ec);
+
+    REDIS_CLIENT_DECL void connect(
+            const boost::asio::ip::tcp::endpoint &primary,
+            const std::vector<boost::asio::ip::tcp::endpoint> &replicas);
+
+    REDIS_CLIENT_DECL void disconnect();
+
+    REDIS_CLIENT_DECL RedisValue command(
+            std::string cmd, std::deque<RedisBuffer> args);
+
+    REDIS_CLIENT_DECL RedisValue command(
+            std::string cmd, std::deque<RedisBuffer> args,
+            boost::system::error_code &ec);
+
+    REDIS_CLIENT_DECL RedisValue command(Route route,
+            std::string cmd, std::deque<RedisBuffer> args);
+
+    REDIS_CLIENT_DECL RedisValue command(Route route,
+            std::string cmd, std::deque<RedisBuffer> args,
+            boost::system::error_code &ec);
+
+    // Clients, e.g. to set options before connect().
+    REDIS_CLIENT_DECL RedisSyncClient &primary();
+    REDIS_CLIENT_DECL RedisSyncClient &replica(size_t index);
+    REDIS_CLIENT_DECL size_t replicas() const;
+
+    // Latency EWMA of a replica, zero before its first reply.
+    REDIS_CLIENT_DECL boost::posix_time::time_duration replicaLatency(size_t index) const;
+
+private:
+    REDIS_CLIENT_DECL RedisSyncClient &route(Route route, const std::string &cmd,
+            size_t &index);
+
+    RedisSyncClient primaryClient;
+    std::vector<RedisSyncClient> replicaClients;
+    ReplicaSelector selector;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/replicatedsyncclient.cpp"
+#endif
+
+#endif // REDISCLIENT_REPLICATEDSYNCCLIENT_H
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_SHARDEDCLIENT_H
+#define REDISCLIENT_SHARDEDCLIENT_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redisclient/hashring.h"
+#include "redisclient/key.h"
+#include "redisclient/redisasyncclient.h"
+#include "redisclient/impl/scattergather.h"
+#include "config.h"
+
+namespace redisclient {
+
+// Client-side sharding over standalone Redis servers: one
+// RedisAsyncClient per shard, keys placed on a HashRing by their hash
+// tag. Pipelines and multi-key commands are split by shard and sent to
+// all shards at once. Like RedisAsyncClient, use it from the io_service
+// thread. For RedisSyncClient backends route with a HashRing directly.
+class ShardedClient : boost::noncopyable {
+public:
+    REDIS_CLIENT_DECL explicit ShardedClient(boost::asio::io_service &ioService,
+            size_t pointsPerShard = HashRing::defaultPoints);
+    REDIS_CLIENT_DECL ~ShardedClient();
+
+    // Add a shard and return its index. name places it on the ring and
+    // defaults to "ip:port" of endpoint. Keys of the other shards move
+    // only to the new one. A shard added after connect() is connected
+    // by the next connect() and gets commands only after that.
+    REDIS_CLIENT_DECL size_t addShard(const boost::asio::ip::tcp::endpoint &endpoint,
+            const std::string &name = std::string(), size_t weight = 1);
+
+    // Connect the shards not connected yet, all at once. Handler gets
+    // the first error, if any.
+    REDIS_CLIENT_DECL void connect(std::function<void(boost::system::error_code)> handler);
+
+    // Disconnect all shards; commands waiting for a reply are dropped.
+    REDIS_CLIENT_DECL void disconnect();
+
+    // Execute command on the shard of args.front(), the key of most
+    // commands. Commands without arguments go to shard 0.
+    REDIS_CLIENT_DECL void command(
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Execute command on a shard, e.g. for commands with the key at
+    // another position (EVAL) or to reach every server.
+    REDIS_CLIENT_DECL void command(size_t shard,
+            const std::string &cmd, std::deque<RedisBuffer> args,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Execute commands (command name first, as for
+    // RedisSyncClient::pipelined()) split by shard: the commands of each
+    // shard are pipelined on its connection, all shards at once. Handler
+    // gets the array of replies in the order of commands. A transaction
+    // (WATCH or MULTI up to EXEC or DISCARD) goes as a whole to the shard
+    // of its first key.
+    REDIS_CLIENT_DECL void pipelined(std::deque<std::deque<RedisBuffer>> commands,
+            std::function<void(RedisValue)> handler);
+
+    // Multi-key commands over keys of any shards, sent as one command per
+    // shard and merged in the order of keys, as by RedisClusterClient.
+    REDIS_CLIENT_DECL void mget(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler);
+    REDIS_CLIENT_DECL void mset(const std::vector<std::pair<std::string, RedisBuffer>> &items,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void del(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void unlink(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+    REDIS_CLIENT_DECL void exists(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler);
+    REDIS_CLIENT_DECL void touch(const std::vector<std::string> &keys,
+            std::function<void(RedisValue)> handler = RedisAsyncClient::dummyHandler);
+
+    // Shard of a key.
+    REDIS_CLIENT_DECL size_t shardOf(const std::string &key) const;
+    REDIS_CLIENT_DECL size_t shardOf(const Key &key) const;
+
+    // Clients, e.g. to set options before connect().
+    REDIS_CLIENT_DECL RedisAsyncClient &shard(size_t index);
+    REDIS_CLIENT_DECL size_t shards() const;
+
+    REDIS_CLIENT_DECL const HashRing &ring() const;
+
+private:
+    struct Shard {
+        Shard(boost::asio::io_service &ioService,
+                const boost::asio::ip::tcp::endpoint &endpoint)
+            : client(ioService), endpoint(endpoint), connected(false)
+        {
+        }
+
+        RedisAsyncClient client;
+        boost::asio::ip::tcp::endpoint endpoint;
+        bool connected; // the first connect() succeeded
+    };
+
+    REDIS_CLIENT_DECL static RedisValue shardError(const std::string &message);
+    REDIS_CLIENT_DECL static std::string bufferString(const RedisBuffer &buffer);
+    REDIS_CLIENT_DECL size_t bufferShard(const RedisBuffer &key) const;
+    REDIS_CLIENT_DECL bool ready(size_t index) const;
+
+    REDIS_CLIENT_DECL void scatter(const std::string &cmd, ScatterGather::Merge merge,
+            const std::vector<std::string> &keys, const std::vector<RedisBuffer> *values,
+            std::function<void(RedisValue)> handler);
+
+    boost::asio::io_service &ioService;
+    HashRing hashRing;
+    std::vector<std::shared_ptr<Shard>> shardList;
+};
+
+}
+
+#ifdef REDIS_CLIENT_HEADER_ONLY
+#include "redisclient/impl/shardedclient.cpp"
+#endif
+
+#endif // REDISCLIENT_SHARDEDCLIENT_H
@@ -0,0 +1,150 @@
+#define BOOST_TEST_MODULE asyncclientpool
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <redisclient/asyncclientpool.h>
+
+#include "mockredisserver.h"
+
+using redisclient::AsyncClientPool;
+using redisclient::RedisValue;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : pool(ioService, 2)
+        {
+            // HANG never gets a reply.
+            server.setHandler([this](const MockRedisServer::Command &command) {
+                return command[0] == "HANG" ? std::string() : server.defaultReply(command);
+            });
+
+            for(size_t i = 0; i < pool.size(); ++i)
+            {
+                pool.client(i).installErrorHandler([this](const std::string &s) {
+                    errors.push_back(s);
+                });
+            }
+        }
+
+        void connect()
+        {
+            bool connected = false;
+
+            pool.connect(server.endpoint(), [&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        size_t pending(size_t index) const
+        {
+            return pool.stats()[index].pending;
+        }
+
+        MockRedisServer server;
+        boost::asio::io_service ioService;
+        AsyncClientPool pool;
+        std::vector<std::string> errors;
+    };
+}
+
+BOOST_FIXTURE_TEST_CASE(routes_to_least_outstanding, Fixture)
+{
+    connect();
+
+    pool.command("HANG", {});
+
+    BOOST_CHECK_EQUAL(pending(0), 1u);
+
+    bool done = false;
+
+    pool.command("PING", {}, [&done](RedisValue v) {
+        BOOST_CHECK_EQUAL(v.toString(), "PONG");
+        done = true;
+    });
+
+    BOOST_CHECK_EQUAL(pending(1), 1u);
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_CHECK_EQUAL(pending(0), 1u);
+    BOOST_CHECK_EQUAL(pending(1), 0u);
+    BOOST_CHECK_EQUAL(pool.stats()[1].bytes, 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(dropped_command_is_not_counted, Fixture)
+{
+    connect();
+
+    bool called = false;
+
+    pool.commandByKey("key", "HANG", {}, [&called](RedisValue) { called = true; });
+
+    size_t index = pending(0) == 1 ? 0 : 1;
+
+    BOOST_REQUIRE_EQUAL(pending(index), 1u);
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return server.countCommands("HANG") == 1; }));
+
+    // Closed behind the pool's back: the handler is dropped unrun.
+    pool.client(index).disconnect();
+
+    BOOST_CHECK(!called);
+    BOOST_CHECK_EQUAL(pending(index), 0u);
+    BOOST_CHECK_EQUAL(pool.stats()[index].bytes, 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(disconnect_releases_counters, Fixture)
+{
+    connect();
+
+    pool.command("HANG", {});
+    pool.command("HANG", {});
+    pool.command("HANG", {});
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("HANG") == 3;
+    }));
+    BOOST_CHECK_EQUAL(pending(0) + pending(1), 3u);
+
+    pool.disconnect();
+
+    BOOST_CHECK_EQUAL(pending(0), 0u);
+    BOOST_CHECK_EQUAL(pending(1), 0u);
+    BOOST_CHECK_EQUAL(pool.stats()[0].bytes, 0u);
+    BOOST_CHECK_EQUAL(pool.stats()[1].bytes, 0u);
+
+    // Reconnected, the counters start from zero and stay balanced.
+    connect();
+
+    bool done = false;
+
+    pool.command("PING", {}, [&done](RedisValue) { done = true; });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_CHECK_EQUAL(pending(0), 0u);
+    BOOST_CHECK_EQUAL(pending(1), 0u);
+}
@@ -0,0 +1,147 @@
+#define BOOST_TEST_MODULE cancellation
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <redisclient/cancellationtoken.h>
+#include <redisclient/redisasyncclient.h>
+
+#include "mockredisserver.h"
+
+using redisclient::CancellationToken;
+using redisclient::RedisAsyncClient;
+using redisclient::RedisValue;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : client(ioService)
+        {
+            bool connected = false;
+
+            client.connect(server.endpoint(), [&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        bool wasSent(const MockRedisServer::Command &command) const
+        {
+            std::vector<MockRedisServer::Command> commands = server.commands();
+
+            return std::find(commands.begin(), commands.end(), command) != commands.end();
+        }
+
+        MockRedisServer server;
+        boost::asio::io_service ioService;
+        RedisAsyncClient client;
+    };
+
+    // Size of SET key value as written to the socket.
+    size_t setSize(const std::string &key, const std::string &value)
+    {
+        return std::string("*3\r\n$3\r\nSET\r\n$" + std::to_string(key.size()) + "\r\n" +
+                key + "\r\n$" + std::to_string(value.size()) + "\r\n" + value + "\r\n").size();
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(expired_command_is_not_sent, Fixture)
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::vector<RedisValue> replies;
+    bool done = false;
+
+    client.command("SET", {"a", "1"}, now + boost::posix_time::seconds(10),
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+    client.command("SET", {"b", "2"}, now - boost::posix_time::seconds(1),
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+    client.command("SET", {"c", "3"}, [&done](RedisValue) { done = true; });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_REQUIRE_EQUAL(replies.size(), 2u);
+
+    // Only the command past its deadline fails.
+    BOOST_CHECK_NE(replies[0].isError(), replies[1].isError());
+
+    for(const RedisValue &reply: replies)
+    {
+        if (reply.isError())
+            BOOST_CHECK_EQUAL(reply.toString(), "[RedisClient] command cancelled");
+        else
+            BOOST_CHECK(reply.isOk());
+    }
+
+    BOOST_CHECK(!wasSent({"SET", "b", "2"}));
+    BOOST_CHECK_EQUAL(server.countCommands("SET"), 2u);
+    BOOST_CHECK_EQUAL(client.cancelledCommands(), 1u);
+    BOOST_CHECK_EQUAL(client.cancelledBytes(), setSize("b", "2"));
+}
+
+BOOST_FIXTURE_TEST_CASE(cancelled_command_is_not_sent, Fixture)
+{
+    CancellationToken token;
+    CancellationToken other;
+    std::vector<RedisValue> replies;
+    bool done = false;
+
+    client.command("SET", {"a", "1"}, other,
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+    client.command("SET", {"bb", "22"}, token,
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+    client.command("SET", {"ccc", "333"}, token,
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+
+    // Still queued: posted to the io_service, which is not running.
+    token.cancel();
+    BOOST_CHECK(token.cancelled());
+    BOOST_CHECK(!other.cancelled());
+
+    client.command("SET", {"d", "4"}, [&done](RedisValue) { done = true; });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_REQUIRE_EQUAL(replies.size(), 3u);
+
+    size_t cancelled = 0;
+
+    for(const RedisValue &reply: replies)
+    {
+        if (reply.isError())
+        {
+            BOOST_CHECK_EQUAL(reply.toString(), "[RedisClient] command cancelled");
+            ++cancelled;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(cancelled, 2u);
+    BOOST_CHECK(wasSent({"SET", "a", "1"}));
+    BOOST_CHECK(!wasSent({"SET", "bb", "22"}));
+    BOOST_CHECK(!wasSent({"SET", "ccc", "333"}));
+    BOOST_CHECK_EQUAL(server.countCommands("SET"), 2u);
+    BOOST_CHECK_EQUAL(client.cancelledCommands(), 2u);
+    BOOST_CHECK_EQUAL(client.cancelledBytes(), setSize("bb", "22") + setSize("ccc", "333"));
+}
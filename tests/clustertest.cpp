@@ -0,0 +1,267 @@
+#define BOOST_TEST_MODULE cluster
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <redisclient/redisclusterclient.h>
+
+#include "mockrediscluster.h"
+
+using redisclient::RedisClusterClient;
+using redisclient::RedisValue;
+using redisclient::keySlot;
+using redisclient::test::MockRedisCluster;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    void runFor(boost::asio::io_service &ioService, std::chrono::milliseconds duration)
+    {
+        ioService.restart();
+        ioService.run_for(duration);
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : cluster(3), client(ioService)
+        {
+            bool connected = false;
+
+            client.connect(cluster.seeds(), [&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        // Send a command and wait for its reply.
+        RedisValue command(const std::string &cmd, std::deque<redisclient::RedisBuffer> args)
+        {
+            bool done = false;
+            RedisValue result;
+
+            client.command(cmd, std::move(args), [&done, &result](RedisValue v) {
+                result = std::move(v);
+                done = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+            return result;
+        }
+
+        size_t countCommands(const std::string &name)
+        {
+            size_t count = 0;
+
+            for(size_t i = 0; i < cluster.size(); ++i)
+                count += cluster.node(i).countCommands(name);
+
+            return count;
+        }
+
+        MockRedisCluster cluster;
+        boost::asio::io_service ioService;
+        RedisClusterClient client;
+    };
+}
+
+BOOST_FIXTURE_TEST_CASE(routes_by_slot, Fixture)
+{
+    BOOST_CHECK_EQUAL(cluster.slotRequests(), 1u);
+
+    for(size_t i = 0; i < cluster.size(); ++i)
+    {
+        std::string key = cluster.keyOf(i);
+
+        BOOST_CHECK_EQUAL(client.slotNode(keySlot(key)), cluster.node(i).address());
+        BOOST_CHECK(command("SET", {key, "v" + std::to_string(i)}).isOk());
+        BOOST_CHECK_EQUAL(command("GET", {key}).toString(), "v" + std::to_string(i));
+        BOOST_CHECK_EQUAL(cluster.node(i).countCommands("SET"), 1u);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(moved_updates_the_slot, Fixture)
+{
+    std::string key = cluster.keyOf(0);
+    uint16_t slot = keySlot(key);
+
+    cluster.moveSlot(slot, 1);
+
+    BOOST_CHECK(command("SET", {key, "value"}).isOk());
+    BOOST_CHECK_EQUAL(cluster.node(0).countCommands("SET"), 1u);
+    BOOST_CHECK_EQUAL(cluster.node(1).countCommands("SET"), 1u);
+    BOOST_CHECK_EQUAL(client.slotNode(slot), cluster.node(1).address());
+
+    // Sent to the new owner directly.
+    BOOST_CHECK_EQUAL(command("GET", {key}).toString(), "value");
+    BOOST_CHECK_EQUAL(cluster.node(0).countCommands("GET"), 0u);
+    BOOST_CHECK_EQUAL(cluster.node(1).countCommands("GET"), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(ask_sends_asking_first, Fixture)
+{
+    std::string key = cluster.keyOf(0);
+    uint16_t slot = keySlot(key);
+
+    cluster.migrateSlot(slot, 2);
+
+    BOOST_CHECK(command("SET", {key, "value"}).isOk());
+
+    std::vector<MockRedisServer::Command> commands = cluster.node(2).commands();
+
+    BOOST_REQUIRE_GE(commands.size(), 2u);
+    BOOST_CHECK(commands[commands.size() - 2] == MockRedisServer::Command({"ASKING"}));
+    BOOST_CHECK(commands.back() == MockRedisServer::Command({"SET", key, "value"}));
+
+    // ASK does not change the table, the next command goes to the owner.
+    BOOST_CHECK_EQUAL(client.slotNode(slot), cluster.node(0).address());
+    BOOST_CHECK_EQUAL(command("GET", {key}).toString(), "value");
+    BOOST_CHECK_EQUAL(cluster.node(0).countCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(cluster.node(2).countCommands("ASKING"), 2u);
+}
+
+BOOST_FIXTURE_TEST_CASE(redirects_are_capped, Fixture)
+{
+    std::string key = cluster.keyOf(0);
+
+    cluster.loopSlot(keySlot(key));
+    client.setMaxRedirects(3);
+
+    RedisValue result = command("GET", {key});
+
+    BOOST_CHECK(result.isError());
+    BOOST_CHECK_EQUAL(result.toString().compare(0, 6, "MOVED "), 0);
+    BOOST_CHECK_EQUAL(countCommands("GET"), 4u);
+}
+
+BOOST_FIXTURE_TEST_CASE(slot_refresh_is_throttled, Fixture)
+{
+    // Within refreshInterval (1 s) of connect(): no reload.
+    cluster.moveSlot(keySlot(cluster.keyOf(0, 0)), 1);
+    BOOST_CHECK(command("GET", {cluster.keyOf(1, 0)}).isNull());
+    BOOST_CHECK(command("GET", {cluster.keyOf(0, 0)}).isNull());
+    BOOST_CHECK_EQUAL(cluster.slotRequests(), 1u);
+
+    client.setRefreshInterval(boost::posix_time::milliseconds(20));
+    runFor(ioService, std::chrono::milliseconds(30));
+
+    // One reload for MOVED replies arriving together.
+    std::vector<std::string> keys;
+
+    for(size_t n = 1; n <= 4; ++n)
+    {
+        keys.push_back(cluster.keyOf(0, n));
+        cluster.moveSlot(keySlot(keys.back()), 2);
+    }
+
+    size_t replies = 0;
+
+    for(const std::string &key: keys)
+    {
+        client.command("GET", {key}, [&replies](RedisValue v) {
+            BOOST_CHECK(v.isNull());
+            ++replies;
+        });
+    }
+
+    BOOST_REQUIRE(runUntil(ioService, [&replies]() { return replies == 4; }));
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return cluster.slotRequests() == 2; }));
+    runFor(ioService, std::chrono::milliseconds(30));
+    BOOST_CHECK_EQUAL(cluster.slotRequests(), 2u);
+
+    // The reloaded table has all moved slots.
+    for(const std::string &key: keys)
+        BOOST_CHECK_EQUAL(client.slotNode(keySlot(key)), cluster.node(2).address());
+}
+
+BOOST_FIXTURE_TEST_CASE(pipeline_replies_keep_order, Fixture)
+{
+    std::string keys[3] = { cluster.keyOf(0), cluster.keyOf(1), cluster.keyOf(2) };
+    std::string other = cluster.keyOf(2, 1);
+    bool done = false;
+    RedisValue result;
+
+    // A transaction starting on a keyless MULTI goes to the node of SET.
+    client.pipelined({
+            {"SET", keys[0], "a"},
+            {"SET", keys[1], "b"},
+            {"MULTI"},
+            {"SET", keys[2], "c"},
+            {"GET", keys[2]},
+            {"EXEC"},
+            {"GET", keys[1]},
+            {"GET", keys[0]},
+            {"WATCH", other},
+            {"MULTI"},
+            {"INCR", other},
+            {"EXEC"}
+        }, [&done, &result](RedisValue v) {
+            result = std::move(v);
+            done = true;
+        });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_REQUIRE(result.isArray());
+
+    const std::vector<RedisValue> &replies = result.getArray();
+
+    BOOST_REQUIRE_EQUAL(replies.size(), 12u);
+    BOOST_CHECK(replies[0].isOk());
+    BOOST_CHECK(replies[1].isOk());
+    BOOST_CHECK(replies[2].isOk());
+    BOOST_CHECK_EQUAL(replies[4].toString(), "c");
+    BOOST_CHECK(replies[5].isArray());
+    BOOST_CHECK_EQUAL(replies[6].toString(), "b");
+    BOOST_CHECK_EQUAL(replies[7].toString(), "a");
+    BOOST_CHECK_EQUAL(replies[10].toInt(), 1);
+
+    std::vector<MockRedisServer::Command> expected = {
+        {"MULTI"}, {"SET", keys[2], "c"}, {"GET", keys[2]}, {"EXEC"},
+        {"WATCH", other}, {"MULTI"}, {"INCR", other}, {"EXEC"}
+    };
+
+    BOOST_CHECK(cluster.node(2).commands() == expected);
+    BOOST_CHECK_EQUAL(countCommands("MULTI"), 2u);
+}
+
+BOOST_FIXTURE_TEST_CASE(transaction_is_not_redirected, Fixture)
+{
+    std::string key = cluster.keyOf(0);
+
+    cluster.moveSlot(keySlot(key), 1);
+
+    bool done = false;
+    RedisValue result;
+
+    client.pipelined({{"MULTI"}, {"SET", key, "v"}, {"EXEC"}},
+            [&done, &result](RedisValue v) {
+                result = std::move(v);
+                done = true;
+            });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_REQUIRE_EQUAL(result.getArray().size(), 3u);
+    BOOST_CHECK(result.getArray()[1].isError());
+    BOOST_CHECK_EQUAL(cluster.node(1).countCommands("SET"), 0u);
+}
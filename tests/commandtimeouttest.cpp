@@ -0,0 +1,147 @@
+#define BOOST_TEST_MODULE commandtimeout
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <redisclient/redisasyncclient.h>
+#include <redisclient/impl/timingwheel.h>
+
+#include "mockredisserver.h"
+
+using redisclient::RedisAsyncClient;
+using redisclient::RedisValue;
+using redisclient::TimingWheel;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    void runFor(boost::asio::io_service &ioService, std::chrono::milliseconds duration)
+    {
+        ioService.restart();
+        ioService.run_for(duration);
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : client(ioService)
+        {
+            // GET of "slow" is answered after 200 ms.
+            server.setHandler([this](const MockRedisServer::Command &command) {
+                if (command[0] == "GET" && command.size() == 2 && command[1] == "slow")
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                return server.defaultReply(command);
+            });
+
+            bool connected = false;
+
+            client.connect(server.endpoint(), [&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        MockRedisServer server;
+        boost::asio::io_service ioService;
+        RedisAsyncClient client;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(wheel_fires_expired_timers_only)
+{
+    TimingWheel wheel(4, boost::posix_time::milliseconds(10));
+    std::vector<int> fired;
+
+    wheel.add(boost::posix_time::milliseconds(30), [&fired]() { fired.push_back(1); });
+
+    TimingWheel::TimerPtr cancelled = wheel.add(boost::posix_time::milliseconds(30),
+            [&fired]() { fired.push_back(2); });
+
+    // Seven ticks on four slots: comes up once before it expires.
+    wheel.add(boost::posix_time::milliseconds(70), [&fired]() { fired.push_back(3); });
+
+    TimingWheel::cancel(cancelled);
+
+    wheel.tick();
+    wheel.tick();
+    BOOST_CHECK(fired.empty());
+
+    wheel.tick();
+    BOOST_CHECK(fired == std::vector<int>({1}));
+    BOOST_CHECK(!wheel.empty());
+
+    for(int i = 0; i < 3; ++i)
+        wheel.tick();
+
+    BOOST_CHECK(fired == std::vector<int>({1}));
+
+    wheel.tick();
+    BOOST_CHECK(fired == std::vector<int>({1, 3}));
+    BOOST_CHECK(wheel.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(late_reply_is_discarded, Fixture)
+{
+    client.command("SET", {"slow", "a"});
+
+    std::vector<RedisValue> first;
+
+    client.command("GET", {"slow"}, boost::posix_time::milliseconds(20),
+            [&first](RedisValue v) { first.push_back(std::move(v)); });
+
+    BOOST_REQUIRE(runUntil(ioService, [&first]() { return !first.empty(); }));
+    BOOST_CHECK(first[0].isError());
+    BOOST_CHECK_EQUAL(first[0].toString(), "[RedisClient] command timeout");
+
+    // Sent while the reply of GET is still due, it must not take it.
+    bool done = false;
+    RedisValue second;
+
+    client.command("ECHO", {"b"}, [&done, &second](RedisValue v) {
+        second = std::move(v);
+        done = true;
+    });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_CHECK_EQUAL(second.toString(), "b");
+    BOOST_CHECK_EQUAL(first.size(), 1u);
+    BOOST_CHECK(client.isConnected());
+}
+
+BOOST_FIXTURE_TEST_CASE(answered_command_does_not_time_out, Fixture)
+{
+    std::vector<RedisValue> replies;
+
+    client.command("PING", {}, boost::posix_time::milliseconds(30),
+            [&replies](RedisValue v) { replies.push_back(std::move(v)); });
+
+    BOOST_REQUIRE(runUntil(ioService, [&replies]() { return !replies.empty(); }));
+
+    // Past the timeout: the cancelled timer does not call the handler again.
+    runFor(ioService, std::chrono::milliseconds(80));
+
+    BOOST_REQUIRE_EQUAL(replies.size(), 1u);
+    BOOST_CHECK_EQUAL(replies[0].toString(), "PONG");
+}
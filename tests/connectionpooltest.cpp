@@ -0,0 +1,301 @@
+#define BOOST_TEST_MODULE connectionpool
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <redisclient/connectionpool.h>
+
+#include "mockredisserver.h"
+
+using redisclient::ConnectionPool;
+using redisclient::ConnectionPoolOptions;
+using redisclient::PooledConnection;
+using redisclient::RedisSyncClient;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Fixture
+    {
+        // Connect to the mock server, after delay() if set.
+        ConnectionPool::Factory factory()
+        {
+            return [this]() {
+                if (delay)
+                    delay();
+
+                RedisSyncClient client(ioService);
+
+                client.setCommandTimeout(boost::posix_time::seconds(1));
+                client.connect(server.endpoint());
+                return client;
+            };
+        }
+
+        MockRedisServer server;
+        boost::asio::io_service ioService;
+        std::function<void()> delay;
+    };
+
+    std::chrono::milliseconds elapsed(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(warm_up_connects_in_parallel, Fixture)
+{
+    delay = []() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); };
+
+    ConnectionPoolOptions options;
+
+    options.size = 4;
+    options.minIdle = 4;
+
+    Clock::time_point start = Clock::now();
+    ConnectionPool pool(factory(), options);
+
+    BOOST_CHECK_LT(elapsed(start).count(), 300);
+    BOOST_CHECK_EQUAL(pool.size(), 4u);
+    BOOST_CHECK(MockRedisServer::waitFor([this]() { return server.connections() == 4; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_connects_outside_the_lock, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 2;
+    options.minIdle = 1;
+
+    ConnectionPool pool(factory(), options);
+
+    // The next connect blocks until released.
+    std::promise<void> connecting;
+    std::promise<void> proceed;
+    std::shared_future<void> proceedFuture = proceed.get_future().share();
+
+    delay = [&connecting, proceedFuture]() {
+        connecting.set_value();
+        proceedFuture.wait();
+    };
+
+    PooledConnection first = pool.fetch();
+
+    std::thread creator([&pool]() {
+        PooledConnection second = pool.fetch();
+        BOOST_CHECK(second->command("PING", {}).toString() == "PONG");
+    });
+
+    connecting.get_future().wait();
+
+    // The idle connection is fetched while the other one connects.
+    first.release();
+
+    Clock::time_point start = Clock::now();
+    PooledConnection again = pool.fetch();
+
+    BOOST_CHECK_LT(elapsed(start).count(), 50);
+    BOOST_CHECK_EQUAL(again->command("PING", {}).toString(), "PONG");
+
+    proceed.set_value();
+    creator.join();
+
+    BOOST_CHECK_EQUAL(pool.size(), 2u);
+}
+
+BOOST_FIXTURE_TEST_CASE(failed_connect_frees_the_slot, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 1;
+    options.waitTimeout = boost::posix_time::seconds(1);
+
+    ConnectionPool pool(factory(), options);
+    std::atomic<bool> fail(true);
+
+    delay = [&fail]() {
+        if (fail)
+            throw std::runtime_error("connect failed");
+    };
+
+    boost::system::error_code ec;
+
+    BOOST_CHECK_THROW(pool.fetch(), std::runtime_error);
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+
+    fail = false;
+
+    PooledConnection connection = pool.fetch(ec);
+
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(connection);
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(fetch_and_return, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 2;
+
+    ConnectionPool pool(ioService, server.endpoint(), options,
+            [](RedisSyncClient &client) {
+                client.setCommandTimeout(boost::posix_time::seconds(1));
+            });
+
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+
+    {
+        PooledConnection connection = pool.fetch();
+
+        BOOST_CHECK(connection->command("SET", {"key", "value"}).isOk());
+        BOOST_CHECK_EQUAL(pool.size(), 1u);
+    }
+
+    // Given back on destruction and reused.
+    for(int i = 0; i < 3; ++i)
+    {
+        PooledConnection connection = pool.fetch();
+
+        BOOST_CHECK_EQUAL(connection->command("GET", {"key"}).toString(), "value");
+    }
+
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+    BOOST_CHECK(MockRedisServer::waitFor([this]() { return server.connections() == 1; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(wait_timeout_expires, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 1;
+    options.waitTimeout = boost::posix_time::milliseconds(50);
+
+    ConnectionPool pool(factory(), options);
+    PooledConnection held = pool.fetch();
+    boost::system::error_code ec;
+
+    Clock::time_point start = Clock::now();
+    PooledConnection connection = pool.fetch(ec);
+
+    BOOST_CHECK(ec == boost::asio::error::timed_out);
+    BOOST_CHECK(!connection);
+    BOOST_CHECK_GE(elapsed(start).count(), 50);
+    BOOST_CHECK_THROW(pool.fetch(), boost::system::system_error);
+
+    // A connection given back in time is handed over.
+    std::thread releaser([&held]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        held.release();
+    });
+
+    boost::system::error_code ec2;
+
+    connection = pool.fetch(ec2);
+    releaser.join();
+
+    BOOST_CHECK(!ec2);
+    BOOST_CHECK(connection);
+}
+
+BOOST_FIXTURE_TEST_CASE(broken_connection_is_discarded, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 1;
+
+    ConnectionPool pool(factory(), options);
+
+    {
+        PooledConnection connection = pool.fetch();
+
+        BOOST_CHECK_EQUAL(connection->command("PING", {}).toString(), "PONG");
+
+        // The server drops the connection.
+        server.stop();
+        server.start();
+
+        boost::system::error_code ec;
+
+        connection->command("PING", {}, ec);
+        BOOST_CHECK(ec);
+        BOOST_CHECK(!connection->isConnected());
+    }
+
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+
+    PooledConnection connection = pool.fetch();
+
+    BOOST_CHECK_EQUAL(connection->command("PING", {}).toString(), "PONG");
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+    BOOST_CHECK(MockRedisServer::waitFor([this]() { return server.connections() == 2; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(idle_broken_connection_is_replaced_on_fetch, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.size = 1;
+    options.minIdle = 1;
+
+    ConnectionPool pool(factory(), options);
+
+    {
+        PooledConnection connection = pool.fetch();
+        connection->disconnect();
+    }
+
+    BOOST_CHECK_EQUAL(pool.size(), 0u);
+
+    PooledConnection connection = pool.fetch();
+
+    BOOST_CHECK(connection->isConnected());
+    BOOST_CHECK(MockRedisServer::waitFor([this]() { return server.connections() == 2; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(jitter_does_not_expire_new_connections, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.connectionLifetime = boost::posix_time::milliseconds(100);
+    options.lifetimeJitter = boost::posix_time::seconds(10);
+
+    for(size_t i = 1; i <= 20; ++i)
+    {
+        ConnectionPool pool(factory(), options);
+
+        pool.fetch().release();
+        pool.fetch().release();
+
+        BOOST_CHECK(MockRedisServer::waitFor([this, i]() { return server.connections() == i; }));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(health_check_has_its_own_timeout, Fixture)
+{
+    ConnectionPoolOptions options;
+
+    options.minIdle = 1;
+    options.healthCheckInterval = boost::posix_time::milliseconds(20);
+    options.healthCheckTimeout = boost::posix_time::milliseconds(50);
+
+    ConnectionPool pool(factory(), options);
+
+    // The first connection stops answering PING.
+    std::atomic<bool> hang(true);
+
+    server.setHandler([this, &hang](const MockRedisServer::Command &command) {
+        if (command[0] == "PING" && hang.exchange(false))
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        return server.defaultReply(command);
+    });
+
+    // Reconnected well before the 1 s command timeout.
+    BOOST_CHECK(MockRedisServer::waitFor([this]() { return server.connections() == 2; },
+                std::chrono::milliseconds(500)));
+}
@@ -0,0 +1,159 @@
+#define BOOST_TEST_MODULE iouring
+#include <boost/test/unit_test.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include <redisclient/redissyncclient.h>
+#include <redisclient/pipeline.h>
+
+#include "mockredisserver.h"
+
+using redisclient::RedisSyncClient;
+using redisclient::RedisValue;
+using redisclient::IoUring;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    bool ioUringUsable()
+    {
+        char buf[64];
+        boost::system::error_code ec;
+        IoUring ring;
+
+        return ring.open(buf, sizeof(buf), ec) && ring.probe(ec);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(send_and_read_over_socketpair)
+{
+    if (!ioUringUsable())
+        return; // poll fallback is covered by the client tests
+
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    std::thread peer([&fds]() {
+        char request[64];
+        ssize_t n = ::recv(fds[1], request, sizeof(request), 0);
+        BOOST_CHECK_EQUAL(std::string(request, n > 0 ? n : 0), "PING\r\n");
+        ::send(fds[1], "+PONG\r\n", 7, 0);
+    });
+
+    char buf[64];
+    boost::system::error_code ec;
+    IoUring ring;
+
+    BOOST_REQUIRE(ring.open(buf, sizeof(buf), ec));
+
+    std::string request = "PING\r\n";
+    std::vector<boost::asio::const_buffer> buffers = {
+        boost::asio::buffer(request)
+    };
+    size_t bytesSent = 0;
+    size_t bytesRead = 0;
+
+    ring.sendAndRead(fds[0], buffers, buf, sizeof(buf),
+            std::chrono::steady_clock::now() + std::chrono::seconds(2),
+            bytesSent, bytesRead, ec);
+
+    // A read that came back empty-handed is left to read().
+    if (!ec && bytesRead == 0)
+        bytesRead = ring.read(fds[0], buf, sizeof(buf),
+                std::chrono::steady_clock::now() + std::chrono::seconds(2), ec);
+
+    peer.join();
+
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(bytesSent, request.size());
+    BOOST_CHECK_EQUAL(std::string(buf, bytesRead), "+PONG\r\n");
+    BOOST_CHECK_GE(ring.enters, 1u);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(read_times_out)
+{
+    if (!ioUringUsable())
+        return;
+
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    char buf[64];
+    boost::system::error_code ec;
+    IoUring ring;
+
+    BOOST_REQUIRE(ring.open(buf, sizeof(buf), ec));
+
+    size_t size = ring.read(fds[0], buf, sizeof(buf),
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(20), ec);
+
+    BOOST_CHECK_EQUAL(size, 0u);
+    BOOST_CHECK_EQUAL(ec.value(), ETIMEDOUT);
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(sync_client_commands)
+{
+    MockRedisServer server;
+    boost::asio::io_service ioService;
+    RedisSyncClient client(ioService);
+
+    client.setIoMode(RedisSyncClient::IoMode::IoUring)
+        .setCommandTimeout(boost::posix_time::seconds(2));
+    client.connect(server.endpoint());
+
+    // Works with io_uring, or with poll if the kernel lacks it.
+    BOOST_CHECK(client.command("SET", {"key", "value"}).isOk());
+    BOOST_CHECK_EQUAL(client.command("GET", {"key"}).toString(), "value");
+
+    // Reply larger than the read buffer.
+    std::string big(20000, 'x');
+    BOOST_CHECK(client.command("SET", {"big", big}).isOk());
+    BOOST_CHECK_EQUAL(client.command("GET", {"big"}).toString(), big);
+
+    RedisValue replies = client.pipelined()
+        .command("INCR", {"n"})
+        .command("INCR", {"n"})
+        .command("GET", {"n"})
+        .finish();
+
+    BOOST_REQUIRE_EQUAL(replies.toArray().size(), 3u);
+    BOOST_CHECK_EQUAL(replies.toArray()[2].toString(), "2");
+
+    if (ioUringUsable())
+        BOOST_CHECK_GT(client.ioStats().enters, 0u);
+    else
+        BOOST_CHECK_EQUAL(client.ioStats().enters, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(sync_client_timeout)
+{
+    MockRedisServer server;
+    boost::asio::io_service ioService;
+    RedisSyncClient client(ioService);
+
+    server.setHandler([&server](const MockRedisServer::Command &command) {
+        if (command[0] == "GET")
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        return server.defaultReply(command);
+    });
+
+    client.setIoMode(RedisSyncClient::IoMode::IoUring)
+        .setCommandTimeout(boost::posix_time::milliseconds(20));
+    client.connect(server.endpoint());
+
+    boost::system::error_code ec;
+    client.command("GET", {"key"}, ec);
+
+    BOOST_CHECK(ec);
+    BOOST_CHECK(!client.isConnected());
+}
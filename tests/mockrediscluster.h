@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_TESTS_MOCKREDISCLUSTER_H
+#define REDISCLIENT_TESTS_MOCKREDISCLUSTER_H
+
+#include <boost/noncopyable.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <redisclient/clusterslot.h>
+
+#include "mockredisserver.h"
+
+namespace redisclient {
+namespace test {
+
+// Redis Cluster of MockRedisServer nodes, the slots split evenly between
+// them. Each node answers CLUSTER SLOTS with the current table and
+// -MOVED for keys of slots it does not own. A slot being migrated is
+// answered with -ASK by its owner; the target serves it only right
+// after ASKING. Commands are keyed by their first argument, as in the
+// client.
+class MockRedisCluster : boost::noncopyable {
+public:
+    explicit MockRedisCluster(size_t count)
+        : owners(clusterSlotCount)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            nodes.emplace_back(new MockRedisServer);
+            asking.push_back(false);
+        }
+
+        for(size_t slot = 0; slot < clusterSlotCount; ++slot)
+            owners[slot] = slot * count / clusterSlotCount;
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            nodes[i]->setHandler([this, i](const MockRedisServer::Command &command) {
+                return reply(i, command);
+            });
+        }
+    }
+
+    ~MockRedisCluster()
+    {
+        // Handlers use the table.
+        for(auto &node: nodes)
+            node->stop();
+    }
+
+    MockRedisServer &node(size_t index)
+    {
+        return *nodes[index];
+    }
+
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    std::vector<boost::asio::ip::tcp::endpoint> seeds() const
+    {
+        std::vector<boost::asio::ip::tcp::endpoint> result;
+
+        for(const auto &node: nodes)
+            result.push_back(node->endpoint());
+
+        return result;
+    }
+
+    size_t owner(uint16_t slot) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return owners[slot];
+    }
+
+    // Give slot to node: the old owner answers -MOVED from now on.
+    void moveSlot(uint16_t slot, size_t node)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        owners[slot] = node;
+        migrating.erase(slot);
+        loops.erase(slot);
+    }
+
+    // Start migrating slot to node: its owner answers -ASK.
+    void migrateSlot(uint16_t slot, size_t node)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        migrating[slot] = node;
+    }
+
+    // Every node answers -MOVED to the next one for slot.
+    void loopSlot(uint16_t slot)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loops[slot] = true;
+    }
+
+    // CLUSTER SLOTS requests over all nodes.
+    size_t slotRequests() const
+    {
+        size_t count = 0;
+
+        for(const auto &node: nodes)
+            count += node->countCommands("CLUSTER");
+
+        return count;
+    }
+
+    // A key of slots owned by node, distinct for each n.
+    std::string keyOf(size_t node, size_t n = 0) const
+    {
+        for(size_t i = 0;; ++i)
+        {
+            std::string key = "key" + std::to_string(i);
+
+            if (owner(keySlot(key)) == node && n-- == 0)
+                return key;
+        }
+    }
+
+private:
+    std::string reply(size_t index, const MockRedisServer::Command &command)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool wasAsking = asking[index];
+
+        asking[index] = command[0] == "ASKING";
+
+        if (command[0] == "CLUSTER")
+            return slotsReply();
+
+        if (command[0] == "ASKING" || command.size() < 2)
+        {
+            lock.unlock();
+            return nodes[index]->defaultReply(command);
+        }
+
+        uint16_t slot = keySlot(command[1]);
+        auto migration = migrating.find(slot);
+
+        if (loops.count(slot))
+            return redirection("MOVED", slot, (index + 1) % nodes.size());
+
+        if (migration != migrating.end())
+        {
+            if (owners[slot] == index)
+                return redirection("ASK", slot, migration->second);
+
+            if (migration->second == index && !wasAsking)
+                return redirection("MOVED", slot, owners[slot]);
+        }
+        else if (owners[slot] != index)
+        {
+            return redirection("MOVED", slot, owners[slot]);
+        }
+
+        lock.unlock();
+        return nodes[index]->defaultReply(command);
+    }
+
+    std::string redirection(const std::string &kind, uint16_t slot, size_t node) const
+    {
+        return MockRedisServer::error(kind + " " + std::to_string(slot) + " " +
+                nodes[node]->address());
+    }
+
+    std::string slotsReply() const
+    {
+        std::vector<std::string> ranges;
+
+        for(size_t start = 0; start < clusterSlotCount;)
+        {
+            size_t end = start;
+
+            while (end + 1 < clusterSlotCount && owners[end + 1] == owners[start])
+                ++end;
+
+            const MockRedisServer &node = *nodes[owners[start]];
+
+            ranges.push_back(MockRedisServer::array({
+                        MockRedisServer::integer(static_cast<int64_t>(start)),
+                        MockRedisServer::integer(static_cast<int64_t>(end)),
+                        MockRedisServer::array({
+                            MockRedisServer::bulk("127.0.0.1"),
+                            MockRedisServer::integer(node.endpoint().port()),
+                            MockRedisServer::bulk("node" + std::to_string(owners[start]))
+                        })
+                    }));
+
+            start = end + 1;
+        }
+
+        return MockRedisServer::array(ranges);
+    }
+
+    std::vector<std::unique_ptr<MockRedisServer>> nodes;
+
+    mutable std::mutex mutex;
+    std::vector<size_t> owners;
+    std::map<uint16_t, size_t> migrating;
+    std::map<uint16_t, bool> loops;
+    std::vector<bool> asking; // last command of the node was ASKING
+};
+
+}
+}
+
+#endif // REDISCLIENT_TESTS_MOCKREDISCLUSTER_H
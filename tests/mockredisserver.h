@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) Alex Nekipelov (alex@nekipelov.net)
+ * License: MIT
+ */
+
+#ifndef REDISCLIENT_TESTS_MOCKREDISSERVER_H
+#define REDISCLIENT_TESTS_MOCKREDISSERVER_H
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <redisclient/redisparser.h>
+#include <redisclient/redisvalue.h>
+
+namespace redisclient {
+namespace test {
+
+// In-process RESP server on 127.0.0.1 for tests. Every connection is
+// served by its own thread; commands are answered by the handler, which
+// defaults to a small key-value store. stop() closes the listening
+// socket and all connections, start() listens again on the same port,
+// which is enough to simulate a server that is killed and restarted.
+class MockRedisServer : boost::noncopyable {
+public:
+    typedef std::vector<std::string> Command;
+    // Return the raw reply; an empty string sends nothing.
+    typedef std::function<std::string(const Command &)> Handler;
+
+    MockRedisServer()
+        : port(0), listenFd(-1), running(false), accepted(0)
+    {
+        handler = [this](const Command &command) {
+            return defaultReply(command);
+        };
+        start();
+    }
+
+    ~MockRedisServer()
+    {
+        stop();
+    }
+
+    void setHandler(Handler newHandler)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        handler = std::move(newHandler);
+    }
+
+    void start()
+    {
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        int one = 1;
+        ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                ::listen(listenFd, 64) != 0)
+        {
+            ::close(listenFd);
+            throw std::runtime_error("MockRedisServer: can't listen");
+        }
+
+        socklen_t len = sizeof(addr);
+        ::getsockname(listenFd, reinterpret_cast<sockaddr *>(&addr), &len);
+        port = ntohs(addr.sin_port);
+
+        running = true;
+        acceptThread = std::thread([this]() { acceptLoop(); });
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+
+        running = false;
+        ::shutdown(listenFd, SHUT_RDWR);
+        acceptThread.join();
+        ::close(listenFd);
+        listenFd = -1;
+
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(int fd: clients)
+                ::shutdown(fd, SHUT_RDWR);
+            threads.swap(clientThreads);
+        }
+
+        for(auto &thread: threads)
+            thread.join();
+    }
+
+    boost::asio::ip::tcp::endpoint endpoint() const
+    {
+        return boost::asio::ip::tcp::endpoint(
+                boost::asio::ip::address_v4::loopback(), port);
+    }
+
+    std::string address() const
+    {
+        return "127.0.0.1:" + std::to_string(port);
+    }
+
+    // Send raw data to every open connection.
+    void broadcast(const std::string &data)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(int fd: clients)
+            sendAll(fd, data);
+    }
+
+    // Commands received so far, in arrival order, names in upper case.
+    std::vector<Command> commands() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return log;
+    }
+
+    size_t countCommands(const std::string &name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::count_if(log.begin(), log.end(), [&name](const Command &c) {
+                return !c.empty() && c[0] == name;
+        });
+    }
+
+    void clearCommands()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        log.clear();
+    }
+
+    size_t connections() const
+    {
+        return accepted;
+    }
+
+    size_t openConnections() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return clients.size();
+    }
+
+    // Wait until pred() holds, at most timeout.
+    static bool waitFor(const std::function<bool()> &pred,
+            std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return true;
+    }
+
+    static std::string status(const std::string &s)
+    {
+        return "+" + s + "\r\n";
+    }
+
+    static std::string error(const std::string &s)
+    {
+        return "-" + s + "\r\n";
+    }
+
+    static std::string integer(int64_t i)
+    {
+        return ":" + std::to_string(i) + "\r\n";
+    }
+
+    static std::string bulk(const std::string &s)
+    {
+        return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+    }
+
+    static std::string nil()
+    {
+        return "$-1\r\n";
+    }
+
+    // items are already encoded replies.
+    static std::string array(const std::vector<std::string> &items)
+    {
+        std::string result = "*" + std::to_string(items.size()) + "\r\n";
+        for(const auto &item: items)
+            result += item;
+        return result;
+    }
+
+    // Reply of the key-value store: PING, ECHO, SET, GET, DEL, EXISTS,
+    // MGET, MSET, INCR; AUTH, SELECT, CLIENT, HELLO, READONLY, ASKING
+    // and (P)(UN)SUBSCRIBE are acknowledged. Transactions are not: MULTI,
+    // WATCH, UNWATCH and DISCARD reply OK, commands run at once and EXEC
+    // replies an empty array.
+    std::string defaultReply(const Command &command)
+    {
+        std::string name = command.empty() ? std::string() : command[0];
+
+        if (name == "PING")
+            return status("PONG");
+        if (name == "ECHO" && command.size() == 2)
+            return bulk(command[1]);
+        if (name == "AUTH" || name == "SELECT" || name == "CLIENT" ||
+                name == "READONLY" || name == "ASKING" || name == "MULTI" ||
+                name == "WATCH" || name == "UNWATCH" || name == "DISCARD")
+            return status("OK");
+        if (name == "EXEC")
+            return array({});
+        if (name == "HELLO")
+            return array({bulk("server"), bulk("redis"), bulk("proto"), integer(3)});
+        if (name == "SUBSCRIBE" || name == "PSUBSCRIBE" ||
+                name == "UNSUBSCRIBE" || name == "PUNSUBSCRIBE")
+        {
+            std::string kind = name;
+            std::transform(kind.begin(), kind.end(), kind.begin(), ::tolower);
+            std::string result;
+            for(size_t i = 1; i < command.size(); ++i)
+                result += array({bulk(kind), bulk(command[i]), integer(static_cast<int64_t>(i))});
+            return result;
+        }
+
+        std::lock_guard<std::mutex> lock(storeMutex);
+
+        if (name == "SET" && command.size() >= 3)
+        {
+            store[command[1]] = command[2];
+            return status("OK");
+        }
+        if (name == "GET" && command.size() == 2)
+        {
+            auto it = store.find(command[1]);
+            return it == store.end() ? nil() : bulk(it->second);
+        }
+        if ((name == "DEL" || name == "EXISTS") && command.size() >= 2)
+        {
+            int64_t n = 0;
+            for(size_t i = 1; i < command.size(); ++i)
+            {
+                if (name == "DEL")
+                    n += static_cast<int64_t>(store.erase(command[i]));
+                else
+                    n += static_cast<int64_t>(store.count(command[i]));
+            }
+            return integer(n);
+        }
+        if (name == "MGET")
+        {
+            std::vector<std::string> items;
+            for(size_t i = 1; i < command.size(); ++i)
+            {
+                auto it = store.find(command[i]);
+                items.push_back(it == store.end() ? nil() : bulk(it->second));
+            }
+            return array(items);
+        }
+        if (name == "MSET" && command.size() % 2 == 1)
+        {
+            for(size_t i = 1; i + 1 < command.size(); i += 2)
+                store[command[i]] = command[i + 1];
+            return status("OK");
+        }
+        if (name == "INCR" && command.size() == 2)
+        {
+            int64_t value = store.count(command[1]) ? std::stoll(store[command[1]]) : 0;
+            store[command[1]] = std::to_string(++value);
+            return integer(value);
+        }
+
+        return error("ERR unknown command '" + name + "'");
+    }
+
+private:
+    void acceptLoop()
+    {
+        for(;;)
+        {
+            int fd = ::accept(listenFd, nullptr, nullptr);
+
+            if (fd < 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!running)
+            {
+                ::close(fd);
+                return;
+            }
+
+            ++accepted;
+            clients.push_back(fd);
+            clientThreads.emplace_back([this, fd]() { serve(fd); });
+        }
+    }
+
+    void serve(int fd)
+    {
+        RedisParser parser;
+        char buf[4096];
+
+        for(;;)
+        {
+            ssize_t size = ::recv(fd, buf, sizeof(buf), 0);
+
+            if (size <= 0)
+                break;
+
+            size_t pos = 0;
+
+            while (pos < static_cast<size_t>(size))
+            {
+                auto result = parser.parse(buf + pos, static_cast<size_t>(size) - pos);
+
+                pos += result.first;
+
+                if (result.second == RedisParser::Completed)
+                {
+                    std::string reply = handle(toCommand(parser.result()));
+
+                    if (!reply.empty())
+                        sendAll(fd, reply);
+                }
+                else if (result.second == RedisParser::Error)
+                {
+                    pos = static_cast<size_t>(size);
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.erase(std::remove(clients.begin(), clients.end(), fd), clients.end());
+        ::close(fd);
+    }
+
+    std::string handle(const Command &command)
+    {
+        Handler current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            log.push_back(command);
+            current = handler;
+        }
+        return current(command);
+    }
+
+    static Command toCommand(const RedisValue &value)
+    {
+        Command command;
+
+        for(const auto &item: value.toArray())
+            command.push_back(item.toString());
+
+        // Command names are case insensitive.
+        if (!command.empty())
+            std::transform(command[0].begin(), command[0].end(), command[0].begin(), ::toupper);
+
+        return command;
+    }
+
+    static void sendAll(int fd, const std::string &data)
+    {
+        size_t sent = 0;
+
+        while (sent < data.size())
+        {
+            ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+            if (n <= 0)
+                return;
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    unsigned short port;
+    int listenFd;
+    std::atomic<bool> running;
+    std::atomic<size_t> accepted;
+    std::thread acceptThread;
+
+    mutable std::mutex mutex;
+    Handler handler;
+    std::vector<int> clients;
+    std::vector<std::thread> clientThreads;
+    std::vector<Command> log;
+
+    std::mutex storeMutex;
+    std::map<std::string, std::string> store;
+};
+
+}
+}
+
+#endif // REDISCLIENT_TESTS_MOCKREDISSERVER_H
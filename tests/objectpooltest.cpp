@@ -0,0 +1,190 @@
+#define BOOST_TEST_MODULE objectpool
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <redisclient/impl/objectpool.h>
+
+using redisclient::ObjectPool;
+
+namespace
+{
+    typedef ObjectPool<int> Pool;
+
+    Pool::Factory counter()
+    {
+        std::shared_ptr<std::atomic<int>> seq = std::make_shared<std::atomic<int>>(0);
+
+        return [seq]() { return ++*seq; };
+    }
+}
+
+BOOST_AUTO_TEST_CASE(acquire_release)
+{
+    Pool pool(2, counter());
+
+    size_t first = pool.tryAcquire();
+    size_t second = pool.tryAcquire();
+
+    BOOST_REQUIRE_NE(first, Pool::npos);
+    BOOST_REQUIRE_NE(second, Pool::npos);
+    BOOST_CHECK_NE(first, second);
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), Pool::npos);
+    BOOST_CHECK_EQUAL(pool.size(), 2u);
+
+    // The most recently released object is reused first.
+    pool.release(first);
+    pool.release(second);
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), second);
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), first);
+
+    pool.discard(first);
+    BOOST_CHECK_EQUAL(pool.size(), 1u);
+    pool.release(second);
+}
+
+BOOST_AUTO_TEST_CASE(slots_of_other_threads_are_reused_lifo)
+{
+    Pool pool(3, counter());
+    size_t slots[3] = { pool.acquire(), pool.acquire(), pool.acquire() };
+
+    // Released by other threads: not in this thread's cache.
+    for(size_t slot: { slots[1], slots[2], slots[0] })
+        std::thread([&pool, slot]() { pool.release(slot); }).join();
+
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), slots[0]);
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), slots[2]);
+    BOOST_CHECK_EQUAL(pool.tryAcquire(), slots[1]);
+
+    for(size_t slot: slots)
+        pool.release(slot);
+}
+
+BOOST_AUTO_TEST_CASE(acquire_times_out)
+{
+    Pool pool(1, counter());
+    size_t slot = pool.acquire();
+
+    auto start = std::chrono::steady_clock::now();
+
+    BOOST_CHECK_EQUAL(pool.acquire(start + std::chrono::milliseconds(20)), Pool::npos);
+    BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+    pool.release(slot);
+}
+
+BOOST_AUTO_TEST_CASE(waited_excludes_creation)
+{
+    Pool pool(1, []() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return 1;
+    });
+
+    std::chrono::steady_clock::duration waited;
+    size_t slot = pool.acquire(Pool::Deadline::max(), waited);
+
+    BOOST_CHECK(waited == std::chrono::steady_clock::duration::zero());
+
+    std::thread releaser([&pool, slot]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pool.release(slot);
+    });
+
+    slot = pool.acquire(Pool::Deadline::max(), waited);
+    releaser.join();
+
+    BOOST_CHECK(waited >= std::chrono::milliseconds(15));
+    BOOST_CHECK(waited < std::chrono::milliseconds(50));
+    pool.release(slot);
+}
+
+// Releases in quick succession wake as many parked threads.
+BOOST_AUTO_TEST_CASE(every_parked_waiter_wakes_up)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> delay(0, 1500);
+
+    for(int run = 0; run < 200; ++run)
+    {
+        Pool pool(2, counter());
+        size_t first = pool.acquire();
+        size_t second = pool.acquire();
+
+        std::vector<std::future<size_t>> waiters;
+
+        for(int i = 0; i < 2; ++i)
+        {
+            waiters.push_back(std::async(std::launch::async, [&pool]() {
+                return pool.acquire();
+            }));
+        }
+
+        // Around the handoff delay, so both release paths are taken.
+        std::this_thread::sleep_for(std::chrono::microseconds(delay(random)));
+
+        pool.release(first);
+        pool.release(second);
+
+        std::vector<size_t> slots;
+
+        for(auto &waiter: waiters)
+        {
+            BOOST_REQUIRE_MESSAGE(waiter.wait_for(std::chrono::milliseconds(200)) ==
+                    std::future_status::ready, "waiter stuck in run " << run);
+            slots.push_back(waiter.get());
+        }
+
+        BOOST_CHECK_NE(slots[0], slots[1]);
+
+        for(size_t slot: slots)
+            pool.release(slot);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stress)
+{
+    const size_t capacity = 4;
+    const size_t threads = 16;
+    const size_t iterations = 2000;
+
+    Pool pool(capacity, counter());
+    std::vector<std::atomic<int>> owners(capacity);
+    std::atomic<size_t> conflicts(0);
+    std::vector<std::future<void>> workers;
+
+    for(auto &owner: owners)
+        owner.store(0);
+
+    for(size_t t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::async(std::launch::async, [&]() {
+            for(size_t i = 0; i < iterations; ++i)
+            {
+                size_t slot = pool.acquire();
+
+                if (owners[slot].fetch_add(1) != 0)
+                    ++conflicts;
+
+                if (i % 8 == 0)
+                    std::this_thread::yield();
+
+                owners[slot].fetch_sub(1);
+                pool.release(slot);
+            }
+        }));
+    }
+
+    for(auto &worker: workers)
+    {
+        BOOST_REQUIRE(worker.wait_for(std::chrono::seconds(20)) == std::future_status::ready);
+        worker.get();
+    }
+
+    BOOST_CHECK_EQUAL(conflicts.load(), 0u);
+    BOOST_CHECK_LE(pool.size(), capacity);
+}
@@ -0,0 +1,98 @@
+#define BOOST_TEST_MODULE pubsubring
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+
+#include <redisclient/pubsubring.h>
+
+using redisclient::PubSubMessage;
+using redisclient::PubSubMessagePtr;
+using redisclient::PubSubOverflow;
+using redisclient::PubSubRing;
+
+namespace
+{
+    PubSubMessagePtr message(const std::string &payload)
+    {
+        std::shared_ptr<PubSubMessage> result = std::make_shared<PubSubMessage>();
+
+        result->payload.assign(payload.begin(), payload.end());
+        return result;
+    }
+
+    std::string payload(const PubSubMessagePtr &message)
+    {
+        return std::string(message->payload.begin(), message->payload.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(max_lag_follows_the_consumer)
+{
+    PubSubRing ring(8);
+    PubSubMessagePtr popped;
+
+    // Popped as pushed: never more than one message in the ring.
+    for(int i = 0; i < 6; ++i)
+    {
+        BOOST_REQUIRE(ring.push(message(std::to_string(i))));
+        BOOST_REQUIRE(ring.tryPop(popped));
+        BOOST_CHECK_EQUAL(payload(popped), std::to_string(i));
+    }
+
+    BOOST_CHECK_EQUAL(ring.stats().maxLag, 1u);
+
+    for(int i = 0; i < 3; ++i)
+        ring.push(message("x"));
+
+    PubSubRing::Stats stats = ring.stats();
+
+    BOOST_CHECK_EQUAL(stats.lag, 3u);
+    BOOST_CHECK_EQUAL(stats.maxLag, 3u);
+    BOOST_CHECK_EQUAL(stats.pushed, 9u);
+    BOOST_CHECK_EQUAL(stats.popped, 6u);
+}
+
+BOOST_AUTO_TEST_CASE(overflow_policies)
+{
+    PubSubRing oldest(2, PubSubOverflow::DropOldest);
+    PubSubRing newest(2, PubSubOverflow::DropNewest);
+    PubSubMessagePtr popped;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        BOOST_CHECK(oldest.push(message(std::to_string(i))));
+        BOOST_CHECK_EQUAL(newest.push(message(std::to_string(i))), i < 2);
+    }
+
+    BOOST_REQUIRE(oldest.tryPop(popped));
+    BOOST_CHECK_EQUAL(payload(popped), "1");
+    BOOST_REQUIRE(newest.tryPop(popped));
+    BOOST_CHECK_EQUAL(payload(popped), "0");
+
+    BOOST_CHECK_EQUAL(oldest.stats().dropped, 1u);
+    BOOST_CHECK_EQUAL(newest.stats().dropped, 1u);
+    BOOST_CHECK_EQUAL(oldest.stats().maxLag, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(closed_ring_drains)
+{
+    PubSubRing ring(4, PubSubOverflow::Block);
+    PubSubMessagePtr popped;
+
+    std::thread producer([&ring]() {
+        for(int i = 0; i < 100; ++i)
+            ring.push(message(std::to_string(i)));
+        ring.close();
+    });
+
+    int expected = 0;
+
+    while (ring.pop(popped))
+        BOOST_CHECK_EQUAL(payload(popped), std::to_string(expected++));
+
+    producer.join();
+
+    BOOST_CHECK_EQUAL(expected, 100);
+    BOOST_CHECK_LE(ring.stats().maxLag, 4u);
+}
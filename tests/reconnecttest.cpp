@@ -0,0 +1,328 @@
+#define BOOST_TEST_MODULE reconnect
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <redisclient/redisasyncclient.h>
+
+#include "mockredisserver.h"
+
+using redisclient::RedisAsyncClient;
+using redisclient::RedisValue;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    void runFor(boost::asio::io_service &ioService, std::chrono::milliseconds duration)
+    {
+        ioService.restart();
+        ioService.run_for(duration);
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : client(ioService)
+        {
+            client.installErrorHandler([this](const std::string &s) {
+                errors.push_back(s);
+            });
+            client.setAutoReconnect(boost::posix_time::milliseconds(5),
+                    boost::posix_time::milliseconds(20));
+        }
+
+        void connect()
+        {
+            bool connected = false;
+
+            client.connect(server.endpoint(), [&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        // Kill the server and wait for the client to notice.
+        void killServer()
+        {
+            server.stop();
+            BOOST_REQUIRE(runUntil(ioService, [this]() {
+                return client.state() == RedisAsyncClient::State::Connecting;
+            }));
+        }
+
+        MockRedisServer server;
+        boost::asio::io_service ioService;
+        RedisAsyncClient client;
+        std::vector<std::string> errors;
+    };
+
+    bool isConnectionLost(const RedisValue &value)
+    {
+        return value.isError() && value.toString() == "[RedisClient] connection lost";
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(queued_commands_are_sent_after_restart, Fixture)
+{
+    connect();
+    killServer();
+
+    std::vector<RedisValue> replies;
+
+    client.command("SET", {"key", "value"}, [&replies](RedisValue v) {
+        replies.push_back(std::move(v));
+    });
+    client.command("GET", {"key"}, [&replies](RedisValue v) {
+        replies.push_back(std::move(v));
+    });
+
+    server.start();
+
+    BOOST_REQUIRE(runUntil(ioService, [&replies]() { return replies.size() == 2; }));
+    BOOST_CHECK(replies[0].isOk());
+    BOOST_CHECK_EQUAL(replies[1].toString(), "value");
+    BOOST_CHECK_EQUAL(server.connections(), 2u);
+    BOOST_CHECK(client.isConnected());
+    BOOST_CHECK(errors.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(commands_in_flight_fail, Fixture)
+{
+    // HANG never gets a reply.
+    server.setHandler([this](const MockRedisServer::Command &command) {
+        return command[0] == "HANG" ? std::string() : server.defaultReply(command);
+    });
+
+    connect();
+
+    bool failed = false;
+
+    client.command("HANG", {}, [&failed](RedisValue v) {
+        BOOST_CHECK(isConnectionLost(v));
+        failed = true;
+    });
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("HANG") == 1;
+    }));
+
+    killServer();
+    BOOST_REQUIRE(runUntil(ioService, [&failed]() { return failed; }));
+
+    server.start();
+
+    bool done = false;
+
+    client.command("PING", {}, [&done](RedisValue v) {
+        BOOST_CHECK_EQUAL(v.toString(), "PONG");
+        done = true;
+    });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    // Not replayed: it may have been executed.
+    BOOST_CHECK_EQUAL(server.countCommands("HANG"), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(subscriptions_are_restored, Fixture)
+{
+    connect();
+
+    std::vector<std::string> messages;
+    auto record = [&messages](const std::string &tag) {
+        return [&messages, tag](std::vector<char> msg) {
+            messages.push_back(tag + ":" + std::string(msg.begin(), msg.end()));
+        };
+    };
+
+    // A channel and a pattern of the same name are separate subscriptions.
+    RedisAsyncClient::Handle channel = client.subscribe("news", record("channel"));
+    client.psubscribe("news", record("pattern"));
+    client.singleShotSubscribe("once", record("once"));
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("SUBSCRIBE") == 2 &&
+            server.countCommands("PSUBSCRIBE") == 1;
+    }));
+
+    client.unsubscribe(channel);
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("UNSUBSCRIBE") == 1;
+    }));
+
+    killServer();
+    server.clearCommands();
+    server.start();
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("SUBSCRIBE") == 1 &&
+            server.countCommands("PSUBSCRIBE") == 1;
+    }));
+
+    std::vector<MockRedisServer::Command> expected = {
+        {"SUBSCRIBE", "once"},
+        {"PSUBSCRIBE", "news"}
+    };
+    BOOST_CHECK(server.commands() == expected);
+
+    server.broadcast(MockRedisServer::array({MockRedisServer::bulk("pmessage"),
+                MockRedisServer::bulk("news"), MockRedisServer::bulk("news"),
+                MockRedisServer::bulk("p1")}));
+    server.broadcast(MockRedisServer::array({MockRedisServer::bulk("message"),
+                MockRedisServer::bulk("once"), MockRedisServer::bulk("o1")}));
+
+    BOOST_REQUIRE(runUntil(ioService, [&messages]() { return messages.size() == 2; }));
+    BOOST_CHECK_EQUAL(messages[0], "pattern:p1");
+    BOOST_CHECK_EQUAL(messages[1], "once:o1");
+    BOOST_CHECK(errors.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(single_shot_is_not_restored_after_delivery, Fixture)
+{
+    connect();
+
+    size_t delivered = 0;
+
+    client.singleShotSubscribe("once", [&delivered](std::vector<char>) { ++delivered; });
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("SUBSCRIBE") == 1;
+    }));
+
+    server.broadcast(MockRedisServer::array({MockRedisServer::bulk("message"),
+                MockRedisServer::bulk("once"), MockRedisServer::bulk("o1")}));
+
+    BOOST_REQUIRE(runUntil(ioService, [&delivered]() { return delivered == 1; }));
+
+    killServer();
+    server.clearCommands();
+    server.start();
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return server.connections() == 2; }));
+    runFor(ioService, std::chrono::milliseconds(50));
+
+    BOOST_CHECK_EQUAL(server.countCommands("SUBSCRIBE"), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(first_connect_failure_fails_queued_commands, Fixture)
+{
+    boost::asio::ip::tcp::endpoint endpoint = server.endpoint();
+
+    server.stop();
+
+    bool connectFailed = false;
+    bool commandFailed = false;
+
+    client.connect(endpoint, [&connectFailed](boost::system::error_code ec) {
+        BOOST_CHECK(ec);
+        connectFailed = true;
+    });
+    client.command("PING", {}, [&commandFailed](RedisValue v) {
+        BOOST_CHECK(isConnectionLost(v));
+        commandFailed = true;
+    });
+
+    BOOST_REQUIRE(runUntil(ioService, [&]() { return connectFailed && commandFailed; }));
+    BOOST_CHECK(client.state() == RedisAsyncClient::State::Unconnected);
+}
+
+BOOST_FIXTURE_TEST_CASE(subscriber_with_handshake_reconnects, Fixture)
+{
+    for(bool hello: {false, true})
+    {
+        redisclient::ConnectOptions options;
+
+        options.password = "secret";
+        options.database = 2;
+        options.hello = hello;
+        client.setConnectOptions(options);
+
+        connect();
+
+        std::vector<std::string> messages;
+
+        client.subscribe("news", [&messages](std::vector<char> msg) {
+            messages.push_back(std::string(msg.begin(), msg.end()));
+        });
+
+        BOOST_REQUIRE(runUntil(ioService, [this]() {
+            return server.countCommands("SUBSCRIBE") == 1;
+        }));
+
+        killServer();
+        server.clearCommands();
+        server.start();
+
+        BOOST_REQUIRE(runUntil(ioService, [this]() {
+            return server.countCommands("SUBSCRIBE") == 1;
+        }));
+
+        std::vector<MockRedisServer::Command> commands = server.commands();
+
+        BOOST_REQUIRE_EQUAL(commands.size(), 3u);
+        BOOST_CHECK_EQUAL(commands[0][0], hello ? "HELLO" : "AUTH");
+        BOOST_CHECK(commands[1] == MockRedisServer::Command({"SELECT", "2"}));
+
+        server.broadcast(MockRedisServer::array({MockRedisServer::bulk("message"),
+                    MockRedisServer::bulk("news"), MockRedisServer::bulk("m1")}));
+
+        BOOST_REQUIRE(runUntil(ioService, [&messages]() { return messages.size() == 1; }));
+        BOOST_CHECK_EQUAL(messages[0], "m1");
+        BOOST_CHECK(client.state() == RedisAsyncClient::State::Subscribed);
+        BOOST_CHECK(errors.empty());
+
+        client.disconnect();
+        server.clearCommands();
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(local_patterns_subscribe_again_after_disconnect, Fixture)
+{
+    std::vector<std::string> messages;
+    auto record = [&messages](const redisclient::PubSubMessagePtr &message) {
+        messages.push_back(std::string(message->payload.begin(), message->payload.end()));
+    };
+
+    connect();
+    client.psubscribeLocal("news.*", "news.a", record);
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("PSUBSCRIBE") == 1;
+    }));
+
+    client.disconnect();
+    connect();
+    client.psubscribeLocal("news.*", "news.a", record);
+
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return server.countCommands("PSUBSCRIBE") == 2;
+    }));
+
+    server.broadcast(MockRedisServer::array({MockRedisServer::bulk("pmessage"),
+                MockRedisServer::bulk("news.*"), MockRedisServer::bulk("news.a"),
+                MockRedisServer::bulk("m1")}));
+
+    BOOST_REQUIRE(runUntil(ioService, [&messages]() { return messages.size() == 1; }));
+    BOOST_CHECK_EQUAL(messages[0], "m1");
+}
@@ -0,0 +1,298 @@
+#define BOOST_TEST_MODULE replicatedclient
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <redisclient/replicatedasyncclient.h>
+#include <redisclient/replicatedsyncclient.h>
+
+#include "mockredisserver.h"
+
+using redisclient::ReplicatedAsyncClient;
+using redisclient::ReplicatedSyncClient;
+using redisclient::RedisValue;
+using redisclient::Route;
+using redisclient::isReadOnlyCommand;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    struct Fixture
+    {
+        std::vector<boost::asio::ip::tcp::endpoint> replicaEndpoints() const
+        {
+            return { replicas[0].endpoint(), replicas[1].endpoint() };
+        }
+
+        size_t replicaCommands(const std::string &name) const
+        {
+            return replicas[0].countCommands(name) + replicas[1].countCommands(name);
+        }
+
+        MockRedisServer primary;
+        MockRedisServer replicas[2];
+        boost::asio::io_service ioService;
+        std::vector<std::string> errors;
+    };
+
+    struct SyncFixture : Fixture
+    {
+        SyncFixture()
+            : client(ioService, 2)
+        {
+            client.primary().setCommandTimeout(boost::posix_time::seconds(1));
+
+            for(size_t i = 0; i < client.replicas(); ++i)
+            {
+                client.replica(i).setCommandTimeout(boost::posix_time::seconds(1));
+                client.replica(i).installErrorHandler([this](const std::string &s) {
+                    errors.push_back(s);
+                });
+            }
+
+            client.connect(primary.endpoint(), replicaEndpoints());
+        }
+
+        ReplicatedSyncClient client;
+    };
+
+    struct AsyncFixture : Fixture
+    {
+        AsyncFixture()
+            : client(ioService, 2)
+        {
+            client.primary().installErrorHandler([this](const std::string &s) {
+                errors.push_back(s);
+            });
+
+            // A lost replica is skipped while it reconnects.
+            for(size_t i = 0; i < client.replicas(); ++i)
+            {
+                client.replica(i).installErrorHandler([this](const std::string &s) {
+                    errors.push_back(s);
+                });
+                client.replica(i).setAutoReconnect(boost::posix_time::milliseconds(5),
+                        boost::posix_time::milliseconds(20));
+            }
+
+            bool connected = false;
+
+            client.connect(primary.endpoint(), replicaEndpoints(),
+                    [&connected](boost::system::error_code ec) {
+                        BOOST_CHECK(!ec);
+                        connected = true;
+                    });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        // Send a command and wait for its reply.
+        RedisValue command(Route route, const std::string &cmd, std::deque<redisclient::RedisBuffer> args)
+        {
+            bool done = false;
+            RedisValue result;
+
+            client.command(route, cmd, std::move(args), [&done, &result](RedisValue v) {
+                result = std::move(v);
+                done = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+            return result;
+        }
+
+        ReplicatedAsyncClient client;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(command_table)
+{
+    for(const char *cmd: { "GET", "get", "MGET", "EXISTS", "ZRANGE", "ZUNION",
+            "BITCOUNT", "Hgetall", "SCAN" })
+        BOOST_CHECK_MESSAGE(isReadOnlyCommand(cmd), cmd);
+
+    // Writes, commands with side effects and unknown ones go to the primary.
+    for(const char *cmd: { "SET", "set", "DEL", "INCR", "EVAL", "PUBLISH", "MULTI",
+            "GETSET", "GETDEL", "ZRANGESTORE", "UNKNOWN", "",
+            "GETAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA" })
+        BOOST_CHECK_MESSAGE(!isReadOnlyCommand(cmd), cmd);
+}
+
+BOOST_FIXTURE_TEST_CASE(sync_routes_reads_to_replicas, SyncFixture)
+{
+    BOOST_CHECK(client.command("SET", {"key", "value"}).isOk());
+    BOOST_CHECK_EQUAL(primary.countCommands("SET"), 1u);
+    BOOST_CHECK_EQUAL(replicaCommands("SET"), 0u);
+
+    // Replicas have their own data in the mock.
+    BOOST_CHECK(client.command("GET", {"key"}).isNull());
+    BOOST_CHECK(client.command("get", {"key"}).isNull());
+    BOOST_CHECK_EQUAL(primary.countCommands("GET"), 0u);
+    BOOST_CHECK_EQUAL(replicaCommands("GET"), 2u);
+
+    BOOST_CHECK_EQUAL(client.command(Route::Primary, "GET", {"key"}).toString(), "value");
+    BOOST_CHECK_EQUAL(primary.countCommands("GET"), 1u);
+
+    BOOST_CHECK(client.command(Route::Replica, "SET", {"key", "other"}).isOk());
+    BOOST_CHECK_EQUAL(replicaCommands("SET"), 1u);
+    BOOST_CHECK_EQUAL(primary.countCommands("SET"), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(sync_replica_failover, SyncFixture)
+{
+    // Replica 1 is slower, reads prefer replica 0.
+    replicas[1].setHandler([this](const MockRedisServer::Command &command) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return replicas[1].defaultReply(command);
+    });
+
+    // Both replicas have latency samples.
+    client.command("GET", {"key"});
+    client.command("GET", {"key"});
+    BOOST_CHECK_EQUAL(replicas[0].countCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 1u);
+
+    client.command("GET", {"key"});
+    BOOST_CHECK_EQUAL(replicas[0].countCommands("GET"), 2u);
+
+    replicas[0].stop();
+
+    // The broken replica fails one command, then is skipped.
+    size_t failed = 0;
+
+    for(int i = 0; i < 10; ++i)
+    {
+        boost::system::error_code ec;
+
+        client.command("GET", {"key"}, ec);
+
+        if (ec)
+            ++failed;
+    }
+
+    BOOST_CHECK_EQUAL(failed, 1u);
+    BOOST_CHECK(!client.replica(0).isConnected());
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 10u);
+
+    // No replica left: reads go to the primary.
+    replicas[1].stop();
+
+    size_t before = primary.countCommands("GET");
+    boost::system::error_code ec;
+
+    for(int i = 0; i < 3; ++i)
+        client.command("GET", {"key"}, ec);
+
+    BOOST_CHECK(!client.replica(1).isConnected());
+    BOOST_CHECK_GE(primary.countCommands("GET"), before + 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(async_routes_reads_to_replicas, AsyncFixture)
+{
+    BOOST_CHECK(command(Route::Auto, "SET", {"key", "value"}).isOk());
+    BOOST_CHECK(command(Route::Auto, "GET", {"key"}).isNull());
+    BOOST_CHECK_EQUAL(command(Route::Primary, "GET", {"key"}).toString(), "value");
+    BOOST_CHECK(command(Route::Replica, "SET", {"key", "other"}).isOk());
+
+    BOOST_CHECK_EQUAL(primary.countCommands("SET"), 1u);
+    BOOST_CHECK_EQUAL(primary.countCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(replicaCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(replicaCommands("SET"), 1u);
+
+    for(size_t i = 0; i < client.replicas(); ++i)
+        BOOST_CHECK_EQUAL(client.replicaPending(i), 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(async_replica_failover, AsyncFixture)
+{
+    // Sent to both replicas at once: one each, as the other is busy.
+    size_t replies = 0;
+
+    client.command("GET", {"key"}, [&replies](RedisValue) { ++replies; });
+    client.command("GET", {"key"}, [&replies](RedisValue) { ++replies; });
+
+    BOOST_REQUIRE(runUntil(ioService, [&replies]() { return replies == 2; }));
+    BOOST_CHECK_EQUAL(replicas[0].countCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 1u);
+
+    replicas[0].stop();
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return !client.replica(0).isConnected(); }));
+
+    for(int i = 0; i < 5; ++i)
+        BOOST_CHECK(command(Route::Auto, "GET", {"key"}).isNull());
+
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 6u);
+
+    replicas[1].stop();
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return !client.replica(1).isConnected(); }));
+
+    BOOST_CHECK(command(Route::Replica, "GET", {"key"}).isNull());
+    BOOST_CHECK_EQUAL(primary.countCommands("GET"), 1u);
+
+    // Back in use once reconnected.
+    replicas[1].start();
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return client.replica(1).isConnected(); }));
+
+    BOOST_CHECK(command(Route::Auto, "GET", {"key"}).isNull());
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 7u);
+    BOOST_CHECK_EQUAL(primary.countCommands("GET"), 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(dropped_commands_are_not_pending, AsyncFixture)
+{
+    // HANG never gets a reply.
+    for(size_t i = 0; i < client.replicas(); ++i)
+    {
+        MockRedisServer &replica = replicas[i];
+
+        replica.setHandler([&replica](const MockRedisServer::Command &command) {
+            return command[0] == "HANG" ? std::string() : replica.defaultReply(command);
+        });
+    }
+
+    size_t replies = 0;
+
+    for(int i = 0; i < 4; ++i)
+        client.command(Route::Replica, "HANG", {}, [&replies](RedisValue) { ++replies; });
+
+    BOOST_CHECK_EQUAL(client.replicaPending(0) + client.replicaPending(1), 4u);
+    BOOST_REQUIRE(runUntil(ioService, [this]() { return replicaCommands("HANG") == 4; }));
+
+    client.replica(0).disconnect();
+    client.replica(1).disconnect();
+
+    BOOST_CHECK_EQUAL(replies, 0u);
+    BOOST_CHECK_EQUAL(client.replicaPending(0), 0u);
+    BOOST_CHECK_EQUAL(client.replicaPending(1), 0u);
+
+    // Both replicas are chosen again once reconnected.
+    client.connect(primary.endpoint(), replicaEndpoints(), [](boost::system::error_code) {});
+    BOOST_REQUIRE(runUntil(ioService, [this]() {
+        return client.replica(0).isConnected() && client.replica(1).isConnected();
+    }));
+
+    BOOST_CHECK(command(Route::Replica, "GET", {"key"}).isNull());
+    BOOST_CHECK(command(Route::Replica, "GET", {"key"}).isNull());
+    BOOST_CHECK_EQUAL(replicas[0].countCommands("GET"), 1u);
+    BOOST_CHECK_EQUAL(replicas[1].countCommands("GET"), 1u);
+}
@@ -0,0 +1,124 @@
+#define BOOST_TEST_MODULE shardedclient
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <redisclient/shardedclient.h>
+
+#include "mockredisserver.h"
+
+using redisclient::RedisValue;
+using redisclient::ShardedClient;
+using redisclient::test::MockRedisServer;
+
+namespace
+{
+    // Run ioService until pred() holds, at most two seconds.
+    bool runUntil(boost::asio::io_service &ioService, const std::function<bool()> &pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+
+            ioService.restart();
+            ioService.run_for(std::chrono::milliseconds(5));
+        }
+
+        return true;
+    }
+
+    struct Fixture
+    {
+        Fixture()
+            : client(ioService)
+        {
+            for(auto &server: servers)
+                client.addShard(server.endpoint());
+
+            bool connected = false;
+
+            client.connect([&connected](boost::system::error_code ec) {
+                BOOST_CHECK(!ec);
+                connected = true;
+            });
+
+            BOOST_REQUIRE(runUntil(ioService, [&connected]() { return connected; }));
+        }
+
+        // A key of shard, distinct for each n.
+        std::string keyOf(size_t shard, size_t n = 0) const
+        {
+            for(size_t i = 0;; ++i)
+            {
+                std::string key = "key" + std::to_string(i);
+
+                if (client.shardOf(key) == shard && n-- == 0)
+                    return key;
+            }
+        }
+
+        MockRedisServer servers[3];
+        boost::asio::io_service ioService;
+        ShardedClient client;
+    };
+}
+
+BOOST_FIXTURE_TEST_CASE(pipeline_replies_keep_order, Fixture)
+{
+    std::string keys[3] = { keyOf(0), keyOf(1), keyOf(2) };
+    std::string other = keyOf(2, 1);
+    bool done = false;
+    RedisValue result;
+
+    // Transactions start on keyless commands, shard 0 without blocks.
+    client.pipelined({
+            {"SET", keys[2], "c"},
+            {"SET", keys[1], "b"},
+            {"MULTI"},
+            {"SET", keys[1], "d"},
+            {"GET", keys[1]},
+            {"EXEC"},
+            {"GET", keys[2]},
+            {"WATCH", other},
+            {"GET", other},
+            {"MULTI"},
+            {"INCR", other},
+            {"EXEC"}
+        }, [&done, &result](RedisValue v) {
+            result = std::move(v);
+            done = true;
+        });
+
+    BOOST_REQUIRE(runUntil(ioService, [&done]() { return done; }));
+    BOOST_REQUIRE(result.isArray());
+
+    const std::vector<RedisValue> &replies = result.getArray();
+
+    BOOST_REQUIRE_EQUAL(replies.size(), 12u);
+    BOOST_CHECK(replies[0].isOk());
+    BOOST_CHECK(replies[1].isOk());
+    BOOST_CHECK(replies[2].isOk());
+    BOOST_CHECK(replies[3].isOk());
+    BOOST_CHECK_EQUAL(replies[4].toString(), "d");
+    BOOST_CHECK(replies[5].isArray());
+    BOOST_CHECK_EQUAL(replies[6].toString(), "c");
+    BOOST_CHECK(replies[8].isNull());
+    BOOST_CHECK_EQUAL(replies[10].toInt(), 1);
+
+    std::vector<MockRedisServer::Command> shard1 = {
+        {"SET", keys[1], "b"}, {"MULTI"}, {"SET", keys[1], "d"}, {"GET", keys[1]}, {"EXEC"}
+    };
+    std::vector<MockRedisServer::Command> shard2 = {
+        {"SET", keys[2], "c"}, {"GET", keys[2]},
+        {"WATCH", other}, {"GET", other}, {"MULTI"}, {"INCR", other}, {"EXEC"}
+    };
+
+    BOOST_CHECK(servers[0].commands().empty());
+    BOOST_CHECK(servers[1].commands() == shard1);
+    BOOST_CHECK(servers[2].commands() == shard2);
+}